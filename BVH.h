@@ -0,0 +1,532 @@
+/**
+Program name: BVH.h
+Purpose: bounding volume hierarchy over boxed primitives, used to skip intersection tests against objects a ray cannot hit
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <thread>
+#include <atomic>
+
+#define BVH_LEAF_SIZE 4//most primitives kept in a leaf, unless build_bvh(...) is told otherwise
+#define BVH_MEDIAN_DEPTH 32//past this depth every builder splits at the median, so even lopsided trees stay under BVH_STACK_SIZE deep
+#define BVH_STACK_SIZE 96//deepest traversal, BVH_MEDIAN_DEPTH levels followed by median splits of 2^64 primitives would still fit
+#define BVH_TRAVERSAL_COST 1.0f//surface area heuristic cost of visiting a node, relative to testing one primitive
+#define BVH_SAH_BINS 16//bins per axis the binned surface area heuristic builder sorts centres into, a split is tried between every two
+#define BVH_PARALLEL_MINIMUM 4096//fewest primitives under a node for its two children to be built on separate threads
+#define BVH_NO_NODE UINT_MAX//what bvh_entry_node(...) returns when no leaf is wanted
+
+//How build_bvh(...) splits nodes.
+enum BVH_Builder
+{
+    BVH_BUILDER_MEDIAN,//at the median of the centres along their widest axis
+    BVH_BUILDER_SAH,//where the binned surface area heuristic is lowest, slower to build than the median but faster to trace
+    BVH_BUILDER_MORTON//LBVH, centres sorted along a Morton curve and split where their codes first differ, the fastest to build, for previews
+};
+
+//Axis aligned box.
+struct Bounding_Box
+{
+    float minimum [3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maximum [3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+};
+
+//Node of a BVH. Children are stored next to each other, after their parent.
+struct BVH_Node
+{
+    struct Bounding_Box bounds;
+    unsigned int first;//index of the left child, right child is first + 1, or for leaves the index into BVH::primitive_indices of the first primitive
+    unsigned int count;//number of primitives, 0 for interior nodes
+};
+
+struct BVH
+{
+    std::vector<struct BVH_Node> nodes;//nodes[0] is the root, empty if there are no primitives
+    std::vector<unsigned int> primitive_indices;//primitives ordered so that every leaf refers to a contiguous range
+    float built_cost = 0.0f;//bvh_cost(...) right after the last build, refits are compared against it
+};
+
+/*
+ * Grows a box to also contain another box.
+ *
+ * box: box being grown
+ * OTHER: box to include
+ */
+static void grow_bounding_box(struct Bounding_Box& box, const struct Bounding_Box& OTHER)
+{
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        box.minimum[i] = std::min(box.minimum[i], OTHER.minimum[i]);
+        box.maximum[i] = std::max(box.maximum[i], OTHER.maximum[i]);
+    }
+}
+
+/*
+ * Calculates the surface area of a box, 0 for empty boxes.
+ *
+ * BOX: box being measured
+ */
+static float bounding_box_area(const struct Bounding_Box& BOX)
+{
+    const float EXTENT [3] = {BOX.maximum[0] - BOX.minimum[0], BOX.maximum[1] - BOX.minimum[1], BOX.maximum[2] - BOX.minimum[2]};
+
+    if (EXTENT[0] < 0.0f || EXTENT[1] < 0.0f || EXTENT[2] < 0.0f)
+        return 0.0f;
+    return 2.0f * (EXTENT[0] * EXTENT[1] + EXTENT[1] * EXTENT[2] + EXTENT[2] * EXTENT[0]);
+}
+
+/*
+ * Surface area heuristic cost of a tree, the expected cost of a ray that hits the root. Every node costs the chance of a ray hitting it, its area over the root's,
+ * times BVH_TRAVERSAL_COST for interior nodes or the number of primitives for leaves. Lower is better, refitting moved primitives makes it grow.
+ *
+ * TREE: tree being measured
+ */
+static float bvh_cost(const struct BVH& TREE)
+{
+    float cost = 0.0f;
+
+    if (TREE.nodes.empty() || bounding_box_area(TREE.nodes[0].bounds) <= 0.0f)
+        return 0.0f;
+    for (unsigned int i = 0; i < TREE.nodes.size(); ++i)
+        cost += bounding_box_area(TREE.nodes[i].bounds) * (TREE.nodes[i].count > 0 ? static_cast<float>(TREE.nodes[i].count) : BVH_TRAVERSAL_COST);
+    return cost / bounding_box_area(TREE.nodes[0].bounds);
+}
+
+/*
+ * Spreads the low 10 bits of a value out to every third bit, for interleaving them into Morton codes.
+ *
+ * VALUE: bits spread
+ */
+static unsigned int spread_morton_bits(unsigned int value)
+{
+    value &= 0x3ffu;
+    value = (value | value << 16) & 0x030000ffu;
+    value = (value | value << 8) & 0x0300f00fu;
+    value = (value | value << 4) & 0x030c30c3u;
+    value = (value | value << 2) & 0x09249249u;
+    return value;
+}
+
+/*
+ * Bin of the binned surface area heuristic a primitive's centre falls in along an axis.
+ *
+ * PRIMITIVE: box of the primitive
+ * CENTRE_BOUNDS: box of the centres being binned
+ * SCALE: BVH_SAH_BINS over the width of CENTRE_BOUNDS along AXIS, which must be over 0
+ * AXIS: axis binned along
+ */
+static unsigned int sah_bin(const struct Bounding_Box& PRIMITIVE, const struct Bounding_Box& CENTRE_BOUNDS, const float SCALE, const unsigned int AXIS)
+{
+    const float BIN = ((PRIMITIVE.minimum[AXIS] + PRIMITIVE.maximum[AXIS]) * 0.5f - CENTRE_BOUNDS.minimum[AXIS]) * SCALE;
+
+    return BIN <= 0.0f ? 0 : std::min(static_cast<unsigned int>(BIN), static_cast<unsigned int>(BVH_SAH_BINS - 1));
+}
+
+/*
+ * Splits tree.primitive_indices[FIRST, FIRST + COUNT) where the binned surface area heuristic is lowest. Centres are sorted into BVH_SAH_BINS bins along every
+ * axis, and each of the splits between bins is costed as the area of the box of either side times the number of primitives in it, in a sweep from each end.
+ * Returns the number of primitives moved to the front, 0 if no split leaves primitives on both sides.
+ *
+ * tree: tree being built
+ * PRIMITIVE_BOUNDS: box of every primitive
+ * FIRST, COUNT: primitives split
+ * CENTRE_BOUNDS: box of their centres
+ */
+static unsigned int sah_split(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS, const unsigned int FIRST, const unsigned int COUNT,
+                              const struct Bounding_Box& CENTRE_BOUNDS)
+{
+    struct Bounding_Box bins [3][BVH_SAH_BINS];
+    unsigned int counts [3][BVH_SAH_BINS] = {{0}}, i, axis, best_axis = 0, best_bin = BVH_SAH_BINS;
+    float scales [3], best_cost = FLT_MAX;
+
+    for (axis = 0; axis < 3; ++axis)
+        scales[axis] = CENTRE_BOUNDS.maximum[axis] > CENTRE_BOUNDS.minimum[axis] ? BVH_SAH_BINS / (CENTRE_BOUNDS.maximum[axis] - CENTRE_BOUNDS.minimum[axis]) : 0.0f;
+    for (i = FIRST; i < FIRST + COUNT; ++i)
+        for (axis = 0; axis < 3; ++axis)
+            if (scales[axis] > 0.0f)
+            {
+                const struct Bounding_Box& PRIMITIVE = PRIMITIVE_BOUNDS[tree.primitive_indices[i]];
+                const unsigned int BIN = sah_bin(PRIMITIVE, CENTRE_BOUNDS, scales[axis], axis);
+
+                grow_bounding_box(bins[axis][BIN], PRIMITIVE);
+                ++counts[axis][BIN];
+            }
+    for (axis = 0; axis < 3; ++axis)
+    {
+        struct Bounding_Box left, right;
+        float right_costs [BVH_SAH_BINS];//area times count of bins (bin, BVH_SAH_BINS)
+        unsigned int left_count = 0, right_count = 0, bin;
+
+        if (scales[axis] <= 0.0f)
+            continue;
+        for (bin = BVH_SAH_BINS - 1; bin > 0; --bin)
+        {
+            grow_bounding_box(right, bins[axis][bin]);
+            right_count += counts[axis][bin];
+            right_costs[bin - 1] = right_count > 0 ? bounding_box_area(right) * right_count : -1.0f;
+        }
+        for (bin = 0; bin + 1 < BVH_SAH_BINS; ++bin)//split after bin
+        {
+            grow_bounding_box(left, bins[axis][bin]);
+            left_count += counts[axis][bin];
+            if (left_count > 0 && right_costs[bin] >= 0.0f && bounding_box_area(left) * left_count + right_costs[bin] < best_cost)
+            {
+                best_cost = bounding_box_area(left) * left_count + right_costs[bin];
+                best_axis = axis;
+                best_bin = bin;
+            }
+        }
+    }
+    if (best_bin == BVH_SAH_BINS)
+        return 0;
+    return static_cast<unsigned int>(std::partition(tree.primitive_indices.begin() + FIRST, tree.primitive_indices.begin() + FIRST + COUNT, [&](const unsigned int PRIMITIVE)
+    {
+        return sah_bin(PRIMITIVE_BOUNDS[PRIMITIVE], CENTRE_BOUNDS, scales[best_axis], best_axis) <= best_bin;
+    }) - (tree.primitive_indices.begin() + FIRST));
+}
+
+/*
+ * Splits primitives sorted by Morton code where the highest bit their codes differ in changes, so each side holds one half of the space the range spans. Returns
+ * the number of primitives on the first side, 0 if every code is the same.
+ *
+ * MORTON_CODES: code of every primitive, in the order of tree.primitive_indices
+ * FIRST, COUNT: primitives split
+ */
+static unsigned int morton_split(const std::vector<unsigned int>& MORTON_CODES, const unsigned int FIRST, const unsigned int COUNT)
+{
+    const unsigned int DIFFERENT_BITS = MORTON_CODES[FIRST] ^ MORTON_CODES[FIRST + COUNT - 1];
+    unsigned int bit = 31;
+
+    if (DIFFERENT_BITS == 0)
+        return 0;
+    while ((DIFFERENT_BITS >> bit & 1u) == 0)
+        --bit;
+    return static_cast<unsigned int>(std::partition_point(MORTON_CODES.begin() + FIRST, MORTON_CODES.begin() + FIRST + COUNT, [bit](const unsigned int CODE)
+    {
+        return (CODE >> bit & 1u) == 0;
+    }) - (MORTON_CODES.begin() + FIRST));
+}
+
+/*
+ * Recursively builds the subtree of NODE_INDEX over tree.primitive_indices[FIRST, FIRST + COUNT). Nodes of more than LEAF_SIZE primitives are split as BUILDER
+ * says, falling back to the median of the centres along the axis in which they are most spread out when it cannot split them or DEPTH reaches BVH_MEDIAN_DEPTH. Children are taken from node_count,
+ * always after their parent, and with THREAD_COUNT over 1 big enough subtrees build their children on separate threads, each with half the threads.
+ *
+ * tree: tree being built, tree.nodes already sized for every node, NODE_INDEX must already be taken
+ * PRIMITIVE_BOUNDS: box of every primitive
+ * BUILDER: see BVH_Builder
+ * LEAF_SIZE: most primitives kept in a leaf
+ * MORTON_CODES: see morton_split(...), only for BVH_BUILDER_MORTON
+ * node_count: nodes taken so far
+ * NODE_INDEX: node to fill in
+ * FIRST, COUNT: range of primitives under the node
+ * DEPTH: depth of the node, 0 for the root
+ * THREAD_COUNT: threads the subtree may be built on
+ */
+static void build_bvh_node(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS, const enum BVH_Builder BUILDER, const unsigned int LEAF_SIZE,
+                           const std::vector<unsigned int>& MORTON_CODES, std::atomic<unsigned int>& node_count, const unsigned int NODE_INDEX, const unsigned int FIRST, const unsigned int COUNT, const unsigned int DEPTH,
+                           const unsigned int THREAD_COUNT)
+{
+    struct Bounding_Box bounds, centre_bounds;
+    unsigned int i, axis = 0, split = 0;
+
+    for (i = FIRST; i < FIRST + COUNT; ++i)
+    {
+        const struct Bounding_Box& PRIMITIVE = PRIMITIVE_BOUNDS[tree.primitive_indices[i]];
+        struct Bounding_Box centre;
+
+        grow_bounding_box(bounds, PRIMITIVE);
+        for (unsigned int j = 0; j < 3; ++j)
+            centre.minimum[j] = centre.maximum[j] = (PRIMITIVE.minimum[j] + PRIMITIVE.maximum[j]) * 0.5f;
+        grow_bounding_box(centre_bounds, centre);
+    }
+    tree.nodes[NODE_INDEX].bounds = bounds;
+    for (i = 1; i < 3; ++i)
+        if (centre_bounds.maximum[i] - centre_bounds.minimum[i] > centre_bounds.maximum[axis] - centre_bounds.minimum[axis])
+            axis = i;
+
+    //leaf, either small enough or impossible to split
+    if (COUNT <= LEAF_SIZE || centre_bounds.maximum[axis] <= centre_bounds.minimum[axis])
+    {
+        tree.nodes[NODE_INDEX].first = FIRST;
+        tree.nodes[NODE_INDEX].count = COUNT;
+        return;
+    }
+
+    if (DEPTH < BVH_MEDIAN_DEPTH && BUILDER == BVH_BUILDER_SAH)
+        split = sah_split(tree, PRIMITIVE_BOUNDS, FIRST, COUNT, centre_bounds);
+    else if (BUILDER == BVH_BUILDER_MORTON)
+    {
+        split = DEPTH < BVH_MEDIAN_DEPTH ? morton_split(MORTON_CODES, FIRST, COUNT) : 0;
+        if (split == 0)//the middle of the curve stands in for the median, and keeps the codes in order
+            split = COUNT / 2;
+    }
+    if (split == 0)
+    {
+        split = COUNT / 2;
+        std::nth_element(tree.primitive_indices.begin() + FIRST, tree.primitive_indices.begin() + FIRST + split, tree.primitive_indices.begin() + FIRST + COUNT,
+                         [&](const unsigned int A, const unsigned int B)
+                         {
+                             return PRIMITIVE_BOUNDS[A].minimum[axis] + PRIMITIVE_BOUNDS[A].maximum[axis] < PRIMITIVE_BOUNDS[B].minimum[axis] + PRIMITIVE_BOUNDS[B].maximum[axis];
+                         });
+    }
+
+    {
+        const unsigned int CHILD_INDEX = node_count.fetch_add(2);
+
+        tree.nodes[NODE_INDEX].first = CHILD_INDEX;
+        tree.nodes[NODE_INDEX].count = 0;
+        if (THREAD_COUNT > 1 && COUNT >= BVH_PARALLEL_MINIMUM)
+        {
+            std::thread left([&]()
+            {
+                build_bvh_node(tree, PRIMITIVE_BOUNDS, BUILDER, LEAF_SIZE, MORTON_CODES, node_count, CHILD_INDEX, FIRST, split, DEPTH + 1, THREAD_COUNT / 2);
+            });
+
+            build_bvh_node(tree, PRIMITIVE_BOUNDS, BUILDER, LEAF_SIZE, MORTON_CODES, node_count, CHILD_INDEX + 1, FIRST + split, COUNT - split, DEPTH + 1, THREAD_COUNT - THREAD_COUNT / 2);
+            left.join();
+        }
+        else
+        {
+            build_bvh_node(tree, PRIMITIVE_BOUNDS, BUILDER, LEAF_SIZE, MORTON_CODES, node_count, CHILD_INDEX, FIRST, split, DEPTH + 1, THREAD_COUNT);
+            build_bvh_node(tree, PRIMITIVE_BOUNDS, BUILDER, LEAF_SIZE, MORTON_CODES, node_count, CHILD_INDEX + 1, FIRST + split, COUNT - split, DEPTH + 1, THREAD_COUNT);
+        }
+    }
+}
+
+/*
+ * Builds a BVH from scratch, replacing whatever tree held. The Morton builder first sorts the primitives by the Morton code of their centre, 10 bits per axis
+ * over the box of every centre.
+ *
+ * tree: where the BVH is stored
+ * PRIMITIVE_BOUNDS: box of every primitive, primitives are referred to by their index in this
+ * BUILDER: how nodes are split
+ * THREAD_COUNT: threads the tree may be built on, at least 1
+ * LEAF_SIZE: most primitives kept in a leaf, at least 1
+ */
+static void build_bvh(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS, const enum BVH_Builder BUILDER, const unsigned int THREAD_COUNT,
+                      const unsigned int LEAF_SIZE)
+{
+    std::vector<unsigned int> morton_codes;
+    std::atomic<unsigned int> node_count(1);
+
+    tree.nodes.clear();
+    tree.primitive_indices.resize(PRIMITIVE_BOUNDS.size());
+    for (unsigned int i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+        tree.primitive_indices[i] = i;
+    if (PRIMITIVE_BOUNDS.empty())
+        return;
+    if (BUILDER == BVH_BUILDER_MORTON)
+    {
+        struct Bounding_Box centre_bounds;
+        std::vector<std::pair<unsigned int, unsigned int> > sorted(PRIMITIVE_BOUNDS.size());//{code, primitive}
+
+        for (unsigned int i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+            for (unsigned int j = 0; j < 3; ++j)
+            {
+                const float CENTRE = (PRIMITIVE_BOUNDS[i].minimum[j] + PRIMITIVE_BOUNDS[i].maximum[j]) * 0.5f;
+
+                centre_bounds.minimum[j] = std::min(centre_bounds.minimum[j], CENTRE);
+                centre_bounds.maximum[j] = std::max(centre_bounds.maximum[j], CENTRE);
+            }
+        for (unsigned int i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+        {
+            sorted[i].first = 0;
+            sorted[i].second = i;
+            for (unsigned int j = 0; j < 3; ++j)
+            {
+                const float EXTENT = centre_bounds.maximum[j] - centre_bounds.minimum[j];
+                const float QUANTIZED = EXTENT > 0.0f ? ((PRIMITIVE_BOUNDS[i].minimum[j] + PRIMITIVE_BOUNDS[i].maximum[j]) * 0.5f - centre_bounds.minimum[j]) / EXTENT * 1023.0f + 0.5f : 0.0f;
+
+                sorted[i].first |= spread_morton_bits(static_cast<unsigned int>(QUANTIZED)) << (2 - j);
+            }
+        }
+        std::sort(sorted.begin(), sorted.end());
+        morton_codes.resize(sorted.size());
+        for (unsigned int i = 0; i < sorted.size(); ++i)
+        {
+            morton_codes[i] = sorted[i].first;
+            tree.primitive_indices[i] = sorted[i].second;
+        }
+    }
+    tree.nodes.resize(2 * PRIMITIVE_BOUNDS.size() - 1);//most a tree with a primitive or more per leaf can have
+    build_bvh_node(tree, PRIMITIVE_BOUNDS, BUILDER, LEAF_SIZE, morton_codes, node_count, 0, 0, static_cast<unsigned int>(PRIMITIVE_BOUNDS.size()), 0, THREAD_COUNT);
+    tree.nodes.resize(node_count.load());
+    tree.built_cost = bvh_cost(tree);
+}
+
+/*
+ * Builds a BVH from scratch with median splits on one thread and leaves of up to BVH_LEAF_SIZE primitives, see build_bvh(...) above.
+ *
+ * tree: where the BVH is stored
+ * PRIMITIVE_BOUNDS: box of every primitive, primitives are referred to by their index in this
+ */
+static void build_bvh(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS)
+{
+    build_bvh(tree, PRIMITIVE_BOUNDS, BVH_BUILDER_MEDIAN, 1, BVH_LEAF_SIZE);
+}
+
+/*
+ * Updates the boxes of a tree for primitives that moved, keeping its structure. Much cheaper than build_bvh(...), but the tree gets worse the further primitives move
+ * from where they were when it was built, which bvh_cost(...) measures.
+ *
+ * tree: tree being updated, built over the same primitives
+ * PRIMITIVE_BOUNDS: new box of every primitive
+ */
+static void refit_bvh(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS)
+{
+    //children always come after their parent, so going backwards visits children first
+    for (unsigned int i = static_cast<unsigned int>(tree.nodes.size()); i-- > 0;)
+    {
+        struct BVH_Node& node = tree.nodes[i];
+
+        node.bounds = Bounding_Box();
+        if (node.count > 0)
+            for (unsigned int j = node.first; j < node.first + node.count; ++j)
+                grow_bounding_box(node.bounds, PRIMITIVE_BOUNDS[tree.primitive_indices[j]]);
+        else
+        {
+            grow_bounding_box(node.bounds, tree.nodes[node.first].bounds);
+            grow_bounding_box(node.bounds, tree.nodes[node.first + 1].bounds);
+        }
+    }
+}
+
+/*
+ * Slab test of a ray against a box. Returns true if the ray is inside the box for some distance in [MINIMUM_DISTANCE, MAXIMUM_DISTANCE].
+ *
+ * BOX: box tested
+ * RAY_ORIGIN: point origin of the ray
+ * INVERSE_DIRECTION: 1 / ray direction per axis, infinities for 0 components work out
+ * MINIMUM_DISTANCE, MAXIMUM_DISTANCE: part of the ray that matters, in terms of scalar
+ */
+static bool ray_hits_bounding_box(const struct Bounding_Box& BOX, const float RAY_ORIGIN [3], const float INVERSE_DIRECTION [3], float minimum_distance, float maximum_distance)
+{
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        float near_distance = (BOX.minimum[i] - RAY_ORIGIN[i]) * INVERSE_DIRECTION[i], far_distance = (BOX.maximum[i] - RAY_ORIGIN[i]) * INVERSE_DIRECTION[i];
+
+        if (near_distance > far_distance)
+            std::swap(near_distance, far_distance);
+        //written so NaN, from a 0 direction starting on a slab, leaves the interval alone
+        minimum_distance = near_distance > minimum_distance ? near_distance : minimum_distance;
+        maximum_distance = far_distance < maximum_distance ? far_distance : maximum_distance;
+        if (minimum_distance > maximum_distance)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Visits the leaves of a BVH a ray passes through, nearest child first. intersect_leaf is called as intersect_leaf(first, count) for the range of
+ * TREE.primitive_indices of every leaf and returns true to stop the traversal, which is what shadow rays do on their first blocker. Closest hit queries lower
+ * maximum_distance as they find hits, through the reference, so farther nodes get skipped.
+ *
+ * TREE: tree traversed
+ * RAY_ORIGIN: point origin of the ray
+ * RAY_DIRECTION: mathematical vector of the ray's direction
+ * MINIMUM_DISTANCE: closest distance, in terms of scalar, a hit can be at
+ * maximum_distance: farthest distance a hit can be at
+ * ROOT: node the traversal starts from, 0 for the whole tree, see bvh_entry_node(...)
+ * intersect_leaf: see above
+ */
+template <typename Leaf_Function>
+static void traverse_bvh_leaves(const struct BVH& TREE, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                                const unsigned int ROOT, Leaf_Function intersect_leaf)
+{
+    const float INVERSE_DIRECTION [3] = {1.0f / RAY_DIRECTION[0], 1.0f / RAY_DIRECTION[1], 1.0f / RAY_DIRECTION[2]};
+    unsigned int stack [BVH_STACK_SIZE], stack_size = 0;
+
+    if (TREE.nodes.empty())
+        return;
+    stack[stack_size++] = ROOT;
+    while (stack_size > 0)
+    {
+        const struct BVH_Node& NODE = TREE.nodes[stack[--stack_size]];
+
+        if (!ray_hits_bounding_box(NODE.bounds, RAY_ORIGIN, INVERSE_DIRECTION, MINIMUM_DISTANCE, maximum_distance))
+            continue;
+        if (NODE.count > 0)
+        {
+            if (intersect_leaf(NODE.first, NODE.count))
+                return;
+        }
+        else
+        {
+            //push the far child first so the near one is popped first, near is decided by the ray's direction along the split axis' centres
+            const struct BVH_Node& LEFT = TREE.nodes[NODE.first];
+            const struct BVH_Node& RIGHT = TREE.nodes[NODE.first + 1];
+            float left_centre_distance = 0.0f, right_centre_distance = 0.0f;
+
+            for (unsigned int i = 0; i < 3; ++i)
+            {
+                left_centre_distance += (LEFT.bounds.minimum[i] + LEFT.bounds.maximum[i]) * RAY_DIRECTION[i];
+                right_centre_distance += (RIGHT.bounds.minimum[i] + RIGHT.bounds.maximum[i]) * RAY_DIRECTION[i];
+            }
+            if (left_centre_distance < right_centre_distance)
+            {
+                stack[stack_size++] = NODE.first + 1;
+                stack[stack_size++] = NODE.first;
+            }
+            else
+            {
+                stack[stack_size++] = NODE.first;
+                stack[stack_size++] = NODE.first + 1;
+            }
+        }
+    }
+}
+
+/*
+ * Visits the primitives in the leaves of a BVH a ray passes through, see traverse_bvh_leaves(...). intersect_primitive is called as intersect_primitive(primitive index)
+ * and returns true to stop the traversal.
+ *
+ * TREE, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance: see traverse_bvh_leaves(...)
+ * intersect_primitive: see above
+ */
+template <typename Primitive_Function>
+static void traverse_bvh(const struct BVH& TREE, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                         Primitive_Function intersect_primitive)
+{
+    traverse_bvh_leaves(TREE, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, 0, [&](const unsigned int FIRST, const unsigned int COUNT)
+    {
+        for (unsigned int i = FIRST; i < FIRST + COUNT; ++i)
+            if (intersect_primitive(TREE.primitive_indices[i]))
+                return true;
+        return false;
+    });
+}
+
+/*
+ * Node a traversal can start from instead of the root when every ray only ever enters boxes box_wanted accepts, such as boxes seen through part of the image:
+ * the deepest node all the accepted leaves are under, found by going down for as long as just one child is accepted. Returns BVH_NO_NODE if nothing is.
+ * The nodes skipped are ones such rays pass through anyway or never enter, so leaves are still visited in the same order as from the root.
+ *
+ * TREE: tree the node is in
+ * box_wanted: called as box_wanted(node's bounds), true if a ray may enter the box
+ */
+template <typename Box_Function>
+static unsigned int bvh_entry_node(const struct BVH& TREE, Box_Function box_wanted)
+{
+    unsigned int node = 0;
+
+    if (TREE.nodes.empty() || !box_wanted(TREE.nodes[0].bounds))
+        return BVH_NO_NODE;
+    while (TREE.nodes[node].count == 0)
+    {
+        const bool LEFT = box_wanted(TREE.nodes[TREE.nodes[node].first].bounds), RIGHT = box_wanted(TREE.nodes[TREE.nodes[node].first + 1].bounds);
+
+        if (LEFT == RIGHT)
+            return LEFT ? node : BVH_NO_NODE;
+        node = TREE.nodes[node].first + (LEFT ? 0 : 1);
+    }
+    return node;
+}
+
+#endif /* BVH_H_ */
@@ -0,0 +1,254 @@
+/**
+Program name: Frame_Buffer.h
+Purpose: final image storage, either float or quantized to 8/16 bits per channel, filled one rendered tile at a time
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef FRAME_BUFFER_H_
+#define FRAME_BUFFER_H_
+
+#include "CImg.h"
+#include <vector>
+#include <string>
+#include <math.h>
+
+//How a frame buffer stores each channel.
+enum Frame_Buffer_Depth
+{
+    FRAME_BUFFER_AUTOMATIC,//not chosen, float for float output formats and 8 bit otherwise
+    FRAME_BUFFER_8_BIT,//tonemapped and quantized when a tile is stored, 3 bytes per pixel
+    FRAME_BUFFER_16_BIT,//tonemapped and quantized when a tile is stored, 6 bytes per pixel
+    FRAME_BUFFER_FLOAT//radiance as rendered, tonemapped when written, 12 bytes per pixel
+};
+
+//Mapping from rendered radiance to displayable [0, 1] values.
+enum Tonemap
+{
+    TONEMAP_CLAMP,//anything above 1 becomes 1, as always
+    TONEMAP_REINHARD//c / (1 + c), keeps detail in highlights at the cost of overall brightness
+};
+
+//Final image, RGB interleaved, row major. Only the vector matching depth is used.
+struct Frame_Buffer
+{
+    unsigned int width = 0, height = 0;
+    enum Frame_Buffer_Depth depth = FRAME_BUFFER_8_BIT;
+    enum Tonemap tonemap = TONEMAP_CLAMP;
+    bool srgb = false;//quantized values are sRGB encoded instead of linear
+    std::vector<unsigned char> pixels_8_bit;
+    std::vector<unsigned short> pixels_16_bit;
+    std::vector<float> pixels_float;
+};
+
+/*
+ * Reads a depth's name. Returns false, leaving depth alone, if the name is unknown.
+ *
+ * NAME: "8", "16" or "float"
+ * depth: where the depth is stored
+ */
+static bool read_frame_buffer_depth(const std::string& NAME, enum Frame_Buffer_Depth& depth)
+{
+    if (NAME == "8")
+        depth = FRAME_BUFFER_8_BIT;
+    else if (NAME == "16")
+        depth = FRAME_BUFFER_16_BIT;
+    else if (NAME == "float")
+        depth = FRAME_BUFFER_FLOAT;
+    else
+        return false;
+    return true;
+}
+
+/*
+ * Sets a frame buffer's size and clears it to black, allocating only the storage its depth needs.
+ *
+ * frame_buffer: frame buffer being set up, depth must not be FRAME_BUFFER_AUTOMATIC
+ * WIDTH, HEIGHT: size in pixels
+ */
+static void allocate_frame_buffer(struct Frame_Buffer& frame_buffer, const unsigned int WIDTH, const unsigned int HEIGHT)
+{
+    const size_t SIZE = static_cast<size_t>(WIDTH) * HEIGHT * 3;
+
+    frame_buffer.width = WIDTH;
+    frame_buffer.height = HEIGHT;
+    frame_buffer.pixels_8_bit.assign(frame_buffer.depth == FRAME_BUFFER_8_BIT ? SIZE : 0, 0);
+    frame_buffer.pixels_16_bit.assign(frame_buffer.depth == FRAME_BUFFER_16_BIT ? SIZE : 0, 0);
+    frame_buffer.pixels_float.assign(frame_buffer.depth == FRAME_BUFFER_FLOAT ? SIZE : 0, 0.0f);
+    frame_buffer.pixels_8_bit.shrink_to_fit();
+    frame_buffer.pixels_16_bit.shrink_to_fit();
+    frame_buffer.pixels_float.shrink_to_fit();
+}
+
+/*
+ * Swaps the contents of two frame buffers, used to hand a finished frame to the image writer without copying it.
+ *
+ * a, b: frame buffers swapped
+ */
+static void swap_frame_buffers(struct Frame_Buffer& a, struct Frame_Buffer& b)
+{
+    std::swap(a.width, b.width);
+    std::swap(a.height, b.height);
+    std::swap(a.depth, b.depth);
+    std::swap(a.tonemap, b.tonemap);
+    std::swap(a.srgb, b.srgb);
+    a.pixels_8_bit.swap(b.pixels_8_bit);
+    a.pixels_16_bit.swap(b.pixels_16_bit);
+    a.pixels_float.swap(b.pixels_float);
+}
+
+/*
+ * Maps a radiance channel to [0, 1], with the tonemap and optionally the sRGB transfer function.
+ *
+ * FRAME_BUFFER: frame buffer whose settings are used
+ * VALUE: rendered radiance
+ */
+static float tonemap_channel(const struct Frame_Buffer& FRAME_BUFFER, float value)
+{
+    if (FRAME_BUFFER.tonemap == TONEMAP_REINHARD && value > 0.0f)
+        value /= 1.0f + value;
+    if (value >= 1.0f)
+        return 1.0f;
+    if (value <= 0.0f)
+        return 0.0f;
+    if (FRAME_BUFFER.srgb)
+        value = value <= 0.0031308f ? value * 12.92f : 1.055f * static_cast<float>(pow(value, 1.0f / 2.4f)) - 0.055f;
+    return value;
+}
+
+/*
+ * Stores a rendered tile. Quantized frame buffers tonemap, clamp and quantize it here, so float values only ever exist in the tile's scratch buffer.
+ * 8 bit values are truncated, which matches how .bmp files were always written.
+ *
+ * frame_buffer: frame buffer stored to
+ * X_START, Y_START: upper left corner of the tile
+ * TILE_WIDTH, TILE_HEIGHT: size of the tile
+ * TILE_PIXELS: rendered radiance of the tile, RGB interleaved, row major
+ */
+static void store_tile(struct Frame_Buffer& frame_buffer, const unsigned int X_START, const unsigned int Y_START, const unsigned int TILE_WIDTH, const unsigned int TILE_HEIGHT,
+                       const float * TILE_PIXELS)
+{
+    for (unsigned int y = 0; y < TILE_HEIGHT; ++y)
+    {
+        const size_t ROW_START = (static_cast<size_t>(Y_START + y) * frame_buffer.width + X_START) * 3;
+        const float * SOURCE = TILE_PIXELS + static_cast<size_t>(y) * TILE_WIDTH * 3;
+
+        for (unsigned int i = 0; i < TILE_WIDTH * 3; ++i)
+            switch (frame_buffer.depth)
+            {
+                case FRAME_BUFFER_FLOAT:
+                    frame_buffer.pixels_float[ROW_START + i] = SOURCE[i];
+                    break;
+                case FRAME_BUFFER_16_BIT:
+                    frame_buffer.pixels_16_bit[ROW_START + i] = static_cast<unsigned short>(tonemap_channel(frame_buffer, SOURCE[i]) * 65535.0f + 0.5f);
+                    break;
+                default:
+                    frame_buffer.pixels_8_bit[ROW_START + i] = static_cast<unsigned char>(tonemap_channel(frame_buffer, SOURCE[i]) * 255.0f);
+                    break;
+            }
+    }
+}
+
+/*
+ * Reads a channel as an 8 bit value, whatever the depth.
+ *
+ * FRAME_BUFFER: frame buffer read
+ * INDEX: (y * width + x) * 3 + channel
+ */
+static unsigned char read_channel_8_bit(const struct Frame_Buffer& FRAME_BUFFER, const size_t INDEX)
+{
+    switch (FRAME_BUFFER.depth)
+    {
+        case FRAME_BUFFER_FLOAT:
+            return static_cast<unsigned char>(tonemap_channel(FRAME_BUFFER, FRAME_BUFFER.pixels_float[INDEX]) * 255.0f);
+        case FRAME_BUFFER_16_BIT:
+            return static_cast<unsigned char>(FRAME_BUFFER.pixels_16_bit[INDEX] >> 8);
+        default:
+            return FRAME_BUFFER.pixels_8_bit[INDEX];
+    }
+}
+
+/*
+ * Reads a channel as a 16 bit value, whatever the depth.
+ *
+ * FRAME_BUFFER: frame buffer read
+ * INDEX: (y * width + x) * 3 + channel
+ */
+static unsigned short read_channel_16_bit(const struct Frame_Buffer& FRAME_BUFFER, const size_t INDEX)
+{
+    switch (FRAME_BUFFER.depth)
+    {
+        case FRAME_BUFFER_FLOAT:
+            return static_cast<unsigned short>(tonemap_channel(FRAME_BUFFER, FRAME_BUFFER.pixels_float[INDEX]) * 65535.0f + 0.5f);
+        case FRAME_BUFFER_16_BIT:
+            return FRAME_BUFFER.pixels_16_bit[INDEX];
+        default:
+            return static_cast<unsigned short>(FRAME_BUFFER.pixels_8_bit[INDEX] * 257);
+    }
+}
+
+/*
+ * Reads a channel as a float, radiance for float frame buffers and the stored [0, 1] value for quantized ones.
+ *
+ * FRAME_BUFFER: frame buffer read
+ * INDEX: (y * width + x) * 3 + channel
+ */
+static float read_channel_float(const struct Frame_Buffer& FRAME_BUFFER, const size_t INDEX)
+{
+    switch (FRAME_BUFFER.depth)
+    {
+        case FRAME_BUFFER_FLOAT:
+            return FRAME_BUFFER.pixels_float[INDEX];
+        case FRAME_BUFFER_16_BIT:
+            return FRAME_BUFFER.pixels_16_bit[INDEX] / 65535.0f;
+        default:
+            return FRAME_BUFFER.pixels_8_bit[INDEX] / 255.0f;
+    }
+}
+
+/*
+ * Copies a frame buffer into an 8 bit CImg, for CImg's own writers and display.
+ *
+ * FRAME_BUFFER: frame buffer copied
+ */
+static cimg_library::CImg<unsigned char> frame_buffer_to_cimg(const struct Frame_Buffer& FRAME_BUFFER)
+{
+    cimg_library::CImg<unsigned char> to_return(FRAME_BUFFER.width, FRAME_BUFFER.height, 1, 3);
+
+    for (unsigned int y = 0; y < FRAME_BUFFER.height; ++y)
+        for (unsigned int x = 0; x < FRAME_BUFFER.width; ++x)
+            for (unsigned int channel = 0; channel < 3; ++channel)
+                to_return(x, y, 0, channel) = read_channel_8_bit(FRAME_BUFFER, (static_cast<size_t>(y) * FRAME_BUFFER.width + x) * 3 + channel);
+    return to_return;
+}
+
+/*
+ * Fills a frame buffer, keeping its depth and settings, with a loaded image, such as a previous render to composite a crop into.
+ *
+ * IMAGE: image with 3 channels
+ * MAXIMUM: channel value that means 1, such as 255 for 8 bit files or 1 for float ones
+ * frame_buffer: frame buffer resized to and filled with IMAGE
+ */
+static void cimg_to_frame_buffer(const cimg_library::CImg<float>& IMAGE, const float MAXIMUM, struct Frame_Buffer& frame_buffer)
+{
+    allocate_frame_buffer(frame_buffer, static_cast<unsigned int>(IMAGE.width()), static_cast<unsigned int>(IMAGE.height()));
+    for (unsigned int y = 0; y < frame_buffer.height; ++y)
+        for (unsigned int x = 0; x < frame_buffer.width; ++x)
+            for (unsigned int channel = 0; channel < 3; ++channel)
+            {
+                const size_t INDEX = (static_cast<size_t>(y) * frame_buffer.width + x) * 3 + channel;
+                float value = IMAGE(x, y, 0, channel) / MAXIMUM;
+
+                if (frame_buffer.depth == FRAME_BUFFER_FLOAT)
+                {
+                    frame_buffer.pixels_float[INDEX] = value;
+                    continue;
+                }
+                value = value <= 0.0f ? 0.0f : value >= 1.0f ? 1.0f : value;//already tonemapped, rounded so 8 bit values come back unchanged
+                if (frame_buffer.depth == FRAME_BUFFER_16_BIT)
+                    frame_buffer.pixels_16_bit[INDEX] = static_cast<unsigned short>(value * 65535.0f + 0.5f);
+                else
+                    frame_buffer.pixels_8_bit[INDEX] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+}
+
+#endif /* FRAME_BUFFER_H_ */
@@ -0,0 +1,136 @@
+/**
+Program name: G_Buffer.h
+Purpose: storage for what primary rays hit, kept between frames so material edits can be re-shaded without tracing
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef G_BUFFER_H_
+#define G_BUFFER_H_
+
+#include "Scene_Pieces.h"
+#include <vector>
+#include <limits.h>
+
+#define NO_SAMPLES UINT_MAX//marks a pixel without samples of its own in a Tile_Cache
+
+//Where a primary ray first hits the scene, everything shading needs that does not depend on materials or light colours.
+struct Surface_Hit
+{
+    const struct Object_Light_Properties * object;//nullptr if nothing was hit
+    float distance;//scalar from the camera to point
+    float point [ARRAY_SIZE];//intersection point
+    float normal [ARRAY_SIZE];//normal of object at point
+    float direction [ARRAY_SIZE];//normalized direction of the primary ray
+};
+
+//Surface hits of many samples, one array per field so each pass over them reads contiguous memory.
+struct G_Buffer
+{
+    std::vector<const struct Object_Light_Properties *> objects;
+    std::vector<float> distances;
+    std::vector<float> points, normals, directions;//ARRAY_SIZE floats per sample
+    std::vector<unsigned int> light_masks;//mask_words per sample, bit i of the mask is set when light i reaches the sample
+    unsigned int mask_words = 0;
+};
+
+//Samples of one tile, in the order render_region(...) takes them.
+struct Tile_Cache
+{
+    struct G_Buffer samples;
+    std::vector<unsigned int> refined_samples;//per pixel of the tile, first of its supersamples, NO_SAMPLES if it was not supersampled
+    std::vector<float> secondary_colours;//per sample, 2 * ARRAY_SIZE: the reflected, then the refracted light the deferred secondary pass gathered for it, empty without it
+};
+
+//Samples kept from one frame to the next, see render_region(...).
+struct Render_Cache
+{
+    std::vector<struct Tile_Cache> tiles;//one per tile of the frame, in the order create_tiles(...) makes them
+    bool valid = false;//tiles hold samples of the current camera and geometry, only materials and lights may have changed since
+    std::vector<unsigned int> moved_lights;//lights that moved since, their bits in every light mask are out of date
+};
+
+/*
+ * Resizes a G-buffer, keeping the samples that still fit.
+ *
+ * g_buffer: G-buffer resized
+ * SAMPLE_COUNT: samples it holds afterwards
+ * MASK_WORDS: words of light mask per sample, enough for one bit per light
+ */
+static void resize_g_buffer(struct G_Buffer& g_buffer, const size_t SAMPLE_COUNT, const unsigned int MASK_WORDS)
+{
+    g_buffer.mask_words = MASK_WORDS;
+    g_buffer.objects.resize(SAMPLE_COUNT);
+    g_buffer.distances.resize(SAMPLE_COUNT);
+    g_buffer.points.resize(SAMPLE_COUNT * ARRAY_SIZE);
+    g_buffer.normals.resize(SAMPLE_COUNT * ARRAY_SIZE);
+    g_buffer.directions.resize(SAMPLE_COUNT * ARRAY_SIZE);
+    g_buffer.light_masks.resize(SAMPLE_COUNT * MASK_WORDS);
+}
+
+/*
+ * Stores a sample's surface hit. Returns its light mask, to be filled in by the caller.
+ *
+ * g_buffer: G-buffer stored to
+ * INDEX: sample stored
+ * HIT: what the sample's primary ray hit
+ */
+static unsigned int * store_g_buffer_sample(struct G_Buffer& g_buffer, const size_t INDEX, const struct Surface_Hit& HIT)
+{
+    g_buffer.objects[INDEX] = HIT.object;
+    g_buffer.distances[INDEX] = HIT.distance;
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+    {
+        g_buffer.points[INDEX * ARRAY_SIZE + i] = HIT.point[i];
+        g_buffer.normals[INDEX * ARRAY_SIZE + i] = HIT.normal[i];
+        g_buffer.directions[INDEX * ARRAY_SIZE + i] = HIT.direction[i];
+    }
+    return &g_buffer.light_masks[INDEX * g_buffer.mask_words];
+}
+
+/*
+ * Reads a sample's surface hit back. Returns its light mask.
+ *
+ * G_BUFFER: G-buffer read
+ * INDEX: sample read
+ * hit: where the sample's surface hit is stored
+ */
+static const unsigned int * load_g_buffer_sample(const struct G_Buffer& G_BUFFER, const size_t INDEX, struct Surface_Hit& hit)
+{
+    hit.object = G_BUFFER.objects[INDEX];
+    hit.distance = G_BUFFER.distances[INDEX];
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+    {
+        hit.point[i] = G_BUFFER.points[INDEX * ARRAY_SIZE + i];
+        hit.normal[i] = G_BUFFER.normals[INDEX * ARRAY_SIZE + i];
+        hit.direction[i] = G_BUFFER.directions[INDEX * ARRAY_SIZE + i];
+    }
+    return &G_BUFFER.light_masks[INDEX * G_BUFFER.mask_words];
+}
+
+/*
+ * Bytes held by a G-buffer.
+ *
+ * G_BUFFER: G-buffer in question
+ */
+static size_t g_buffer_bytes(const struct G_Buffer& G_BUFFER)
+{
+    return G_BUFFER.objects.size() * sizeof(const struct Object_Light_Properties *) +
+           (G_BUFFER.distances.size() + G_BUFFER.points.size() + G_BUFFER.normals.size() + G_BUFFER.directions.size()) * sizeof(float) +
+           G_BUFFER.light_masks.size() * sizeof(unsigned int);
+}
+
+/*
+ * Bytes held by a render cache.
+ *
+ * CACHE: render cache in question
+ */
+static size_t render_cache_bytes(const struct Render_Cache& CACHE)
+{
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < CACHE.tiles.size(); ++i)
+        bytes += g_buffer_bytes(CACHE.tiles[i].samples) + CACHE.tiles[i].refined_samples.size() * sizeof(unsigned int) + CACHE.tiles[i].secondary_colours.size() * sizeof(float);
+    return bytes;
+}
+
+#endif /* G_BUFFER_H_ */
@@ -0,0 +1,222 @@
+/**
+Program name: Grid.h
+Purpose: uniform grid over boxed primitives, walked cell by cell along a ray, an alternative to a BVH for many primitives of similar size packed close together
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef GRID_H_
+#define GRID_H_
+
+#include "BVH.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
+#define GRID_CELLS_PER_PRIMITIVE 2.0f//cells built per primitive, spread over the axes in proportion to the grid's extent
+#define GRID_MAX_RESOLUTION 512//most cells along an axis
+#define GRID_MINIMUM_PRIMITIVES 256//fewer primitives than this always get a BVH, see grid_suits(...)
+#define GRID_SIZE_SPREAD 4.0f//largest primitive box side over the average that grid_suits(...) accepts
+#define GRID_MINIMUM_OCCUPANCY 0.05f//fraction of the grid's volume the primitives' boxes must fill for grid_suits(...)
+
+//Which structure rays find primitives through.
+enum Acceleration_Structure
+{
+    ACCELERATION_AUTOMATIC,//a grid when grid_suits(...), a BVH otherwise
+    ACCELERATION_BVH,
+    ACCELERATION_GRID
+};
+
+//Cells of a uniform grid, x fastest, then y, then z. Cell i holds primitive_indices[cell_starts[i], cell_starts[i + 1]), every primitive whose box overlaps it.
+struct Grid
+{
+    struct Bounding_Box bounds;//of every primitive
+    unsigned int resolution [3] = {0, 0, 0};//cells per axis
+    float cell_size [3] = {0.0f, 0.0f, 0.0f};
+    std::vector<unsigned int> cell_starts;//empty if there are no primitives
+    std::vector<unsigned int> primitive_indices;
+};
+
+/*
+ * Whether a grid is likely to be faster than a BVH for some primitives: there are many, their boxes are about the same size and they fill a good part of the
+ * space around them, such as atoms in a molecule. A grid's cells then each hold a few primitives and a ray stops walking soon after its first hit, where a
+ * BVH would descend many levels. Sparse or mixed sized scenes leave cells empty or overfull, which a BVH adapts to.
+ *
+ * PRIMITIVE_BOUNDS: box of every primitive
+ */
+static bool grid_suits(const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS)
+{
+    struct Bounding_Box bounds;
+    double size_sum = 0.0, volume_sum = 0.0, grid_volume = 1.0;
+    float largest_size = 0.0f;
+
+    if (PRIMITIVE_BOUNDS.size() < GRID_MINIMUM_PRIMITIVES)
+        return false;
+    for (size_t i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+    {
+        double volume = 1.0;
+
+        grow_bounding_box(bounds, PRIMITIVE_BOUNDS[i]);
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            const float SIZE = PRIMITIVE_BOUNDS[i].maximum[j] - PRIMITIVE_BOUNDS[i].minimum[j];
+
+            size_sum += SIZE;
+            largest_size = std::max(largest_size, SIZE);
+            volume *= SIZE;
+        }
+        volume_sum += volume;
+    }
+    for (unsigned int j = 0; j < 3; ++j)
+        grid_volume *= bounds.maximum[j] - bounds.minimum[j];
+    return largest_size <= GRID_SIZE_SPREAD * size_sum / (3.0 * PRIMITIVE_BOUNDS.size()) && grid_volume > 0.0 && volume_sum >= GRID_MINIMUM_OCCUPANCY * grid_volume;
+}
+
+/*
+ * Cells a box overlaps along one axis, clamped to the grid. Boxes touching a cell boundary are in the cells on both sides.
+ *
+ * GRID: grid with its bounds, resolution and cell sizes set
+ * AXIS: axis in question
+ * MINIMUM, MAXIMUM: extent of the box along AXIS
+ * first, last: where the first and last cells, inclusive, are stored
+ */
+static void grid_cell_range(const struct Grid& GRID, const unsigned int AXIS, const float MINIMUM, const float MAXIMUM, unsigned int& first, unsigned int& last)
+{
+    const float FIRST = floor((MINIMUM - GRID.bounds.minimum[AXIS]) / GRID.cell_size[AXIS]), LAST = floor((MAXIMUM - GRID.bounds.minimum[AXIS]) / GRID.cell_size[AXIS]);
+
+    first = FIRST <= 0.0f ? 0 : std::min(static_cast<unsigned int>(FIRST), GRID.resolution[AXIS] - 1);
+    last = LAST <= 0.0f ? 0 : std::min(static_cast<unsigned int>(LAST), GRID.resolution[AXIS] - 1);
+}
+
+/*
+ * Builds a grid from scratch, replacing whatever grid held. About GRID_CELLS_PER_PRIMITIVE cells are made per primitive, as close to cubes as the extent allows,
+ * and primitives are sorted into every cell their box overlaps with a counting pass, so building is linear in the number of references.
+ *
+ * grid: where the grid is stored
+ * PRIMITIVE_BOUNDS: box of every primitive, primitives are referred to by their index in this
+ */
+static void build_grid(struct Grid& grid, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS)
+{
+    unsigned int first [3], last [3], i, j;
+    float extent [3], volume = 1.0f, largest_extent = 0.0f;
+    size_t cell_count = 1;
+
+    grid.bounds = Bounding_Box();
+    grid.cell_starts.clear();
+    grid.primitive_indices.clear();
+    if (PRIMITIVE_BOUNDS.empty())
+        return;
+    for (i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+        grow_bounding_box(grid.bounds, PRIMITIVE_BOUNDS[i]);
+    for (j = 0; j < 3; ++j)
+        largest_extent = std::max(largest_extent, extent[j] = grid.bounds.maximum[j] - grid.bounds.minimum[j]);
+    for (j = 0; j < 3; ++j)//flat axes count as a small fraction of the largest so the volume does not vanish
+        volume *= std::max(extent[j], largest_extent * 0.001f);
+    {
+        const float CELLS_PER_UNIT = largest_extent > 0.0f ? static_cast<float>(cbrt(GRID_CELLS_PER_PRIMITIVE * PRIMITIVE_BOUNDS.size() / volume)) : 0.0f;
+
+        for (j = 0; j < 3; ++j)
+        {
+            const float CELLS = extent[j] * CELLS_PER_UNIT;
+
+            grid.resolution[j] = CELLS < 1.0f ? 1 : CELLS > GRID_MAX_RESOLUTION ? GRID_MAX_RESOLUTION : static_cast<unsigned int>(CELLS);
+            grid.cell_size[j] = extent[j] > 0.0f ? extent[j] / grid.resolution[j] : 1.0f;
+            cell_count *= grid.resolution[j];
+        }
+    }
+
+    //counts the references of every cell, shifted by one so the prefix sum leaves the starts
+    grid.cell_starts.assign(cell_count + 1, 0);
+    for (i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)
+    {
+        for (j = 0; j < 3; ++j)
+            grid_cell_range(grid, j, PRIMITIVE_BOUNDS[i].minimum[j], PRIMITIVE_BOUNDS[i].maximum[j], first[j], last[j]);
+        for (unsigned int z = first[2]; z <= last[2]; ++z)
+            for (unsigned int y = first[1]; y <= last[1]; ++y)
+                for (unsigned int x = first[0]; x <= last[0]; ++x)
+                    ++grid.cell_starts[(static_cast<size_t>(z) * grid.resolution[1] + y) * grid.resolution[0] + x + 1];
+    }
+    for (size_t cell = 1; cell <= cell_count; ++cell)
+        grid.cell_starts[cell] += grid.cell_starts[cell - 1];
+    grid.primitive_indices.resize(grid.cell_starts[cell_count]);
+    {
+        std::vector<unsigned int> filled(grid.cell_starts.begin(), grid.cell_starts.end() - 1);//next free slot of every cell
+
+        for (i = 0; i < PRIMITIVE_BOUNDS.size(); ++i)//in index order, so every cell lists its primitives in the order they were given
+        {
+            for (j = 0; j < 3; ++j)
+                grid_cell_range(grid, j, PRIMITIVE_BOUNDS[i].minimum[j], PRIMITIVE_BOUNDS[i].maximum[j], first[j], last[j]);
+            for (unsigned int z = first[2]; z <= last[2]; ++z)
+                for (unsigned int y = first[1]; y <= last[1]; ++y)
+                    for (unsigned int x = first[0]; x <= last[0]; ++x)
+                        grid.primitive_indices[filled[(static_cast<size_t>(z) * grid.resolution[1] + y) * grid.resolution[0] + x]++] = i;
+        }
+    }
+}
+
+/*
+ * Visits the cells of a grid a ray passes through in order, 3D-DDA style, stepping to whichever neighbouring cell the ray enters next. intersect_primitive is
+ * called as intersect_primitive(primitive index) for every primitive in those cells, more than once for primitives spanning several, and returns true to stop
+ * the walk, like for traverse_bvh(...). Closest hit queries lower maximum_distance as they find hits, and the walk ends at the first cell the closest hit so far
+ * is not beyond, as later cells only hold points further along the ray.
+ *
+ * GRID: grid walked
+ * RAY_ORIGIN: point origin of the ray
+ * RAY_DIRECTION: mathematical vector of the ray's direction
+ * MINIMUM_DISTANCE: closest distance, in terms of scalar, a hit can be at
+ * maximum_distance: farthest distance a hit can be at
+ * intersect_primitive: see above
+ */
+template <typename Primitive_Function>
+static void traverse_grid(const struct Grid& GRID, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                          Primitive_Function intersect_primitive)
+{
+    const float INVERSE_DIRECTION [3] = {1.0f / RAY_DIRECTION[0], 1.0f / RAY_DIRECTION[1], 1.0f / RAY_DIRECTION[2]};
+    float entry_distance = MINIMUM_DISTANCE, exit_distance = maximum_distance, next [3], delta [3];
+    unsigned int cell [3];
+    int step [3];
+
+    if (GRID.cell_starts.empty())
+        return;
+    for (unsigned int i = 0; i < 3; ++i)//clips the ray to the grid, like ray_hits_bounding_box(...)
+    {
+        float near_distance = (GRID.bounds.minimum[i] - RAY_ORIGIN[i]) * INVERSE_DIRECTION[i], far_distance = (GRID.bounds.maximum[i] - RAY_ORIGIN[i]) * INVERSE_DIRECTION[i];
+
+        if (near_distance > far_distance)
+            std::swap(near_distance, far_distance);
+        entry_distance = near_distance > entry_distance ? near_distance : entry_distance;
+        exit_distance = far_distance < exit_distance ? far_distance : exit_distance;
+        if (entry_distance > exit_distance)
+            return;
+    }
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        const float CELL = floor((RAY_ORIGIN[i] + entry_distance * RAY_DIRECTION[i] - GRID.bounds.minimum[i]) / GRID.cell_size[i]);
+
+        cell[i] = CELL <= 0.0f ? 0 : std::min(static_cast<unsigned int>(CELL), GRID.resolution[i] - 1);
+        step[i] = RAY_DIRECTION[i] > 0.0f ? 1 : RAY_DIRECTION[i] < 0.0f ? -1 : 0;
+        if (step[i] == 0)
+        {
+            next[i] = delta[i] = FLT_MAX;
+            continue;
+        }
+        next[i] = (GRID.bounds.minimum[i] + (cell[i] + (step[i] > 0 ? 1 : 0)) * GRID.cell_size[i] - RAY_ORIGIN[i]) * INVERSE_DIRECTION[i];
+        delta[i] = GRID.cell_size[i] * INVERSE_DIRECTION[i] * step[i];
+    }
+    for (;;)
+    {
+        const size_t CELL = (static_cast<size_t>(cell[2]) * GRID.resolution[1] + cell[1]) * GRID.resolution[0] + cell[0];
+        const unsigned int AXIS = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);//crossed first on leaving the cell
+
+        for (unsigned int i = GRID.cell_starts[CELL]; i < GRID.cell_starts[CELL + 1]; ++i)
+            if (intersect_primitive(GRID.primitive_indices[i]))
+                return;
+        if (next[AXIS] > exit_distance || maximum_distance <= next[AXIS])
+            return;
+        if (step[AXIS] > 0 ? ++cell[AXIS] >= GRID.resolution[AXIS] : cell[AXIS]-- == 0)
+            return;
+        next[AXIS] += delta[AXIS];
+    }
+}
+
+#endif /* GRID_H_ */
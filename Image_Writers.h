@@ -0,0 +1,605 @@
+/**
+Program name: Image_Writers.h
+Purpose: writers for the output image in several formats, run on a background thread so rendering can go on while files are written
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef IMAGE_WRITERS_H_
+#define IMAGE_WRITERS_H_
+
+#include "Frame_Buffer.h"
+#include <string>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <algorithm>
+
+#define IMAGE_WRITER_QUEUE_SIZE 2//images waiting to be written before queue_image(...) blocks, bounds the memory held by pending frames
+#define PNG_STORED_BLOCK_SIZE 65535//largest uncompressed deflate block
+#define TIFF_DEFAULT_TILE_SIZE 256//tile size when a whole frame buffer is written as a TIFF, TIFF wants multiples of 16
+#define TIFF_CLASSIC_LIMIT 0xffffffffull//files that could get bigger than this need BigTIFF's 64 bit offsets
+
+//Formats the output image can be saved in.
+enum Image_Format
+{
+    IMAGE_FORMAT_BMP,//through CImg, as always
+    IMAGE_FORMAT_PPM,//binary 8 or 16 bit RGB
+    IMAGE_FORMAT_PNG,//8 or 16 bit RGB with uncompressed deflate blocks, so it costs about as much as writing a PPM
+    IMAGE_FORMAT_PFM,//32 bit float RGB, keeps everything the renderer computed
+    IMAGE_FORMAT_TIFF//tiled 8 or 16 bit RGB, BigTIFF when needed, uncompressed
+};
+
+/*
+ * Reads a format's name. Returns false, leaving format alone, if the name is unknown.
+ *
+ * NAME: "bmp", "ppm", "png", "pfm" or "tiff"
+ * format: where the format is stored
+ */
+static bool read_image_format(const std::string& NAME, enum Image_Format& format)
+{
+    if (NAME == "bmp")
+        format = IMAGE_FORMAT_BMP;
+    else if (NAME == "ppm")
+        format = IMAGE_FORMAT_PPM;
+    else if (NAME == "png")
+        format = IMAGE_FORMAT_PNG;
+    else if (NAME == "pfm")
+        format = IMAGE_FORMAT_PFM;
+    else if (NAME == "tiff")
+        format = IMAGE_FORMAT_TIFF;
+    else
+        return false;
+    return true;
+}
+
+/*
+ * File extension, including the '.', of a format.
+ *
+ * FORMAT: format in question
+ */
+static const char * image_format_extension(const enum Image_Format FORMAT)
+{
+    switch (FORMAT)
+    {
+        case IMAGE_FORMAT_PPM:
+            return ".ppm";
+        case IMAGE_FORMAT_PNG:
+            return ".png";
+        case IMAGE_FORMAT_PFM:
+            return ".pfm";
+        case IMAGE_FORMAT_TIFF:
+            return ".tif";
+        default:
+            return ".bmp";
+    }
+}
+
+/*
+ * Interleaves a frame buffer into RGB rows, top row first, with FILTER_BYTES zero bytes in front of each row. 16 bit channels are big endian, as PPM and PNG want them.
+ *
+ * FRAME_BUFFER: frame buffer read
+ * BYTES_PER_CHANNEL: 1 or 2
+ * FILTER_BYTES: bytes to put in front of each row, PNG puts a filter type there
+ */
+static std::vector<unsigned char> interleave_rgb(const struct Frame_Buffer& FRAME_BUFFER, const unsigned int BYTES_PER_CHANNEL, const unsigned int FILTER_BYTES)
+{
+    const size_t ROW_SIZE = static_cast<size_t>(FRAME_BUFFER.width) * 3;
+    std::vector<unsigned char> to_return;
+
+    to_return.reserve((ROW_SIZE * BYTES_PER_CHANNEL + FILTER_BYTES) * FRAME_BUFFER.height);
+    for (unsigned int y = 0; y < FRAME_BUFFER.height; ++y)
+    {
+        to_return.insert(to_return.end(), FILTER_BYTES, 0);
+        for (size_t i = y * ROW_SIZE; i < (y + 1) * ROW_SIZE; ++i)
+            if (BYTES_PER_CHANNEL == 2)
+            {
+                const unsigned short VALUE = read_channel_16_bit(FRAME_BUFFER, i);
+                to_return.push_back(static_cast<unsigned char>(VALUE >> 8));
+                to_return.push_back(static_cast<unsigned char>(VALUE));
+            }
+            else
+                to_return.push_back(read_channel_8_bit(FRAME_BUFFER, i));
+    }
+    return to_return;
+}
+
+/*
+ * Writes a frame buffer as a PFM, the floating point sibling of PPM. Rows go bottom to top and the negative scale marks the floats as little endian.
+ * Float frame buffers are written as rendered, before any tonemapping.
+ *
+ * FRAME_BUFFER: frame buffer written
+ * PATH: file written
+ */
+static bool write_pfm(const struct Frame_Buffer& FRAME_BUFFER, const std::string& PATH)
+{
+    std::ofstream output_file(PATH, std::ofstream::binary);
+    std::vector<float> row(static_cast<size_t>(FRAME_BUFFER.width) * 3);
+
+    output_file << "PF\n" << FRAME_BUFFER.width << " " << FRAME_BUFFER.height << "\n-1.0\n";
+    for (unsigned int y = FRAME_BUFFER.height; y-- > 0;)
+    {
+        for (size_t i = 0; i < row.size(); ++i)
+            row[i] = read_channel_float(FRAME_BUFFER, y * row.size() + i);
+        output_file.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+    }
+    return static_cast<bool>(output_file);
+}
+
+/*
+ * Continues a CRC-32, as used by PNG chunks, over more bytes.
+ *
+ * crc: CRC so far, start with 0
+ * DATA, SIZE: bytes to add
+ */
+static unsigned int png_crc(unsigned int crc, const unsigned char * DATA, const size_t SIZE)
+{
+    static unsigned int table [256];
+    static bool table_ready = false;
+
+    if (!table_ready)//filling it twice from two threads is harmless, both write the same values
+    {
+        for (unsigned int i = 0; i < 256; ++i)
+        {
+            unsigned int value = i;
+            for (unsigned int j = 0; j < 8; ++j)
+                value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            table[i] = value;
+        }
+        table_ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < SIZE; ++i)
+        crc = table[(crc ^ DATA[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/*
+ * Appends a 32 bit big endian value, which is how PNG stores every number.
+ *
+ * bytes: where the value is appended
+ * VALUE: value appended
+ */
+static void append_big_endian(std::vector<unsigned char>& bytes, const unsigned int VALUE)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        bytes.push_back(static_cast<unsigned char>(VALUE >> shift));
+}
+
+/*
+ * Writes a PNG chunk, {length, type, data, CRC of type and data}.
+ *
+ * output_file: file being written
+ * TYPE: 4 letter chunk type
+ * DATA: chunk data
+ */
+static void write_png_chunk(std::ofstream& output_file, const char TYPE [4], const std::vector<unsigned char>& DATA)
+{
+    std::vector<unsigned char> chunk;
+
+    append_big_endian(chunk, static_cast<unsigned int>(DATA.size()));
+    chunk.insert(chunk.end(), TYPE, TYPE + 4);
+    chunk.insert(chunk.end(), DATA.begin(), DATA.end());
+    append_big_endian(chunk, png_crc(0, chunk.data() + 4, chunk.size() - 4));
+    output_file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+/*
+ * Writes a frame buffer as an RGB PNG, 16 bits per channel if the frame buffer has more than 8. The pixels are stored in uncompressed deflate blocks, so the files are as
+ * big as a PPM but writing them takes no longer either.
+ *
+ * FRAME_BUFFER: frame buffer written
+ * PATH: file written
+ */
+static bool write_png(const struct Frame_Buffer& FRAME_BUFFER, const std::string& PATH)
+{
+    static const unsigned char SIGNATURE [8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    const unsigned int BYTES_PER_CHANNEL = FRAME_BUFFER.depth == FRAME_BUFFER_8_BIT ? 1 : 2;
+    std::ofstream output_file(PATH, std::ofstream::binary);
+    const std::vector<unsigned char> ROWS = interleave_rgb(FRAME_BUFFER, BYTES_PER_CHANNEL, 1);//filter type 0, none, for every row
+    std::vector<unsigned char> header, image_data;
+
+    output_file.write(reinterpret_cast<const char *>(SIGNATURE), sizeof(SIGNATURE));
+    append_big_endian(header, FRAME_BUFFER.width);
+    append_big_endian(header, FRAME_BUFFER.height);
+    header.push_back(static_cast<unsigned char>(BYTES_PER_CHANNEL * 8));//bits per channel
+    header.push_back(2);//RGB
+    header.push_back(0);//deflate
+    header.push_back(0);//filter method
+    header.push_back(0);//not interlaced
+    write_png_chunk(output_file, "IHDR", header);
+
+    //zlib stream made of stored blocks
+    {
+        unsigned int adler_a = 1, adler_b = 0;
+
+        image_data.reserve(ROWS.size() + ROWS.size() / PNG_STORED_BLOCK_SIZE * 5 + 11);
+        image_data.push_back(0x78);//deflate with a 32K window
+        image_data.push_back(0x01);//no preset dictionary, fastest, makes the header a multiple of 31
+        for (size_t position = 0; position < ROWS.size() || position == 0; position += PNG_STORED_BLOCK_SIZE)
+        {
+            const size_t BLOCK_SIZE = ROWS.size() - position < PNG_STORED_BLOCK_SIZE ? ROWS.size() - position : PNG_STORED_BLOCK_SIZE;
+
+            image_data.push_back(position + BLOCK_SIZE >= ROWS.size() ? 1 : 0);//last block flag, stored type
+            image_data.push_back(static_cast<unsigned char>(BLOCK_SIZE));
+            image_data.push_back(static_cast<unsigned char>(BLOCK_SIZE >> 8));
+            image_data.push_back(static_cast<unsigned char>(~BLOCK_SIZE));
+            image_data.push_back(static_cast<unsigned char>(~BLOCK_SIZE >> 8));
+            image_data.insert(image_data.end(), ROWS.begin() + position, ROWS.begin() + position + BLOCK_SIZE);
+            if (BLOCK_SIZE == 0)
+                break;
+        }
+        for (size_t i = 0; i < ROWS.size(); ++i)
+        {
+            adler_a = (adler_a + ROWS[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+        append_big_endian(image_data, (adler_b << 16) | adler_a);
+    }
+    write_png_chunk(output_file, "IDAT", image_data);
+    write_png_chunk(output_file, "IEND", std::vector<unsigned char>());
+    return static_cast<bool>(output_file);
+}
+
+//Image written a band of rows at a time, top to bottom, so only the band being written has to be in memory. Only PPM and TIFF can be written this way.
+struct Image_Stream
+{
+    std::ofstream file;
+    enum Image_Format format = IMAGE_FORMAT_PPM;
+    unsigned int width = 0, height = 0;
+    unsigned int bytes_per_channel = 1;//1 or 2
+    unsigned int tile_size = 0;//TIFF tiles are tile_size x tile_size, bands must be a multiple of tile_size rows high except for the last
+    unsigned int rows_written = 0;
+    bool big_tiff = false;//64 bit offsets, for files past 4GiB
+    std::vector<unsigned char> tile;//TIFF tile being assembled
+};
+
+/*
+ * Writes the lowest BYTES bytes of a value, little endian, which is how TIFF files starting with "II" store numbers.
+ *
+ * output_file: file being written
+ * VALUE: value written
+ * BYTES: bytes written
+ */
+static void write_little_endian(std::ofstream& output_file, const unsigned long long VALUE, const unsigned int BYTES)
+{
+    for (unsigned int i = 0; i < BYTES; ++i)
+        output_file.put(static_cast<char>(VALUE >> (i * 8)));
+}
+
+/*
+ * Number of TIFF tiles a stream is cut into.
+ *
+ * STREAM: TIFF stream in question
+ */
+static unsigned long long tiff_tile_count(const struct Image_Stream& STREAM)
+{
+    return static_cast<unsigned long long>((STREAM.width + STREAM.tile_size - 1) / STREAM.tile_size) * ((STREAM.height + STREAM.tile_size - 1) / STREAM.tile_size);
+}
+
+/*
+ * Bytes in one TIFF tile, every tile is full size, those on the edges are padded.
+ *
+ * STREAM: TIFF stream in question
+ */
+static unsigned long long tiff_tile_bytes(const struct Image_Stream& STREAM)
+{
+    return static_cast<unsigned long long>(STREAM.tile_size) * STREAM.tile_size * 3 * STREAM.bytes_per_channel;
+}
+
+/*
+ * Writes the values FIRST, FIRST + STEP, FIRST + 2 STEP... Every array a TIFF here needs is such a sequence, so tile offsets never have to be held in memory.
+ *
+ * output_file: file being written
+ * TYPE_BYTES: bytes per value
+ * COUNT: number of values
+ * FIRST, STEP: the sequence
+ */
+static void write_tiff_values(std::ofstream& output_file, const unsigned int TYPE_BYTES, const unsigned long long COUNT, const unsigned long long FIRST, const unsigned long long STEP)
+{
+    for (unsigned long long i = 0; i < COUNT; ++i)
+        write_little_endian(output_file, FIRST + i * STEP, TYPE_BYTES);
+}
+
+/*
+ * Writes a TIFF directory entry, whose values are FIRST, FIRST + STEP... They are stored in the entry if they fit, otherwise the entry points to ARRAY_OFFSET,
+ * where they must have been written already.
+ *
+ * STREAM: TIFF stream being closed
+ * TAG: what the entry is
+ * TYPE: TIFF type of the values, 3 short, 4 long or 16 long8
+ * COUNT, FIRST, STEP: the values
+ * ARRAY_OFFSET: where the values are in the file if they do not fit
+ */
+static void write_tiff_entry(struct Image_Stream& stream, const unsigned int TAG, const unsigned int TYPE, const unsigned long long COUNT, const unsigned long long FIRST,
+                             const unsigned long long STEP, const unsigned long long ARRAY_OFFSET)
+{
+    const unsigned int TYPE_BYTES = TYPE == 3 ? 2 : TYPE == 4 ? 4 : 8, OFFSET_BYTES = stream.big_tiff ? 8 : 4;
+
+    write_little_endian(stream.file, TAG, 2);
+    write_little_endian(stream.file, TYPE, 2);
+    write_little_endian(stream.file, COUNT, OFFSET_BYTES);
+    if (COUNT * TYPE_BYTES <= OFFSET_BYTES)
+    {
+        write_tiff_values(stream.file, TYPE_BYTES, COUNT, FIRST, STEP);
+        write_little_endian(stream.file, 0, static_cast<unsigned int>(OFFSET_BYTES - COUNT * TYPE_BYTES));
+    }
+    else
+        write_little_endian(stream.file, ARRAY_OFFSET, OFFSET_BYTES);
+}
+
+/*
+ * Starts writing an image, with its header. Returns false if the file could not be created.
+ *
+ * stream: stream being opened
+ * PATH: file written
+ * FORMAT: IMAGE_FORMAT_PPM or IMAGE_FORMAT_TIFF
+ * WIDTH, HEIGHT: size of the whole image
+ * BYTES_PER_CHANNEL: 1 or 2
+ * TILE_SIZE: TIFF tile size, a multiple of 16, unused for PPM
+ */
+static bool open_image_stream(struct Image_Stream& stream, const std::string& PATH, const enum Image_Format FORMAT, const unsigned int WIDTH, const unsigned int HEIGHT,
+                              const unsigned int BYTES_PER_CHANNEL, const unsigned int TILE_SIZE)
+{
+    stream.file.open(PATH, std::ofstream::binary);
+    stream.format = FORMAT;
+    stream.width = WIDTH;
+    stream.height = HEIGHT;
+    stream.bytes_per_channel = BYTES_PER_CHANNEL;
+    stream.tile_size = TILE_SIZE;
+    stream.rows_written = 0;
+    if (FORMAT == IMAGE_FORMAT_TIFF)
+    {
+        //header, the directory goes at the end, once the pixels are written, and its offset is filled in on closing
+        stream.big_tiff = 16 + tiff_tile_count(stream) * (tiff_tile_bytes(stream) + 16) + 1024 > TIFF_CLASSIC_LIMIT;
+        stream.tile.resize(static_cast<size_t>(tiff_tile_bytes(stream)));
+        stream.file.write("II", 2);
+        write_little_endian(stream.file, stream.big_tiff ? 43 : 42, 2);
+        if (stream.big_tiff)
+        {
+            write_little_endian(stream.file, 8, 2);//offset size
+            write_little_endian(stream.file, 0, 2);
+        }
+        write_little_endian(stream.file, 0, stream.big_tiff ? 8 : 4);
+    }
+    else
+        stream.file << "P6\n" << WIDTH << " " << HEIGHT << (BYTES_PER_CHANNEL == 2 ? "\n65535\n" : "\n255\n");
+    return static_cast<bool>(stream.file);
+}
+
+/*
+ * Writes the next band of rows. For TIFF every band but the last must be a multiple of the tile size high. Returns false if the file could not be written.
+ *
+ * stream: stream written to
+ * BAND: rows [rows written so far, + BAND.height) of the image, as wide as the image
+ */
+static bool write_image_band(struct Image_Stream& stream, const struct Frame_Buffer& BAND)
+{
+    if (stream.format == IMAGE_FORMAT_TIFF)
+    {
+        for (unsigned int tile_y = 0; tile_y < BAND.height; tile_y += stream.tile_size)
+            for (unsigned int tile_x = 0; tile_x < stream.width; tile_x += stream.tile_size)
+            {
+                std::fill(stream.tile.begin(), stream.tile.end(), 0);
+                for (unsigned int y = tile_y; y < tile_y + stream.tile_size && y < BAND.height; ++y)
+                    for (unsigned int x = tile_x; x < tile_x + stream.tile_size && x < stream.width; ++x)
+                        for (unsigned int channel = 0; channel < 3; ++channel)
+                        {
+                            const size_t SOURCE = (static_cast<size_t>(y) * BAND.width + x) * 3 + channel,
+                                         TARGET = (((y - tile_y) * stream.tile_size + (x - tile_x)) * 3 + channel) * stream.bytes_per_channel;
+
+                            if (stream.bytes_per_channel == 2)
+                            {
+                                const unsigned short VALUE = read_channel_16_bit(BAND, SOURCE);
+                                stream.tile[TARGET] = static_cast<unsigned char>(VALUE);
+                                stream.tile[TARGET + 1] = static_cast<unsigned char>(VALUE >> 8);
+                            }
+                            else
+                                stream.tile[TARGET] = read_channel_8_bit(BAND, SOURCE);
+                        }
+                stream.file.write(reinterpret_cast<const char *>(stream.tile.data()), stream.tile.size());
+            }
+    }
+    else
+    {
+        const std::vector<unsigned char> PIXELS = interleave_rgb(BAND, stream.bytes_per_channel, 0);
+        stream.file.write(reinterpret_cast<const char *>(PIXELS.data()), PIXELS.size());
+    }
+    stream.rows_written += BAND.height;
+    return static_cast<bool>(stream.file);
+}
+
+/*
+ * Finishes an image, for TIFF by writing its directory. Returns false if the file could not be written or not every row was.
+ *
+ * stream: stream closed
+ */
+static bool close_image_stream(struct Image_Stream& stream)
+{
+    if (stream.format == IMAGE_FORMAT_TIFF)
+    {
+        const unsigned long long TILE_COUNT = tiff_tile_count(stream), TILE_BYTES = tiff_tile_bytes(stream);
+        const unsigned int OFFSET_BYTES = stream.big_tiff ? 8 : 4, OFFSET_TYPE = stream.big_tiff ? 16 : 4;
+        unsigned long long bits_offset, tile_offsets_offset, tile_sizes_offset, directory_offset;
+
+        //arrays too big for their directory entries, TIFF wants everything on even offsets
+        if (static_cast<unsigned long long>(stream.file.tellp()) % 2 != 0)
+            stream.file.put(0);
+        bits_offset = static_cast<unsigned long long>(stream.file.tellp());
+        write_tiff_values(stream.file, 2, 3, stream.bytes_per_channel * 8, 0);
+        tile_offsets_offset = static_cast<unsigned long long>(stream.file.tellp());
+        write_tiff_values(stream.file, OFFSET_BYTES, TILE_COUNT, stream.big_tiff ? 16 : 8, TILE_BYTES);
+        tile_sizes_offset = static_cast<unsigned long long>(stream.file.tellp());
+        write_tiff_values(stream.file, 4, TILE_COUNT, TILE_BYTES, 0);
+
+        //directory, entries sorted by tag
+        directory_offset = static_cast<unsigned long long>(stream.file.tellp());
+        write_little_endian(stream.file, 11, stream.big_tiff ? 8 : 2);
+        write_tiff_entry(stream, 256, 4, 1, stream.width, 0, 0);//image width
+        write_tiff_entry(stream, 257, 4, 1, stream.height, 0, 0);//image length
+        write_tiff_entry(stream, 258, 3, 3, stream.bytes_per_channel * 8, 0, bits_offset);//bits per sample
+        write_tiff_entry(stream, 259, 3, 1, 1, 0, 0);//no compression
+        write_tiff_entry(stream, 262, 3, 1, 2, 0, 0);//RGB
+        write_tiff_entry(stream, 277, 3, 1, 3, 0, 0);//samples per pixel
+        write_tiff_entry(stream, 284, 3, 1, 1, 0, 0);//channels interleaved
+        write_tiff_entry(stream, 322, 4, 1, stream.tile_size, 0, 0);//tile width
+        write_tiff_entry(stream, 323, 4, 1, stream.tile_size, 0, 0);//tile length
+        write_tiff_entry(stream, 324, OFFSET_TYPE, TILE_COUNT, stream.big_tiff ? 16 : 8, TILE_BYTES, tile_offsets_offset);//tile offsets, tiles follow the header in order
+        write_tiff_entry(stream, 325, 4, TILE_COUNT, TILE_BYTES, 0, tile_sizes_offset);//tile byte counts
+        write_little_endian(stream.file, 0, OFFSET_BYTES);//no next directory
+        stream.file.seekp(stream.big_tiff ? 8 : 4);
+        write_little_endian(stream.file, directory_offset, OFFSET_BYTES);
+    }
+    stream.file.close();
+    return !stream.file.fail() && stream.rows_written == stream.height;
+}
+
+/*
+ * Writes a whole frame buffer through an image stream, as a single band.
+ *
+ * FRAME_BUFFER: frame buffer written
+ * PATH: file written
+ * FORMAT: IMAGE_FORMAT_PPM or IMAGE_FORMAT_TIFF, 16 bits per channel if the frame buffer has more than 8
+ */
+static bool write_streamable_image(const struct Frame_Buffer& FRAME_BUFFER, const std::string& PATH, const enum Image_Format FORMAT)
+{
+    struct Image_Stream stream;
+    bool written = open_image_stream(stream, PATH, FORMAT, FRAME_BUFFER.width, FRAME_BUFFER.height, FRAME_BUFFER.depth == FRAME_BUFFER_8_BIT ? 1 : 2, TIFF_DEFAULT_TILE_SIZE);
+
+    if (written)
+        written = write_image_band(stream, FRAME_BUFFER);
+    return close_image_stream(stream) && written;
+}
+
+/*
+ * Writes a frame buffer in the given format. Returns false if the file could not be written.
+ *
+ * FRAME_BUFFER: frame buffer written
+ * PATH: file written, including its extension
+ * FORMAT: format written
+ */
+static bool write_image(const struct Frame_Buffer& FRAME_BUFFER, const std::string& PATH, const enum Image_Format FORMAT)
+{
+    switch (FORMAT)
+    {
+        case IMAGE_FORMAT_PPM:
+        case IMAGE_FORMAT_TIFF:
+            return write_streamable_image(FRAME_BUFFER, PATH, FORMAT);
+        case IMAGE_FORMAT_PNG:
+            return write_png(FRAME_BUFFER, PATH);
+        case IMAGE_FORMAT_PFM:
+            return write_pfm(FRAME_BUFFER, PATH);
+        default:
+            try
+            {
+                frame_buffer_to_cimg(FRAME_BUFFER).save(PATH.c_str());
+            }
+            catch (const cimg_library::CImgException&)
+            {
+                return false;
+            }
+            return true;
+    }
+}
+
+//Image waiting to be written.
+struct Image_Job
+{
+    struct Frame_Buffer frame_buffer;
+    std::string path;
+    enum Image_Format format;
+};
+
+//Background thread writing queued images, in the order they were queued.
+struct Image_Writer
+{
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable changed;//signalled when a job is added or removed, or on stopping
+    std::deque<struct Image_Job> jobs;
+    bool stopping = false;
+};
+
+/*
+ * Body of the writer thread, writes jobs until told to stop and the queue is empty.
+ *
+ * writer: writer whose queue is emptied
+ */
+static void image_writer_loop(struct Image_Writer& writer)
+{
+    std::unique_lock<std::mutex> guard(writer.lock);
+
+    for (;;)
+    {
+        writer.changed.wait(guard, [&]() {return writer.stopping || !writer.jobs.empty();});
+        if (writer.jobs.empty())
+            return;
+        {
+            struct Image_Job job;
+            swap_frame_buffers(job.frame_buffer, writer.jobs.front().frame_buffer);
+            job.path.swap(writer.jobs.front().path);
+            job.format = writer.jobs.front().format;
+
+            //write without holding the lock so the render thread can queue the next frame
+            guard.unlock();
+            if (!write_image(job.frame_buffer, job.path, job.format))
+                std::cerr << "Error: unable to write \"" << job.path << "\"" << std::endl;
+            guard.lock();
+            writer.jobs.pop_front();//only now, so the queue counts the image being written against IMAGE_WRITER_QUEUE_SIZE
+            writer.changed.notify_all();
+        }
+    }
+}
+
+/*
+ * Starts the writer thread.
+ *
+ * writer: writer started
+ */
+static void start_image_writer(struct Image_Writer& writer)
+{
+    writer.stopping = false;
+    writer.thread = std::thread(image_writer_loop, std::ref(writer));
+}
+
+/*
+ * Hands a frame buffer to the writer thread. Takes its pixels, leaving frame_buffer empty, so the caller can render the next frame into it right away. Blocks while
+ * IMAGE_WRITER_QUEUE_SIZE images are already waiting.
+ *
+ * writer: writer the image is queued on
+ * frame_buffer: frame buffer written, emptied
+ * PATH: file written, including its extension
+ * FORMAT: format written
+ */
+static void queue_image(struct Image_Writer& writer, struct Frame_Buffer& frame_buffer, const std::string& PATH, const enum Image_Format FORMAT)
+{
+    std::unique_lock<std::mutex> guard(writer.lock);
+
+    writer.changed.wait(guard, [&]() {return writer.jobs.size() < IMAGE_WRITER_QUEUE_SIZE;});
+    writer.jobs.push_back(Image_Job());
+    swap_frame_buffers(writer.jobs.back().frame_buffer, frame_buffer);
+    writer.jobs.back().path = PATH;
+    writer.jobs.back().format = FORMAT;
+    writer.changed.notify_all();
+}
+
+/*
+ * Waits for every queued image to be written and stops the writer thread.
+ *
+ * writer: writer stopped
+ */
+static void stop_image_writer(struct Image_Writer& writer)
+{
+    {
+        std::lock_guard<std::mutex> guard(writer.lock);
+        writer.stopping = true;
+        writer.changed.notify_all();
+    }
+    if (writer.thread.joinable())
+        writer.thread.join();
+}
+
+#endif /* IMAGE_WRITERS_H_ */
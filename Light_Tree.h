@@ -0,0 +1,142 @@
+/**
+Program name: Light_Tree.h
+Purpose: hierarchy over point lights with the summed colours of every subtree, so far away or dim groups of lights can be shaded as one
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef LIGHT_TREE_H_
+#define LIGHT_TREE_H_
+
+#include "Scene_Pieces.h"
+#include "BVH.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
+//BVH over lights, each node also knows the total colour of its lights and which of them stands in for the rest.
+struct Light_Tree
+{
+    struct BVH tree;//over lights, primitive i is lights[i]
+    std::vector<unsigned int> lights;//index in the scene's lights of every primitive
+    std::vector<float> diffuse_sums, specular_sums;//ARRAY_SIZE per node, sum of the colours of the lights under it
+    std::vector<unsigned int> representatives;//per node, the brightest light under it, index in the scene's lights
+    std::vector<float> ranges;//per node, the largest range of the lights under it, FLT_MAX if any of them has none
+    std::vector<unsigned int> excluded_lights;//the scene's lights the tree is not over, left to be shaded one by one
+};
+
+/*
+ * How bright a light is, to pick representatives with.
+ *
+ * LIGHT: light in question
+ */
+static float light_brightness(const struct Light& LIGHT)
+{
+    float brightness = 0.0f;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        brightness += LIGHT.diffuse_colour[i] + LIGHT.specular_colour[i];
+    return brightness;
+}
+
+/*
+ * Builds a light tree over some of a scene's lights, replacing whatever tree held, except for excluded_lights, which are up to the caller. A parent's representative is always one of its children's, so a shadow ray
+ * traced for a parent still holds for that child.
+ *
+ * tree: where the light tree is stored
+ * LIGHTS: the scene's lights
+ * INDICES: which of them the tree is over
+ */
+static void build_light_tree(struct Light_Tree& tree, const std::vector<struct Light>& LIGHTS, const std::vector<unsigned int>& INDICES)
+{
+    std::vector<struct Bounding_Box> bounds(INDICES.size());
+
+    tree.lights = INDICES;
+    for (unsigned int i = 0; i < INDICES.size(); ++i)
+        for (unsigned int j = 0; j < 3; ++j)
+            bounds[i].minimum[j] = bounds[i].maximum[j] = LIGHTS[INDICES[i]].position[j];
+    build_bvh(tree.tree, bounds);
+    tree.diffuse_sums.assign(tree.tree.nodes.size() * ARRAY_SIZE, 0.0f);
+    tree.specular_sums.assign(tree.tree.nodes.size() * ARRAY_SIZE, 0.0f);
+    tree.representatives.assign(tree.tree.nodes.size(), 0);
+    tree.ranges.assign(tree.tree.nodes.size(), 0.0f);
+    //children always come after their parent, so going backwards visits children first
+    for (unsigned int node = static_cast<unsigned int>(tree.tree.nodes.size()); node-- > 0;)
+    {
+        const struct BVH_Node& NODE = tree.tree.nodes[node];
+        std::vector<unsigned int> candidates;//lights or children whose sums and representatives are combined
+
+        if (NODE.count > 0)
+            for (unsigned int i = NODE.first; i < NODE.first + NODE.count; ++i)
+            {
+                const unsigned int LIGHT = tree.lights[tree.tree.primitive_indices[i]];
+
+                for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                {
+                    tree.diffuse_sums[node * ARRAY_SIZE + j] += LIGHTS[LIGHT].diffuse_colour[j];
+                    tree.specular_sums[node * ARRAY_SIZE + j] += LIGHTS[LIGHT].specular_colour[j];
+                }
+                tree.ranges[node] = std::max(tree.ranges[node], LIGHTS[LIGHT].range > 0.0f ? LIGHTS[LIGHT].range : FLT_MAX);
+                candidates.push_back(LIGHT);
+            }
+        else
+            for (unsigned int child = NODE.first; child < NODE.first + 2; ++child)
+            {
+                for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                {
+                    tree.diffuse_sums[node * ARRAY_SIZE + j] += tree.diffuse_sums[child * ARRAY_SIZE + j];
+                    tree.specular_sums[node * ARRAY_SIZE + j] += tree.specular_sums[child * ARRAY_SIZE + j];
+                }
+                tree.ranges[node] = std::max(tree.ranges[node], tree.ranges[child]);
+                candidates.push_back(tree.representatives[child]);
+            }
+        tree.representatives[node] = *std::max_element(candidates.begin(), candidates.end(), [&](const unsigned int A, const unsigned int B)
+        {
+            return light_brightness(LIGHTS[A]) < light_brightness(LIGHTS[B]);
+        });
+    }
+}
+
+/*
+ * Squared distance from a point to the nearest point of a box, 0 inside it.
+ *
+ * BOX: box of lights
+ * POINT: point the box is seen from
+ */
+static float box_distance_squared(const struct Bounding_Box& BOX, const float POINT [3])
+{
+    float distance_squared = 0.0f;
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        const float LOW = BOX.minimum[i] - POINT[i], HIGH = BOX.maximum[i] - POINT[i];
+        const float NEAREST = LOW > 0.0f ? LOW : HIGH < 0.0f ? HIGH : 0.0f;
+
+        distance_squared += NEAREST * NEAREST;
+    }
+    return distance_squared;
+}
+
+/*
+ * Upper bound on the cosine between AXIS and the direction from POINT to anywhere in a box, 0 if the whole box is behind POINT as seen along AXIS. The furthest
+ * any corner reaches along AXIS over the distance to the box's nearest point, which no point of the box can beat, clamped to 1.
+ *
+ * BOX: box of lights
+ * POINT: point the box is seen from
+ * AXIS: normalized direction
+ */
+static float cosine_bound(const struct Bounding_Box& BOX, const float POINT [3], const float AXIS [3])
+{
+    const float NEAREST_SQUARED = box_distance_squared(BOX, POINT);
+    float furthest = 0.0f;
+
+    for (unsigned int i = 0; i < 3; ++i)
+        furthest += AXIS[i] * (AXIS[i] > 0.0f ? BOX.maximum[i] - POINT[i] : BOX.minimum[i] - POINT[i]);
+    if (furthest <= 0.0f)
+        return 0.0f;
+    if (NEAREST_SQUARED <= 0.0f || furthest * furthest >= NEAREST_SQUARED)//inside the box, or no tighter than 1
+        return 1.0f;
+    return furthest / static_cast<float>(sqrt(NEAREST_SQUARED));
+}
+
+#endif /* LIGHT_TREE_H_ */
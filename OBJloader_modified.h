@@ -9,6 +9,14 @@
 #include <string>
 #include <stdlib.h>
 #include <array>
+#include <cstdio>
+#include <cerrno>
+
+#ifndef _MSC_VER//the bounds checked _s functions only come with Microsoft's C library, so map them to the standard ones elsewhere
+    #define fopen_s(file_pointer, path, mode) ((*(file_pointer) = fopen((path), (mode))) == nullptr ? errno : 0)
+    #define fscanf_s fscanf
+    #define sscanf_s sscanf
+#endif
 
 bool loadOBJ(
     const char * path,
@@ -0,0 +1,267 @@
+/**
+Program name: Process_Scheduler.h
+Purpose: coordinator/worker rendering, where tiles are handed to local worker processes over pipes and their pixels merged back into the image
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef PROCESS_SCHEDULER_H_
+#define PROCESS_SCHEDULER_H_
+
+#include "Tile_Scheduler.h"
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define PROCESS_SCHEDULER_AVAILABLE
+    #include <unistd.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <sys/wait.h>
+#endif
+
+#ifdef PROCESS_SCHEDULER_AVAILABLE
+//Coordinator's end of the pipes to one worker.
+struct Worker_Connection
+{
+    pid_t process_id;
+    int request_pipe;//coordinator writes tiles to render, closed to tell the worker to exit
+    int result_pipe;//coordinator reads rendered tiles
+    int tile_index;//tile the worker is rendering, -1 if idle
+};
+
+/*
+ * Writes all of a buffer to a pipe, pipes accept large writes in pieces. Returns false if the other end is gone.
+ *
+ * PIPE: file descriptor written to
+ * DATA: start of the buffer
+ * SIZE: bytes to write
+ */
+static bool write_all(const int PIPE, const void * DATA, size_t size)
+{
+    const char * position = static_cast<const char *>(DATA);
+
+    while (size > 0)
+    {
+        const ssize_t WRITTEN = write(PIPE, position, size);
+        if (WRITTEN <= 0)
+            return false;
+        position += WRITTEN;
+        size -= static_cast<size_t>(WRITTEN);
+    }
+    return true;
+}
+
+/*
+ * Reads exactly size bytes from a pipe. Returns false on end of file or error.
+ *
+ * PIPE: file descriptor read from
+ * data: where the bytes are stored
+ * size: bytes to read
+ */
+static bool read_all(const int PIPE, void * data, size_t size)
+{
+    char * position = static_cast<char *>(data);
+
+    while (size > 0)
+    {
+        const ssize_t READ = read(PIPE, position, size);
+        if (READ <= 0)
+            return false;
+        position += READ;
+        size -= static_cast<size_t>(READ);
+    }
+    return true;
+}
+
+/*
+ * Main loop of a worker process. Renders each tile it is sent and answers with {tile, busy seconds, Tile_Result, pixels} until its request pipe closes.
+ *
+ * REQUEST_PIPE, RESULT_PIPE: worker's ends of the pipes
+ * render_tile: see render_tiles_in_processes(...)
+ */
+template <typename Tile_Result, typename Tile_Function>
+static void worker_loop(const int REQUEST_PIPE, const int RESULT_PIPE, Tile_Function& render_tile)
+{
+    struct Tile tile;
+    std::vector<float> pixels;
+
+    while (read_all(REQUEST_PIPE, &tile, sizeof(tile)))
+    {
+        const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+        const Tile_Result RESULT = render_tile(tile, pixels);
+        const double BUSY_SECONDS = std::chrono::duration<double>(std::chrono::steady_clock::now() - START).count();
+
+        if (!write_all(RESULT_PIPE, &tile, sizeof(tile)) || !write_all(RESULT_PIPE, &BUSY_SECONDS, sizeof(BUSY_SECONDS)) || !write_all(RESULT_PIPE, &RESULT, sizeof(RESULT)) ||
+            !write_all(RESULT_PIPE, pixels.data(), pixels.size() * sizeof(float)))
+            return;
+    }
+}
+
+/*
+ * Sends a worker its next tile, or closes its request pipe if there are none left. Returns false when the worker was told to exit.
+ *
+ * worker: worker being given work
+ * TILES: all tiles
+ * next_tile: index of the next tile not yet handed out, advanced if one is sent
+ */
+static bool dispatch_tile(struct Worker_Connection& worker, const std::vector<struct Tile>& TILES, unsigned int& next_tile)
+{
+    if (next_tile < TILES.size() && write_all(worker.request_pipe, &TILES[next_tile], sizeof(struct Tile)))
+    {
+        worker.tile_index = static_cast<int>(next_tile++);
+        return true;
+    }
+    close(worker.request_pipe);
+    worker.request_pipe = -1;
+    worker.tile_index = -1;
+    return false;
+}
+#endif
+
+/*
+ * Renders every tile in WORKER_COUNT forked worker processes, which inherit the already parsed scene. The coordinator hands out one tile at a time to whichever worker
+ * is idle and passes the returned pixels on to merge_result. Tiles of a worker that dies are rendered by the coordinator itself. Returns a report per worker, where
+ * tiles_stolen counts tiles the coordinator had to render for that worker.
+ *
+ * TILES: tiles to render
+ * WORKER_COUNT: number of worker processes
+ * render_tile: called as render_tile(tile, pixels) in a worker, renders the tile into pixels, a std::vector<float> it resizes to hold the tile's interleaved
+ *              {R, G, B}, and returns a trivially copyable Tile_Result
+ * merge_result: called as merge_result(result, worker index, tile, pixels) in the coordinator for every rendered tile
+ */
+template <typename Tile_Result, typename Tile_Function, typename Merge_Function>
+static std::vector<struct Thread_Report> render_tiles_in_processes(const std::vector<struct Tile>& TILES, const unsigned int WORKER_COUNT, Tile_Function render_tile, Merge_Function merge_result)
+{
+    std::vector<struct Thread_Report> reports(WORKER_COUNT);
+#ifdef PROCESS_SCHEDULER_AVAILABLE
+    std::vector<struct Worker_Connection> workers;
+    std::vector<float> pixels;
+    unsigned int next_tile = 0, i;
+
+    std::cout.flush();//otherwise buffered output is written again by every worker
+    std::cerr.flush();
+    signal(SIGPIPE, SIG_IGN);//a dead worker shows up as a failed write instead of killing the coordinator
+    for (i = 0; i < WORKER_COUNT; ++i)
+    {
+        int request_pipe [2], result_pipe [2];
+        pid_t process_id;
+
+        if (pipe(request_pipe) != 0)
+            break;
+        if (pipe(result_pipe) != 0)
+        {
+            close(request_pipe[0]);
+            close(request_pipe[1]);
+            break;
+        }
+        if ((process_id = fork()) == 0)//worker
+        {
+            close(request_pipe[1]);
+            close(result_pipe[0]);
+            for (unsigned int j = 0; j < workers.size(); ++j)//pipes of earlier workers were inherited as well
+            {
+                close(workers[j].request_pipe);
+                close(workers[j].result_pipe);
+            }
+            worker_loop<Tile_Result>(request_pipe[0], result_pipe[1], render_tile);
+            _exit(0);//skip destructors and atexit handlers owned by the coordinator
+        }
+        close(request_pipe[0]);
+        close(result_pipe[1]);
+        if (process_id < 0)
+        {
+            close(request_pipe[1]);
+            close(result_pipe[0]);
+            break;
+        }
+        workers.push_back({process_id, request_pipe[1], result_pipe[0], -1});
+    }
+    if (workers.size() < WORKER_COUNT)
+        std::cerr << "Warning: only " << workers.size() << " of " << WORKER_COUNT << " worker processes could be started." << std::endl;
+
+    {
+        unsigned int active_workers = 0;
+        std::vector<struct pollfd> poll_list;
+
+        for (i = 0; i < workers.size(); ++i)
+            if (dispatch_tile(workers[i], TILES, next_tile))
+                ++active_workers;
+
+        while (active_workers > 0)
+        {
+            poll_list.clear();
+            for (i = 0; i < workers.size(); ++i)
+                if (workers[i].request_pipe >= 0)
+                    poll_list.push_back({workers[i].result_pipe, POLLIN, 0});
+            if (poll(poll_list.data(), poll_list.size(), -1) < 0)
+                continue;//interrupted by a signal
+
+            for (i = 0; i < workers.size(); ++i)
+            {
+                struct Worker_Connection& worker = workers[i];
+                bool ready = false;
+
+                if (worker.request_pipe < 0)
+                    continue;
+                for (unsigned int j = 0; j < poll_list.size(); ++j)
+                    if (poll_list[j].fd == worker.result_pipe && poll_list[j].revents != 0)
+                        ready = true;
+                if (!ready)
+                    continue;
+
+                {
+                    struct Tile tile;
+                    double busy_seconds;
+                    Tile_Result result;
+
+                    if (read_all(worker.result_pipe, &tile, sizeof(tile)) && read_all(worker.result_pipe, &busy_seconds, sizeof(busy_seconds)) && read_all(worker.result_pipe, &result, sizeof(result)))
+                    {
+                        const unsigned int TILE_WIDTH = tile.x_end - tile.x_start, TILE_HEIGHT = tile.y_end - tile.y_start;
+
+                        pixels.resize(static_cast<size_t>(TILE_WIDTH) * TILE_HEIGHT * 3);
+                        if (read_all(worker.result_pipe, pixels.data(), pixels.size() * sizeof(float)))
+                        {
+                            merge_result(result, i, tile, pixels);
+                            reports[i].busy_seconds += busy_seconds;
+                            ++reports[i].tiles_rendered;
+                            if (!dispatch_tile(worker, TILES, next_tile))
+                                --active_workers;
+                            continue;
+                        }
+                    }
+                }
+
+                //worker died, take over its tile
+                std::cerr << "Warning: worker process " << worker.process_id << " stopped responding, rendering its tile in the coordinator." << std::endl;
+                close(worker.request_pipe);
+                worker.request_pipe = -1;
+                --active_workers;
+                if (worker.tile_index >= 0)
+                {
+                    merge_result(render_tile(TILES[worker.tile_index], pixels), i, TILES[worker.tile_index], pixels);
+                    ++reports[i].tiles_stolen;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < workers.size(); ++i)
+    {
+        close(workers[i].result_pipe);
+        waitpid(workers[i].process_id, nullptr, 0);
+    }
+    //anything left over, when not all workers could be started
+    for (; next_tile < TILES.size(); ++next_tile)
+        merge_result(render_tile(TILES[next_tile], pixels), 0, TILES[next_tile], pixels);
+#else
+    std::vector<float> pixels;
+
+    std::cerr << "Warning: worker processes are not supported on this platform, rendering in the coordinator." << std::endl;
+    for (unsigned int i = 0; i < TILES.size(); ++i)
+        merge_result(render_tile(TILES[i], pixels), 0, TILES[i], pixels);
+#endif
+    return reports;
+}
+
+#endif /* PROCESS_SCHEDULER_H_ */
@@ -0,0 +1,216 @@
+/**
+Program name: Ray_Packet.h
+Purpose: packets of rays going much the same way, traversed through a BVH together with interval arithmetic culling for the whole packet and box tests of
+         several rays at once with SSE or AVX
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef RAY_PACKET_H_
+#define RAY_PACKET_H_
+
+#include "BVH.h"
+#include <algorithm>
+#include <float.h>
+#include <immintrin.h>
+
+#define RAY_PACKET_LIMIT 256//most rays in a Ray_Packet
+#ifdef __AVX__
+    #define RAY_PACKET_LANES 8//rays tested against a box at once, one AVX register
+#else
+    #define RAY_PACKET_LANES 4//one SSE register
+#endif
+
+//Bounds on a packet of rays: every ray starts in the origin box, has every component of its direction within the direction box and only counts between the
+//distances, see packet_hits_bounding_box(...).
+struct Ray_Packet_Bounds
+{
+    float origin_minimum [3] = {FLT_MAX, FLT_MAX, FLT_MAX}, origin_maximum [3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float direction_minimum [3] = {FLT_MAX, FLT_MAX, FLT_MAX}, direction_maximum [3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float minimum_distance = FLT_MAX, maximum_distance = 0.0f;//minimum_distance is at least 0
+};
+
+//Rays traversed through a BVH together, see traverse_bvh_packet(...). Ray i is element i of each array, which are one per field so RAY_PACKET_LANES rays are
+//loaded at once. The arrays run RAY_PACKET_LANES - 1 past the limit, so loading the last rays stays in bounds.
+struct Ray_Packet
+{
+    struct Ray_Packet_Bounds bounds;//of every ray added
+    unsigned int count = 0;
+    float origins [3][RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1];
+    float inverse_directions [3][RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1];//1 / ray direction per axis, see ray_hits_bounding_box(...)
+    float minimum_distances [RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1];//FLT_MAX past the count
+    float maximum_distances [RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1];//-FLT_MAX for rays that are done and past the count, which no box test passes
+};
+
+/*
+ * Empties a packet for rays to be added to it with add_packet_ray(...), marking every ray done.
+ *
+ * packet: packet emptied
+ */
+static void clear_ray_packet(struct Ray_Packet& packet)
+{
+    packet.bounds = Ray_Packet_Bounds();
+    packet.count = 0;
+    std::fill(packet.minimum_distances, packet.minimum_distances + RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1, FLT_MAX);
+    std::fill(packet.maximum_distances, packet.maximum_distances + RAY_PACKET_LIMIT + RAY_PACKET_LANES - 1, -FLT_MAX);
+}
+
+/*
+ * Adds a ray to a packet, growing its bounds. The packet must not be full, and must have been cleared with clear_ray_packet(...).
+ *
+ * packet: packet added to
+ * RAY_ORIGIN, RAY_DIRECTION: the ray
+ * MINIMUM_DISTANCE, MAXIMUM_DISTANCE: part of the ray that matters, in terms of scalar
+ */
+static void add_packet_ray(struct Ray_Packet& packet, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE, const float MAXIMUM_DISTANCE)
+{
+    struct Ray_Packet_Bounds& bounds = packet.bounds;
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        packet.origins[i][packet.count] = RAY_ORIGIN[i];
+        packet.inverse_directions[i][packet.count] = 1.0f / RAY_DIRECTION[i];
+        bounds.origin_minimum[i] = std::min(bounds.origin_minimum[i], RAY_ORIGIN[i]);
+        bounds.origin_maximum[i] = std::max(bounds.origin_maximum[i], RAY_ORIGIN[i]);
+        bounds.direction_minimum[i] = std::min(bounds.direction_minimum[i], RAY_DIRECTION[i]);
+        bounds.direction_maximum[i] = std::max(bounds.direction_maximum[i], RAY_DIRECTION[i]);
+    }
+    packet.minimum_distances[packet.count] = MINIMUM_DISTANCE;
+    packet.maximum_distances[packet.count++] = MAXIMUM_DISTANCE;
+    bounds.minimum_distance = std::min(bounds.minimum_distance, std::max(MINIMUM_DISTANCE, 0.0f));
+    bounds.maximum_distance = std::max(bounds.maximum_distance, MAXIMUM_DISTANCE);
+}
+
+/*
+ * Interval arithmetic test of a packet of rays against a box. Returns false only if no ray within BOUNDS can be inside the box, so a node failing it can be
+ * skipped for the whole packet. Along each axis, a point at distance t of such a ray lies within [origin_minimum + t * direction_minimum, origin_maximum + t *
+ * direction_maximum], t being at least 0, which limits t to where that interval overlaps the box's slab. A packet of rays going much the same way from much the
+ * same place is bounded tightly, like a frustum around it.
+ *
+ * BOX: box tested
+ * BOUNDS: bounds of the packet
+ */
+static bool packet_hits_bounding_box(const struct Bounding_Box& BOX, const struct Ray_Packet_Bounds& BOUNDS)
+{
+    float minimum_distance = BOUNDS.minimum_distance, maximum_distance = BOUNDS.maximum_distance;
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        //origin_maximum + t * direction_maximum >= BOX.minimum and origin_minimum + t * direction_minimum <= BOX.maximum
+        const float LOWER_GAP = BOX.minimum[i] - BOUNDS.origin_maximum[i], UPPER_GAP = BOX.maximum[i] - BOUNDS.origin_minimum[i];
+
+        if (BOUNDS.direction_maximum[i] > 0.0f)
+            minimum_distance = std::max(minimum_distance, LOWER_GAP / BOUNDS.direction_maximum[i]);
+        else if (BOUNDS.direction_maximum[i] < 0.0f)
+            maximum_distance = std::min(maximum_distance, LOWER_GAP / BOUNDS.direction_maximum[i]);
+        else if (LOWER_GAP > 0.0f)
+            return false;
+        if (BOUNDS.direction_minimum[i] < 0.0f)
+            minimum_distance = std::max(minimum_distance, UPPER_GAP / BOUNDS.direction_minimum[i]);
+        else if (BOUNDS.direction_minimum[i] > 0.0f)
+            maximum_distance = std::min(maximum_distance, UPPER_GAP / BOUNDS.direction_minimum[i]);
+        else if (UPPER_GAP < 0.0f)
+            return false;
+        if (minimum_distance > maximum_distance)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Slab test of RAY_PACKET_LANES rays of a packet against a box at once, see ray_hits_bounding_box(...). Returns a mask with bit i set if ray FIRST + i hits it.
+ * Rays past the packet's count or done never do. Where a 0 direction starts right on a slab the test can pass where ray_hits_bounding_box(...) fails, never the
+ * other way around, which only costs a few more primitive tests.
+ *
+ * BOX: box tested
+ * PACKET: rays tested
+ * FIRST: first ray tested
+ */
+static unsigned int packet_rays_hit_bounding_box(const struct Bounding_Box& BOX, const struct Ray_Packet& PACKET, const unsigned int FIRST)
+{
+    //max and min return their second operand when the first is NaN, which leaves the interval alone
+    #ifdef __AVX__
+        __m256 minimum = _mm256_loadu_ps(&PACKET.minimum_distances[FIRST]), maximum = _mm256_loadu_ps(&PACKET.maximum_distances[FIRST]);
+
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            const __m256 ORIGIN = _mm256_loadu_ps(&PACKET.origins[axis][FIRST]), INVERSE_DIRECTION = _mm256_loadu_ps(&PACKET.inverse_directions[axis][FIRST]);
+            const __m256 LOWER = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(BOX.minimum[axis]), ORIGIN), INVERSE_DIRECTION);
+            const __m256 UPPER = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(BOX.maximum[axis]), ORIGIN), INVERSE_DIRECTION);
+            const __m256 NEGATIVE = _mm256_cmp_ps(INVERSE_DIRECTION, _mm256_setzero_ps(), _CMP_LT_OQ);//the ray enters through the maximum
+
+            minimum = _mm256_max_ps(_mm256_blendv_ps(LOWER, UPPER, NEGATIVE), minimum);
+            maximum = _mm256_min_ps(_mm256_blendv_ps(UPPER, LOWER, NEGATIVE), maximum);
+        }
+        return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(minimum, maximum, _CMP_LE_OQ)));
+    #else
+        __m128 minimum = _mm_loadu_ps(&PACKET.minimum_distances[FIRST]), maximum = _mm_loadu_ps(&PACKET.maximum_distances[FIRST]);
+
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            const __m128 ORIGIN = _mm_loadu_ps(&PACKET.origins[axis][FIRST]), INVERSE_DIRECTION = _mm_loadu_ps(&PACKET.inverse_directions[axis][FIRST]);
+            const __m128 LOWER = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(BOX.minimum[axis]), ORIGIN), INVERSE_DIRECTION);
+            const __m128 UPPER = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(BOX.maximum[axis]), ORIGIN), INVERSE_DIRECTION);
+            const __m128 NEGATIVE = _mm_cmplt_ps(INVERSE_DIRECTION, _mm_setzero_ps());//the ray enters through the maximum
+
+            minimum = _mm_max_ps(_mm_or_ps(_mm_and_ps(NEGATIVE, UPPER), _mm_andnot_ps(NEGATIVE, LOWER)), minimum);
+            maximum = _mm_min_ps(_mm_or_ps(_mm_and_ps(NEGATIVE, LOWER), _mm_andnot_ps(NEGATIVE, UPPER)), maximum);
+        }
+        return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(minimum, maximum)));
+    #endif
+}
+
+/*
+ * Any hit traversal of a BVH with a packet of rays. Nodes are culled for the whole packet with packet_hits_bounding_box(...), which costs one test however many
+ * rays the packet holds, then by finding the first ray of the packet that hits them, starting from the one that hit their parent, as earlier rays missed the
+ * parent already. In a leaf, every ray from there on that hits its box is handed to ray_hits_leaf(ray, first, count), ray being its index in the packet, which
+ * returns true if a primitive in the range of TREE.primitive_indices blocks it. Blocked rays are marked done, and the traversal stops once all are. Returns the
+ * number of rays blocked.
+ *
+ * TREE: tree traversed
+ * packet: rays traversed, see add_packet_ray(...)
+ * ray_hits_leaf: see above
+ */
+template <typename Ray_Leaf_Function>
+static unsigned int traverse_bvh_packet(const struct BVH& TREE, struct Ray_Packet& packet, Ray_Leaf_Function ray_hits_leaf)
+{
+    unsigned int stack [BVH_STACK_SIZE][2], stack_size = 0, blocked = 0;//node and first ray to test it with
+
+    if (TREE.nodes.empty() || packet.count == 0)
+        return 0;
+    stack[stack_size][0] = 0;
+    stack[stack_size++][1] = 0;
+    while (stack_size > 0)
+    {
+        const struct BVH_Node& NODE = TREE.nodes[stack[--stack_size][0]];
+        unsigned int first_ray = stack[stack_size][1], lanes = first_ray, hits = 0;//hits of the rays from lanes on
+
+        if (!packet_hits_bounding_box(NODE.bounds, packet.bounds))
+            continue;
+        for (; lanes < packet.count && (hits = packet_rays_hit_bounding_box(NODE.bounds, packet, lanes)) == 0; lanes += RAY_PACKET_LANES);
+        if (hits == 0)
+            continue;
+        for (first_ray = lanes; (hits >> (first_ray - lanes) & 1) == 0; ++first_ray);
+        if (NODE.count > 0)
+        {
+            for (; lanes < packet.count; lanes += RAY_PACKET_LANES, hits = lanes < packet.count ? packet_rays_hit_bounding_box(NODE.bounds, packet, lanes) : 0)
+                for (unsigned int ray = lanes; hits != 0; hits >>= 1, ++ray)
+                    if ((hits & 1) != 0 && ray_hits_leaf(ray, NODE.first, NODE.count))
+                    {
+                        packet.maximum_distances[ray] = -FLT_MAX;//done
+                        ++blocked;
+                    }
+            if (blocked == packet.count)
+                return blocked;
+        }
+        else
+        {
+            stack[stack_size][0] = NODE.first + 1;
+            stack[stack_size++][1] = first_ray;
+            stack[stack_size][0] = NODE.first;
+            stack[stack_size++][1] = first_ray;
+        }
+    }
+    return blocked;
+}
+
+#endif /* RAY_PACKET_H_ */
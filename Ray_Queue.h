@@ -0,0 +1,199 @@
+/**
+Program name: Ray_Queue.h
+Purpose: batches of rays sorted by type and direction, so wavefront kernels test rays going the same way one after another
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef RAY_QUEUE_H_
+#define RAY_QUEUE_H_
+
+#include "BVH.h"
+#include "Ray_Packet.h"
+#include <vector>
+#include <algorithm>
+
+#define RAY_DIRECTION_KEY_BITS 4//bits each direction component is quantized to in a sort key
+
+//What a queued ray is traced for, the most significant part of its sort key so each type is handled by its own kernels.
+enum Ray_Type
+{
+    RAY_TYPE_SHADOW,//any hit between a surface point and a light
+    RAY_TYPE_REFLECTION,//closest hit along a mirror reflection
+    RAY_TYPE_REFRACTION//closest hit along a refraction, or the reflection total internal reflection turns it into
+};
+
+//What a closest hit ray hit, and so what its hit primitive is of.
+enum Ray_Hit
+{
+    RAY_HIT_NOTHING,
+    RAY_HIT_PLANE,//plane_instance, the primitive is unused
+    RAY_HIT_SPHERE,//index in sphere_container
+    RAY_HIT_TRIANGLE//triangle i of mesh_instance, made of mesh_instance.vertices[3i, 3i + 2]
+};
+
+//Rays with one array per field, ray i is element i of each. Kernels walk active, which is kept in sort order.
+struct Ray_Queue
+{
+    std::vector<float> origins, directions;//3 floats per ray
+    std::vector<float> minimum_distances, maximum_distances;//only hits in between count
+    std::vector<unsigned int> groups;//what the ray is traced for within its type, the light for shadow rays
+    std::vector<unsigned int> owners;//what the result belongs to, such as a sample of a G-buffer or a path vertex
+    std::vector<unsigned long long> keys;//see ray_sort_key(...)
+    std::vector<unsigned char> hits;//whether a kernel found a hit, for closest hit rays the Ray_Hit of the closest one so far, whose scalar maximum_distances shrinks to
+    std::vector<unsigned int> hit_primitives;//for closest hit rays, the sphere or triangle the Ray_Hit in hits refers to
+    std::vector<unsigned int> active;//rays no kernel has resolved yet
+    std::vector<unsigned int> sort_scratch;//see sort_ray_queue(...), kept to reuse its memory
+    bool direction_keys = true;//whether keys order rays of a group by direction, rather than keeping the order they were added in, see store_ray(...)
+};
+
+/*
+ * Sort key of a ray: its type, then its group, then its direction quantized and interleaved into a Morton code. The sign bits of the direction end up on top
+ * of the Morton code, so rays are grouped by octant first and by how close their directions are within it.
+ *
+ * TYPE: what the ray is for
+ * GROUP: see Ray_Queue::groups, only the low 24 bits are used
+ * DIRECTION: normalized direction, nullptr to leave it out of the key
+ */
+static unsigned long long ray_sort_key(const enum Ray_Type TYPE, const unsigned int GROUP, const float DIRECTION [3])
+{
+    const float SCALE = ((1u << RAY_DIRECTION_KEY_BITS) - 1) * 0.5f;
+    unsigned int morton = 0;
+
+    for (unsigned int i = 0; DIRECTION != nullptr && i < 3; ++i)
+    {
+        const float QUANTIZED = (DIRECTION[i] + 1.0f) * SCALE + 0.5f;
+        morton |= spread_morton_bits(QUANTIZED <= 0.0f ? 0u : static_cast<unsigned int>(QUANTIZED)) << (2 - i);
+    }
+    return static_cast<unsigned long long>(TYPE) << 56 | static_cast<unsigned long long>(GROUP & 0xffffffu) << 32 | morton;
+}
+
+/*
+ * Resizes a queue, for its rays to be filled in with store_ray(...). Keeps its memory, so reusing a queue for batch after batch does not allocate.
+ *
+ * queue: queue resized
+ * COUNT: rays it holds afterwards
+ */
+static void resize_ray_queue(struct Ray_Queue& queue, const size_t COUNT)
+{
+    queue.origins.resize(COUNT * 3);
+    queue.directions.resize(COUNT * 3);
+    queue.minimum_distances.resize(COUNT);
+    queue.maximum_distances.resize(COUNT);
+    queue.groups.resize(COUNT);
+    queue.owners.resize(COUNT);
+    queue.keys.resize(COUNT);
+    queue.hit_primitives.resize(COUNT);
+    queue.hits.clear();
+    queue.active.clear();
+}
+
+/*
+ * Stores a ray in a queue. Without queue.direction_keys, its key leaves out the direction, so rays of a group stay in the order they were added in, which
+ * for rays added pixel by pixel keeps neighbours together for packets, see next_ray_packet(...), and sorting a queue filled group by group costs nothing.
+ *
+ * queue: queue stored to
+ * INDEX: ray stored
+ * TYPE, GROUP: see ray_sort_key(...)
+ * ORIGIN, DIRECTION: the ray, DIRECTION normalized
+ * MINIMUM_DISTANCE, MAXIMUM_DISTANCE: range of scalars hits count in
+ * OWNER: see Ray_Queue::owners
+ */
+static void store_ray(struct Ray_Queue& queue, const size_t INDEX, const enum Ray_Type TYPE, const unsigned int GROUP, const float ORIGIN [3], const float DIRECTION [3],
+                      const float MINIMUM_DISTANCE, const float MAXIMUM_DISTANCE, const unsigned int OWNER)
+{
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        queue.origins[INDEX * 3 + i] = ORIGIN[i];
+        queue.directions[INDEX * 3 + i] = DIRECTION[i];
+    }
+    queue.minimum_distances[INDEX] = MINIMUM_DISTANCE;
+    queue.maximum_distances[INDEX] = MAXIMUM_DISTANCE;
+    queue.groups[INDEX] = GROUP;
+    queue.owners[INDEX] = OWNER;
+    queue.keys[INDEX] = queue.direction_keys ? ray_sort_key(TYPE, GROUP, DIRECTION) : ray_sort_key(TYPE, GROUP, nullptr);
+}
+
+/*
+ * Makes every ray of a queue active, ordered by sort key so kernels test similar rays one after another. Only the active list is reordered, the fields stay
+ * where they are. Keys are radix sorted a byte at a time, skipping bytes that are the same for every ray, which is most of them, so sorting is linear in the
+ * number of rays, and skipped entirely when rays were added in order. Each pass is stable, rays with equal keys keep the order they were added in, which is
+ * usually coherent already.
+ *
+ * queue: queue sorted
+ */
+static void sort_ray_queue(struct Ray_Queue& queue)
+{
+    const size_t COUNT = queue.keys.size();
+    unsigned long long all_bits = 0, common_bits = ~0ull;
+    bool in_order = true;
+
+    queue.hits.assign(COUNT, 0);
+    queue.active.resize(COUNT);
+    queue.sort_scratch.resize(COUNT);
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+        queue.active[i] = static_cast<unsigned int>(i);
+        all_bits |= queue.keys[i];
+        common_bits &= queue.keys[i];
+        in_order = in_order && (i == 0 || queue.keys[i - 1] <= queue.keys[i]);
+    }
+    if (in_order)
+        return;
+    for (unsigned int shift = 0; shift < 64; shift += 8)//least significant byte first
+    {
+        size_t counts [257] = {0};
+
+        if (((all_bits ^ common_bits) >> shift & 0xffu) == 0)
+            continue;
+        for (size_t i = 0; i < COUNT; ++i)
+            ++counts[(queue.keys[queue.active[i]] >> shift & 0xffu) + 1];
+        for (unsigned int digit = 1; digit < 257; ++digit)
+            counts[digit] += counts[digit - 1];
+        for (size_t i = 0; i < COUNT; ++i)
+            queue.sort_scratch[counts[queue.keys[queue.active[i]] >> shift & 0xffu]++] = queue.active[i];
+        queue.active.swap(queue.sort_scratch);
+    }
+}
+
+/*
+ * Drops rays a kernel found a hit for from the active list, keeping the rest in order. Returns the number dropped.
+ *
+ * queue: queue compacted
+ */
+static size_t compact_ray_queue(struct Ray_Queue& queue)
+{
+    const size_t BEFORE = queue.active.size();
+
+    queue.active.erase(std::remove_if(queue.active.begin(), queue.active.end(), [&](const unsigned int RAY)
+    {
+        return queue.hits[RAY] != 0;
+    }), queue.active.end());
+    return BEFORE - queue.active.size();
+}
+
+/*
+ * Takes the packet of active rays starting at queue.active[START]: the rays after it in the same group, up to MAXIMUM_COUNT of them. As active is in sort order,
+ * these are rays of one group going much the same way, which a BVH can be traversed with together, see traverse_bvh_packet(...). Returns where the packet ends
+ * in queue.active.
+ *
+ * QUEUE: queue the packet is taken from, sorted
+ * START: where the packet starts in QUEUE.active
+ * MAXIMUM_COUNT: most rays in the packet, in [1, RAY_PACKET_LIMIT]
+ * packet: where the rays are stored, ray i of it is QUEUE.active[START + i]
+ */
+static size_t next_ray_packet(const struct Ray_Queue& QUEUE, const size_t START, const unsigned int MAXIMUM_COUNT, struct Ray_Packet& packet)
+{
+    const unsigned int GROUP = QUEUE.groups[QUEUE.active[START]];
+    size_t end = START;
+
+    clear_ray_packet(packet);
+    for (; end < QUEUE.active.size() && end - START < MAXIMUM_COUNT && QUEUE.groups[QUEUE.active[end]] == GROUP; ++end)
+    {
+        const unsigned int RAY = QUEUE.active[end];
+
+        add_packet_ray(packet, &QUEUE.origins[RAY * 3], &QUEUE.directions[RAY * 3], QUEUE.minimum_distances[RAY], QUEUE.maximum_distances[RAY]);
+    }
+    return end;
+}
+
+#endif /* RAY_QUEUE_H_ */
@@ -17,6 +17,23 @@ Date: 2019-03-[30, 31]/2019-4-[5, 10]
 #include <float.h>
 #include "OBJloader_modified.h"
 #include <string.h>
+#include "Tile_Scheduler.h"
+#include "Process_Scheduler.h"
+#include "BVH.h"
+#include "Wide_BVH.h"
+#include "Grid.h"
+#include "Sequence.h"
+#include "Frame_Buffer.h"
+#include "Image_Writers.h"
+#include "G_Buffer.h"
+#include "Visibility_Buffer.h"
+#include "Ray_Queue.h"
+#include "Light_Tree.h"
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <errno.h>
+#include <stdlib.h>
 
 //#define DEBUG_1//file reading
 //#define DEBUG_2//paths and display output
@@ -26,12 +43,144 @@ Date: 2019-03-[30, 31]/2019-4-[5, 10]
 //#define DEBUG_4_NOT_BLOCKED//light ray was not blocked by object, warning is rather time consuming
 #define ZERO_TOLERANCE 0.0005f//0.0005f is magic number that acts as tolerance to see if the value is approximately == to 0.
 #define SHADOW_BIAS 0.05f//0.05f is magic number for removing some shadows
+#define DEFAULT_SAMPLES_PER_PIXEL 1//1 keeps the single ray through the pixel corner
+#define DEFAULT_CONTRAST_THRESHOLD 0.1f//largest colour channel difference, in [0, 1], between neighbouring base samples before a pixel is supersampled
+#define DEFAULT_TILE_SIZE 32//width and height in pixels of the tiles handed to threads
+#define DEFAULT_REFIT_THRESHOLD 1.5f//how many times its built cost a refit BVH may reach before it is rebuilt instead
+#define SECONDARY_RAY_BIAS 0.05f//like SHADOW_BIAS, keeps reflection and refraction rays from hitting the surface they leave
+#define MAX_TRACE_DEPTH 16//most secondary rays deep a path can go, "--max-depth" is clamped to it
+#define DEFAULT_MAX_DEPTH 5//secondary rays deep paths go by default
+#define DEFAULT_ROULETTE_DEPTH 3//secondary rays deep paths go before Russian roulette may end them
+#define LIGHT_CUT_LIMIT 256//most entries a light cut may grow to, refining stops there whatever the error
+#define NO_LIGHT_CUT_NODE UINT_MAX//marks single lights in a light cut
+#ifdef __AVX__
+    #define TRIANGLE_BATCH_SIZE 8//triangles of a mesh leaf tested at once, one per AVX lane, see triangle_leaf_hits(...)
+#else
+    #define TRIANGLE_BATCH_SIZE 4//one per SSE lane
+#endif
+#define REGION_SPHERE_LIMIT 8//most spheres a region lists for its primary rays to test directly, with more they go through the sphere BVH, see cull_region_primitives(...)
+#define DEFAULT_SHADOW_PACKET_SIZE 64//shadow rays of one light the deferred shadow pass traces through a BVH together, see trace_any_hit_packets(...)
+#define RASTER_MARGIN 0.0625f//pixels projected bounds are grown by on every side when rasterizing, far more than rounding moves them, see visibility_span(...)
+#define RASTER_DEPTH_TOLERANCE 0.001f//fraction of its distance a hit's scalar may come out short by when rasterizing, far more than rounding moves it, see visibility_occluded(...)
+#define DEFAULT_LIGHT_SAMPLES 16//shadow rays per area light for points in a penumbra, rounded down to a square number for stratification
 
 using std::endl;
 using std::cerr;
 
+std::vector<struct Sphere> sphere_container;
+std::vector<struct Light> light_container;
+struct BVH sphere_bvh;//over sphere_container, primitive i is sphere_container[i], empty while sphere_grid is in use
+struct Grid sphere_grid;//over sphere_container when render_settings.sphere_structure picks a grid, empty otherwise
+struct BVH mesh_bvh;//over mesh_instance's triangles, primitive i is made of mesh_instance.vertices[3i, 3i + 2]
+struct Wide_BVH<4> sphere_bvh_4, mesh_bvh_4;//sphere_bvh and mesh_bvh collapsed to 4 children per node with "--bvh-width 4", empty otherwise
+struct Wide_BVH<8> sphere_bvh_8, mesh_bvh_8;//sphere_bvh and mesh_bvh collapsed to 8 children per node with "--bvh-width 8", empty otherwise
+struct Compressed_BVH sphere_bvh_compressed, mesh_bvh_compressed;//sphere_bvh and mesh_bvh collapsed to 4 children per node and compressed with "--compressed-bvh"
+struct Image_Writer image_writer;//saves output images in the background
+struct Render_Cache render_cache;//samples kept between frames with "--gbuffer"
+struct Light_Tree light_tree;//over the point lights of light_container with "--light-tree"
+
+//Settings that can be changed through command line options, see read_command_line_options(...).
+struct Render_Settings
+{
+    unsigned int samples_per_pixel = DEFAULT_SAMPLES_PER_PIXEL;//"--spp", rays for a supersampled pixel, rounded down to a square number for stratification
+    float contrast_threshold = DEFAULT_CONTRAST_THRESHOLD;//"--aa-threshold", see DEFAULT_CONTRAST_THRESHOLD
+    bool adaptive = true;//"--aa-full" turns this off to supersample every pixel instead of only those on edges
+    unsigned int thread_count = std::thread::hardware_concurrency();//"--threads", 0 if it could not be determined, in which case 1 is used
+    unsigned int tile_size = DEFAULT_TILE_SIZE;//"--tile-size"
+    unsigned int worker_count = 0;//"--workers", number of worker processes tiles are handed to, 0 renders with threads in this process
+    std::string sequence_name;//"--sequence", sequence file in the Input folder to animate the scene with, empty to render a single image
+    float refit_threshold = DEFAULT_REFIT_THRESHOLD;//"--refit-threshold", see DEFAULT_REFIT_THRESHOLD, 0 always rebuilds
+    enum BVH_Builder bvh_builder = BVH_BUILDER_SAH;//"--bvh-builder", how sphere_bvh and mesh_bvh are built
+    unsigned int bvh_width = WIDE_BVH_DEFAULT_WIDTH;//"--bvh-width", children per node sphere_bvh and mesh_bvh are traversed with, 2 traverses them as built
+    bool compressed_bvh = false;//"--compressed-bvh", traverse sphere_bvh and mesh_bvh through Compressed_BVH_Node instead, whatever bvh_width is
+    unsigned int mesh_leaf_size = TRIANGLE_BATCH_SIZE;//"--mesh-leaf-size", most triangles in a leaf of mesh_bvh, a batch fills a leaf by default
+    enum Image_Format output_format = IMAGE_FORMAT_BMP;//"--format", what the output image is saved as
+    enum Frame_Buffer_Depth frame_buffer_depth = FRAME_BUFFER_AUTOMATIC;//"--framebuffer", how the final image is held in memory
+    enum Tonemap tonemap = TONEMAP_CLAMP;//"--tonemap", how radiance is mapped to [0, 1] when quantized
+    bool srgb = false;//"--srgb", quantize sRGB encoded values instead of linear ones
+    bool stream = false;//"--stream", write images band by band as they render instead of holding the whole frame in memory
+    struct Tile crop = {0, 0, 0, 0};//"--crop", window of the image to render with the full image's camera, empty for the whole image
+    std::string composite_path;//"--composite", existing image the crop is rendered into, the result is saved as a new image
+    bool g_buffer = false;//"--gbuffer", keep every sample's surface hit and light mask in render_cache so material only edits are re-shaded without tracing
+    bool deferred = false;//"--deferred", render frames in separate visibility, shadow, secondary and shading passes, see render_tiles_deferred(...)
+    bool frustum_culling = true;//"--no-frustum-culling" turns this off to test primary rays against the whole scene instead of what each tile can see
+    bool rasterize = false;//"--rasterize", fill the deferred visibility pass by rasterizing into a Visibility_Buffer instead of tracing, see rasterize_tile_visibility(...)
+    unsigned int shadow_packet_size = DEFAULT_SHADOW_PACKET_SIZE;//"--shadow-packets", see DEFAULT_SHADOW_PACKET_SIZE, 1 traces the deferred shadow rays one by one
+    unsigned int max_depth = DEFAULT_MAX_DEPTH;//"--max-depth", see add_secondary_light(...), 0 shades direct light only
+    unsigned int roulette_depth = DEFAULT_ROULETTE_DEPTH;//"--roulette-depth", see add_secondary_light(...)
+    unsigned long long ray_budget = 0;//"--ray-budget", most secondary rays a frame may trace, 0 for no limit, split evenly between worker processes
+    unsigned int light_samples = DEFAULT_LIGHT_SAMPLES;//"--light-samples", see DEFAULT_LIGHT_SAMPLES
+    float light_tree_tolerance = 0.0f;//"--light-tree", shade point lights through light_tree with this relative error per cut entry, see add_light_cut(...), 0 shades every light
+    enum Acceleration_Structure sphere_structure = ACCELERATION_AUTOMATIC;//"--sphere-structure", whether rays find spheres through sphere_bvh or sphere_grid
+}render_settings;
+
+std::atomic<unsigned long long> secondary_rays_left;//of the frame's ray budget, see take_secondary_ray()
+
+//Dimensions of the image, derived from the camera.
+struct Image_Plane
+{
+    unsigned int horizontal, vertical;//image size in pixels
+    unsigned int half_horizontal, half_vertical;//offsets from pixel indices to ray targets
+    float adjusted_camera_position [ARRAY_SIZE];//point primary ray directions are calculated from
+}image_plane;
+
+//Work done when rendering part of the image.
+struct Sampling_Statistics
+{
+    unsigned long long primary_rays = 0;//number of primary rays traced
+    unsigned long long refined_pixels = 0;//number of pixels that were supersampled
+    unsigned long long reshaded_samples = 0;//number of samples shaded from render_cache instead of traced
+    unsigned long long refreshed_shadow_rays = 0;//number of shadow rays traced again for cached samples because their light moved
+    unsigned long long secondary_rays [MAX_TRACE_DEPTH] = {0};//number of reflection and refraction rays traced, per depth starting at 1
+    unsigned long long budget_cut_rays = 0;//number of secondary rays not traced because the ray budget was used up
+    unsigned long long area_light_points = 0;//number of times a point was lit by an area light
+    unsigned long long penumbra_points = 0;//number of those that were in a penumbra and got every shadow ray
+    unsigned long long area_shadow_rays = 0;//number of shadow rays traced towards area lights
+    unsigned long long light_cut_points = 0;//number of points shaded with a light cut
+    unsigned long long light_cut_entries = 0;//total size of their light cuts
+    unsigned long long light_cut_shadow_rays = 0;//number of shadow rays traced for light cuts
+    unsigned long long light_lists = 0;//number of tiles whose lights were culled
+    unsigned long long light_list_candidates = 0;//total number of lights their lists were culled from
+    unsigned long long light_list_entries = 0;//total number of lights left in their lists
+    unsigned long long primitive_lists = 0;//number of regions whose primitives were culled for their primary rays
+    unsigned long long plane_regions = 0;//number of those the plane can be seen through
+    unsigned long long mesh_regions = 0;//number of those the mesh can be seen through
+    unsigned long long sphere_lists = 0;//number of those that listed their spheres
+    unsigned long long listed_spheres = 0;//total number of spheres in their lists
+};
+
+/*
+ * Adds the work done in ADDED to total.
+ *
+ * total: statistics added to
+ * ADDED: statistics added
+ */
+static void add_sampling_statistics(struct Sampling_Statistics& total, const struct Sampling_Statistics& ADDED)
+{
+    total.primary_rays += ADDED.primary_rays;
+    total.refined_pixels += ADDED.refined_pixels;
+    total.reshaded_samples += ADDED.reshaded_samples;
+    total.refreshed_shadow_rays += ADDED.refreshed_shadow_rays;
+    for (unsigned int i = 0; i < MAX_TRACE_DEPTH; ++i)
+        total.secondary_rays[i] += ADDED.secondary_rays[i];
+    total.budget_cut_rays += ADDED.budget_cut_rays;
+    total.area_light_points += ADDED.area_light_points;
+    total.penumbra_points += ADDED.penumbra_points;
+    total.area_shadow_rays += ADDED.area_shadow_rays;
+    total.light_cut_points += ADDED.light_cut_points;
+    total.light_cut_entries += ADDED.light_cut_entries;
+    total.light_cut_shadow_rays += ADDED.light_cut_shadow_rays;
+    total.light_lists += ADDED.light_lists;
+    total.light_list_candidates += ADDED.light_list_candidates;
+    total.light_list_entries += ADDED.light_list_entries;
+    total.primitive_lists += ADDED.primitive_lists;
+    total.plane_regions += ADDED.plane_regions;
+    total.mesh_regions += ADDED.mesh_regions;
+    total.sphere_lists += ADDED.sphere_lists;
+    total.listed_spheres += ADDED.listed_spheres;
+}
+
 static float dot_product(const float [ARRAY_SIZE], const float [ARRAY_SIZE]);//forward declaration to use function in...plane_intersection(...).
-static void cross_product(const float [ARRAY_SIZE], const float [ARRAY_SIZE], float [ARRAY_SIZE]);//forward declaration to use function in...triangle_intersection(...).
 
 /**
  * function to read int from file
@@ -88,189 +237,83 @@ static float dot_product(const float VECTOR_1 [ARRAY_SIZE], const float VECTOR_2
         to_return += VECTOR_1[i] * VECTOR_2[i];
     return to_return;
 }
-static float dot_product(const float VECTOR_1 [ARRAY_SIZE], const std::array<float, ARRAY_SIZE>& VECTOR_2)
-{
-    float to_return = 0.0f;
-    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
-        to_return += VECTOR_1[i] * VECTOR_2[i];
-    return to_return;
-}
 
 /*
- * Calculates intersection of a plane with a ray. Returns nullptr in event of no intersection. Returns dynamically allocated float which represents a scaler to point of intersection.
- * Also returns nullptr in event that intersection us not positive for implementation reasons. Such as nullptr being used as a special value.
+ * Calculates the scalar from a ray's origin to where it intersects a plane, without allocating. Returns false if they are parallel or the intersection is not positive.
  *
  * INPUT_PLANE: is plane being tested for an intersection
  * RAY_ORIGIN: array of size 3 represent point origin of the ray
  * RAY_DIRECTION: array size 3 representing a mathematical vector of the ray's direction
+ * distance: where the scalar is stored
  */
-static float * plane_intersection(const struct Plane& INPUT_PLANE, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE])
+static bool plane_distance(const struct Plane& INPUT_PLANE, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], float& distance)
 {
     const float RAY_DIRECTION_DOT_NORMAL = dot_product(RAY_DIRECTION, INPUT_PLANE.normal);
 
     //no intersection
     if (-ZERO_TOLERANCE < RAY_DIRECTION_DOT_NORMAL && RAY_DIRECTION_DOT_NORMAL < ZERO_TOLERANCE)
-        return nullptr;//lines are parallel thus no intersection
-    //intersection
-    else
+        return false;//lines are parallel thus no intersection
     {
         const float POSITION_MINUS_RAY_ORIGIN [ARRAY_SIZE] = {INPUT_PLANE.position[0] - RAY_ORIGIN[0], INPUT_PLANE.position[1] - RAY_ORIGIN[1], INPUT_PLANE.position[2] - RAY_ORIGIN[2]};
 
-        const float PLACEHOLDER = dot_product(POSITION_MINUS_RAY_ORIGIN, INPUT_PLANE.normal) / RAY_DIRECTION_DOT_NORMAL;
-        //positive value
-        if (PLACEHOLDER > 0.0f)
-        {
-            float * to_return = new float;
-            *to_return = PLACEHOLDER;
-            return to_return;
-        }
-        //not positive
-        else
-            return nullptr;
+        distance = dot_product(POSITION_MINUS_RAY_ORIGIN, INPUT_PLANE.normal) / RAY_DIRECTION_DOT_NORMAL;
+        return distance > 0.0f;
     }
 }
 
 /*
- * Used to determine if a ray intersects with a sphere. Calculates Sphere intersection through quadratic equation. Returns dynamically allocated float array. Value of 1st index determines case/number of intersections.
- *
- * case [0] == 2 is as follows:
- * Returned float array is size 3. Means 2 intersections. Thus means that the both indices 1 and 2 contain useful information.
- *
- * case [0] == 1 is as follows:
- * Returned float array is size 2. Means one intersection so that sole intersection is stored in index 1
- *
- * case [0] == 0 is as follows:
- * Returned float array is size 1. 0 means no intersections with sphere.
+ * Calculates intersection of a plane with a ray. Returns nullptr in event of no intersection. Returns dynamically allocated float which represents a scaler to point of intersection.
+ * Also returns nullptr in event that intersection us not positive for implementation reasons. Such as nullptr being used as a special value.
  *
- * INPUT_SPHERE: is sphere being tested for an intersection
+ * INPUT_PLANE: is plane being tested for an intersection
  * RAY_ORIGIN: array of size 3 represent point origin of the ray
  * RAY_DIRECTION: array size 3 representing a mathematical vector of the ray's direction
- *
- * Note: RAY_DIRECTION is assumed to be should be normalized, thus QUADRATIC_A would be equal to 1.
  */
-static float * sphere_intersection(const struct Sphere& INPUT_SPHERE, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE])
+static float * plane_intersection(const struct Plane& INPUT_PLANE, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE])
 {
-    //float[] before floats because floats are calculated from float[].
-    const float QUARATIC_ORIGIN_MINUS_CENTER [ARRAY_SIZE] = {RAY_ORIGIN[0] - INPUT_SPHERE.position[0], RAY_ORIGIN[1] - INPUT_SPHERE.position[1], RAY_ORIGIN[2] - INPUT_SPHERE.position[2]};//Store repeated subtractions between RAY_ORIGIN and INPUT_SPHERE's center. Float to avoid future repeated conversions to float.
-    const float QUADRATIC_B = (RAY_DIRECTION[0] * QUARATIC_ORIGIN_MINUS_CENTER[0] + RAY_DIRECTION[1] * QUARATIC_ORIGIN_MINUS_CENTER[1] +
-                               RAY_DIRECTION[2] * QUARATIC_ORIGIN_MINUS_CENTER[2]) * 2.0f;
-    const float DETERMINANT = pow(QUADRATIC_B, 2.0f) - (pow(QUARATIC_ORIGIN_MINUS_CENTER[0], 2.0f) + pow(QUARATIC_ORIGIN_MINUS_CENTER[1], 2.0f) +
-                              pow(QUARATIC_ORIGIN_MINUS_CENTER[2], 2.0f) - pow(INPUT_SPHERE.radius, 2.0f)) * 4.0f;
+    float distance;
 
+    if (!plane_distance(INPUT_PLANE, RAY_ORIGIN, RAY_DIRECTION, distance))
+        return nullptr;
     {
-        float * to_return;
-        //no intersectionz
-        if (DETERMINANT < 0.0f)//DETERMINANT is negative
-        {
-            to_return = new float[1];
-            to_return[0] = 0.0f;
-        }
-        //2 intersections
-        else if (DETERMINANT > 0.0f)//DETERMINANT is positive
-        {
-            const float PLACEHOLDER = sqrt(DETERMINANT);
-            to_return = new float[3];
-            to_return[0] = 2.0f;
-            to_return[1] = (-QUADRATIC_B - PLACEHOLDER) / 2.0f;
-            to_return[2] = (-QUADRATIC_B + PLACEHOLDER) / 2.0f;
-        }
-        //1 intersection
-        else //DETERMINANT == 0
-        {
-            to_return = new float[2];
-            to_return[0] = 1.0f;
-            to_return[1] = -QUADRATIC_B / 2.0f;
-        }
-
+        float * to_return = new float;
+        *to_return = distance;
         return to_return;
     }
 }
 
 /*
- * Used to determine if a ray intersects with a triangle, meant to be used with Mesh.
+ * Solves the quadratic of a ray and a sphere without allocating. Returns the number of intersections, 0, 1 or 2, whose scalars are stored in ascending order.
  *
- * VERTEX_1, VERTEX_2, VERTEX_3: are 3 vertices that define a triangle
+ * CENTRE: centre of the sphere
+ * RADIUS: radius of the sphere
  * RAY_ORIGIN: array of size 3 represent point origin of the ray
- * RAY_DIRECTION: array size 3 representing a mathematical vector of the ray's direction
- * Note: RAY_DIRECTION is assumed to be should be normalized
+ * RAY_DIRECTION: normalized direction of the ray, thus QUADRATIC_A would be equal to 1
+ * roots: where the scalars of the intersections are stored
  */
-static float * triangle_intersection(const std::array<float, ARRAY_SIZE>& VERTEX_1, const std::array<float, ARRAY_SIZE>& VERTEX_2, const std::array<float, ARRAY_SIZE>& VERTEX_3,
-                                     const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE])
+static unsigned int sphere_roots(const float CENTRE [ARRAY_SIZE], const float RADIUS, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], float roots [2])
 {
-    float triangle_normal [ARRAY_SIZE];
-    {
-        float first_vector_2_minus_1 [ARRAY_SIZE], second_vector_3_minus_1 [ARRAY_SIZE];
-        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
-        {
-            first_vector_2_minus_1[i] = VERTEX_2[i] - VERTEX_1[i];
-            second_vector_3_minus_1[i] = VERTEX_3[i] - VERTEX_1[i];
-        }
-        cross_product(first_vector_2_minus_1, second_vector_3_minus_1, triangle_normal);
-    }
+    //float[] before floats because floats are calculated from float[].
+    const float QUARATIC_ORIGIN_MINUS_CENTER [ARRAY_SIZE] = {RAY_ORIGIN[0] - CENTRE[0], RAY_ORIGIN[1] - CENTRE[1], RAY_ORIGIN[2] - CENTRE[2]};//Store repeated subtractions between RAY_ORIGIN and the centre.
+    const float QUADRATIC_B = (RAY_DIRECTION[0] * QUARATIC_ORIGIN_MINUS_CENTER[0] + RAY_DIRECTION[1] * QUARATIC_ORIGIN_MINUS_CENTER[1] +
+                               RAY_DIRECTION[2] * QUARATIC_ORIGIN_MINUS_CENTER[2]) * 2.0f;
+    const float DETERMINANT = pow(QUADRATIC_B, 2.0f) - (pow(QUARATIC_ORIGIN_MINUS_CENTER[0], 2.0f) + pow(QUARATIC_ORIGIN_MINUS_CENTER[1], 2.0f) +
+                              pow(QUARATIC_ORIGIN_MINUS_CENTER[2], 2.0f) - pow(RADIUS, 2.0f)) * 4.0f;
 
+    //no intersection
+    if (DETERMINANT < 0.0f)
+        return 0;
+    //2 intersections
+    if (DETERMINANT > 0.0f)
     {
-        float * to_return;
-        {
-            const float NORMAL_DOT_DIRECTION = dot_product(triangle_normal, RAY_DIRECTION);
-
-            if (-ZERO_TOLERANCE < NORMAL_DOT_DIRECTION && NORMAL_DOT_DIRECTION < ZERO_TOLERANCE)
-                return nullptr;//lines are parallel thus no intersection;
-            {
-                const float PLACEHOLDER = (dot_product(triangle_normal, RAY_ORIGIN) + dot_product(triangle_normal, VERTEX_1)) / NORMAL_DOT_DIRECTION;
-
-                if (PLACEHOLDER < 0.0f)//not negative value check
-                    return nullptr;
-
-                to_return = new float;
-                *to_return = PLACEHOLDER;
-            }
-
-        }
-        {
-            unsigned int i;
-            float placeholder [ARRAY_SIZE], cross_product_result [ARRAY_SIZE], cross_first_vector [ARRAY_SIZE], cross_second_vector [ARRAY_SIZE];//reused for each edge test
-            for (i = 0; i < ARRAY_SIZE; ++i)
-                placeholder[i] = RAY_ORIGIN[i] + *to_return * RAY_DIRECTION[i];
-
-            //test edges, one at a time to fail fast
-            for (i = 0; i < ARRAY_SIZE; ++i)
-            {
-                cross_first_vector[i] = VERTEX_2[i] - VERTEX_1[i];
-                cross_second_vector[i] = placeholder[i] - VERTEX_1[i];
-            }
-            cross_product(cross_first_vector, cross_second_vector, cross_product_result);
-            if (dot_product(triangle_normal, cross_product_result) < 0.0f)
-            {
-                delete to_return;
-                return nullptr;
-            }
-
-            for (i = 0; i < ARRAY_SIZE; ++i)
-            {
-                cross_first_vector[i] = VERTEX_3[i] - VERTEX_2[i];
-                cross_second_vector[i] = placeholder[i] - VERTEX_2[i];
-            }
-            cross_product(cross_first_vector, cross_second_vector, cross_product_result);
-            if (dot_product(triangle_normal, cross_product_result) < 0.0f)
-            {
-                delete to_return;
-                return nullptr;
-            }
-
-            for (i = 0; i < ARRAY_SIZE; ++i)
-            {
-                cross_first_vector[i] = VERTEX_1[i] - VERTEX_2[i];
-                cross_second_vector[i] = placeholder[i] - VERTEX_3[i];
-            }
-            cross_product(cross_first_vector, cross_second_vector, cross_product_result);
-            if (dot_product(triangle_normal, cross_product_result) < 0.0f)
-            {
-                delete to_return;
-                return nullptr;
-            }
-        }
-        return to_return;
+        const float PLACEHOLDER = sqrt(DETERMINANT);
+        roots[0] = (-QUADRATIC_B - PLACEHOLDER) / 2.0f;
+        roots[1] = (-QUADRATIC_B + PLACEHOLDER) / 2.0f;
+        return 2;
     }
+    //1 intersection
+    roots[0] = -QUADRATIC_B / 2.0f;
+    return 1;
 }
 
 /**
@@ -333,6 +376,23 @@ static void file_read_float_array_3(std::fstream& input_file, float float_contai
     #endif
 }
 
+/*
+ * Tests whether the next line of a file starts with NAME, leaving the file where it was, for optional lines.
+ *
+ * input_file: file being read from
+ * NAME: first part of the line, such as "ref:"
+ */
+static bool file_next_line_is(std::fstream& input_file, const char * NAME)
+{
+    const std::streampos START = input_file.tellg();
+    std::string placeholder;
+    const bool MATCHES = std::getline(input_file, placeholder, ' ') && placeholder == NAME;
+
+    input_file.clear();//reaching the end of the file is not an error here
+    input_file.seekg(START);
+    return MATCHES;
+}
+
 /**
   * method to setup object_light_subproperties part.
  *
@@ -356,6 +416,15 @@ static void file_read_setup_object_light_properties(std::fstream& input_file, st
     file_read_float_array_3(input_file, input_struct.ambient_colour);//ambient colour
     file_read_setup_object_light_subproperties(input_file, input_struct);//setup object_light_subproperties
     input_struct.shininess = file_read_float(input_file);//shininess
+    for (;;)//optional properties, in any order
+        if (file_next_line_is(input_file, "ref:"))
+            file_read_float_array_3(input_file, input_struct.reflectivity);//reflectivity
+        else if (file_next_line_is(input_file, "tra:"))
+            file_read_float_array_3(input_file, input_struct.transmission);//transmission
+        else if (file_next_line_is(input_file, "ior:"))
+            input_struct.refractive_index = file_read_float(input_file);//refractive index
+        else
+            break;
 }
 
 /*
@@ -365,19 +434,6 @@ static void file_read_setup_object_light_properties(std::fstream& input_file, st
  * RAY_ORIGIN: is the source of the ray
  * RAY_TARGET: well it is meant to be the target of the ray, it can be any point along the the desired line
  */
-static void create_normailized_ray_direction(const float RAY_ORIGIN [ARRAY_SIZE], const int RAY_TARGET [ARRAY_SIZE], float ray_direction [ARRAY_SIZE])
-{
-    unsigned int i;
-    //intialize ray_direction
-    for (i = 0; i < ARRAY_SIZE; ++i)
-        ray_direction[i] = static_cast<float>(RAY_TARGET[i] - RAY_ORIGIN[i]);
-    //normalize ray_direction
-    {
-        const float UNNORMALIZED_RAY_DIRECTION_LENGTH = sqrt(pow(ray_direction[0], 2.0f) + pow(ray_direction[1], 2.0f) + pow(ray_direction[2], 2.0f));//calculate vector length
-        for (i = 0; i < ARRAY_SIZE; ++i)
-            ray_direction[i] /= UNNORMALIZED_RAY_DIRECTION_LENGTH;
-    }
-}
 static void create_normailized_ray_direction(const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_TARGET [ARRAY_SIZE], float ray_direction [ARRAY_SIZE])
 {
     unsigned int i;
@@ -406,415 +462,3622 @@ static void cross_product(const float VECTOR_1 [ARRAY_SIZE], const float VECTOR_
 }
 
 
-int main(int name_of_arguments, char * argument_container [])
+/*
+ * Calculates the box around a sphere.
+ *
+ * INPUT_SPHERE: sphere being boxed
+ */
+static struct Bounding_Box sphere_bounding_box(const struct Sphere& INPUT_SPHERE)
 {
-    const std::string FILE_NAME = name_of_arguments > 1 ? argument_container[1] : /*"mesh_scene1"*/"scene1";
-    std::vector<struct Sphere> sphere_container;
-    std::vector<struct Light> light_container;
-
-    //file reading, if the order of the scene object's attributes was unknown, then could use the discarded part to figure out which attribute.
+    struct Bounding_Box to_return;
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
     {
-        const std::string INPUT_FILE_PATH =
-            #ifdef ABSOLUTE_PATH
-                std::string(ABSOLUTE_PATH) +
-            #endif
-            "Input/" + FILE_NAME + ".txt";
-        std::fstream target_file = std::fstream(INPUT_FILE_PATH , std::fstream::in);
+        to_return.minimum[i] = INPUT_SPHERE.position[i] - INPUT_SPHERE.radius;
+        to_return.maximum[i] = INPUT_SPHERE.position[i] + INPUT_SPHERE.radius;
+    }
+    return to_return;
+}
 
-        if (target_file.is_open())
+/*
+ * Calculates the box around a triangle of mesh_instance.
+ *
+ * TRIANGLE: index of the triangle, its vertices are mesh_instance.vertices[3 * TRIANGLE, 3 * TRIANGLE + 2]
+ */
+static struct Bounding_Box triangle_bounding_box(const unsigned int TRIANGLE)
+{
+    struct Bounding_Box to_return;
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        for (unsigned int j = TRIANGLE * 3; j < TRIANGLE * 3 + 3; ++j)
         {
-            const int OBJECT_COUNT = target_file.get() - '0';
-            std::string placeholder;
-            target_file.get();
-            #ifdef DEBUG_1
-                cerr << OBJECT_COUNT << endl;
-            #endif
-            for (int i = 0; i < OBJECT_COUNT; ++i)
-            {
-                std::getline(target_file, placeholder);
-                #ifdef DEBUG_1
-                    cerr << placeholder << endl;
-                #endif
-                if (placeholder == "camera")
-                {
-                    file_read_float_array_3(target_file, camera_instance.position);//position
-                    camera_instance.field_of_view = file_read_int(target_file);//field-of-view
-                    camera_instance.focal_length = file_read_int(target_file);//focal length
-                    camera_instance.aspect_ratio = file_read_float(target_file);//aspect ratio
-                }
-                else if (placeholder == "plane")
-                {
-                    plane_instance.active = true;//note that there is a plane in scene
-                    file_read_float_array_3(target_file, plane_instance.normal);//normal
-                    file_read_float_array_3(target_file, plane_instance.position);//position
-                    file_read_setup_object_light_properties(target_file, plane_instance);//setup object_light_properties part
-                }
-                else if (placeholder == "sphere")
-                {
-                    sphere_container.push_back(Sphere());
-                    file_read_float_array_3(target_file, sphere_container.back().position);//position
-                    sphere_container.back().radius = file_read_float(target_file);//radius
-                    file_read_setup_object_light_properties(target_file, sphere_container.back());//setup object_light_properties part
-                }
-                else if (placeholder == "mesh")
-                {
-                    mesh_instance.active = true;//note that there is a mesh in plane
-                    std::getline(target_file, placeholder, ' ');//discard first part
-                    #ifdef DEBUG_1
-                        cerr << placeholder << endl;
-                    #endif
-                    {
-                        std::string filename_plane_holder;
-                        std::getline(target_file, filename_plane_holder);//filename
-                        #ifdef DEBUG_1
-                            cerr << filename_plane_holder << endl;
-                        #endif
-                        filename_plane_holder =
-                        #ifdef ABSOLUTE_PATH
-                            std::string(ABSOLUTE_PATH) +
-                        #endif
-                        "Input/" + filename_plane_holder;
-                        mesh_instance.filename = new char[filename_plane_holder.length() + 1];
-                        strcpy(mesh_instance.filename, filename_plane_holder.c_str());
-                    }
-                    file_read_setup_object_light_properties(target_file, mesh_instance);//setup object_light_properties part
-                    loadOBJ(mesh_instance.filename, mesh_instance.vertices);
-                }
-                else if (placeholder == "light")
-                {
-                    light_container.push_back(Light());
-                    file_read_float_array_3(target_file, light_container.back().position);//position
-                    file_read_setup_object_light_subproperties(target_file, light_container.back());//setup object_light_subproperties part
-                }
-                else
-                {
-                    cerr << "This message should never appear. Read value is \"" << placeholder << "\"" << endl;
-                }
-            }
-            sphere_container.shrink_to_fit();
-            light_container.shrink_to_fit();
+            to_return.minimum[i] = std::min(to_return.minimum[i], mesh_instance.vertices[j][i]);
+            to_return.maximum[i] = std::max(to_return.maximum[i], mesh_instance.vertices[j][i]);
         }
-        else
-            cerr << "Error: unable to open \"" << INPUT_FILE_PATH << "\"" << endl;
-    }
+    return to_return;
+}
+
+/*
+ * Brings a BVH up to date with primitives that moved. Refits it, unless REFIT is false or the refit tree's cost grew past render_settings.refit_threshold times its
+ * built cost, in which case it is rebuilt with render_settings.bvh_builder on render_settings.thread_count threads. Prints which happened, how long it took and the
+ * tree's surface area heuristic cost, to weigh build time against trace time with.
+ *
+ * tree: tree being updated
+ * PRIMITIVE_BOUNDS: current box of every primitive
+ * NAME: what the tree is over, for the printout
+ * REFIT: false to always build from scratch, such as for the first build
+ * LEAF_SIZE: see build_bvh(...)
+ */
+static void update_bvh(struct BVH& tree, const std::vector<struct Bounding_Box>& PRIMITIVE_BOUNDS, const char * NAME, const bool REFIT, const unsigned int LEAF_SIZE)
+{
+    const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
 
+    if (REFIT && render_settings.refit_threshold > 0.0f && tree.primitive_indices.size() == PRIMITIVE_BOUNDS.size())
     {
-        cimg_library::CImg<float> output_image;
-        //ray trace
+        float cost;
+
+        refit_bvh(tree, PRIMITIVE_BOUNDS);
+        cost = bvh_cost(tree);
+        if (cost <= tree.built_cost * render_settings.refit_threshold)
         {
-            unsigned int corresponding_index;
-            const float TAN_CALCULATION = tan(camera_instance.field_of_view / 2.0f * 3.14159265f / 180.0f);//3.14159265f / 180.0f to convert from degrees to radians, is used to define subsequent values
-            const unsigned int IMAGE_VERTICAL = static_cast<unsigned int>(TAN_CALCULATION * camera_instance.focal_length * 2),
-                               HALF_IMAGE_VERTICLE = IMAGE_VERTICAL >> 1, IMAGE_HORIZONTAL = static_cast<unsigned int>(camera_instance.aspect_ratio * IMAGE_VERTICAL),
-                               HALF_IMAGE_HORIZONTAL = IMAGE_HORIZONTAL >> 1;
-            int current_ray_target [ARRAY_SIZE];//variable is reused
-            float smallest_distance_scalar;//Values to avoid constantly assigning placeholder.first a new value, figure the assignment will be faster this way.
-            float * intersections_placeholder;
-            float orginal_ray_direction [ARRAY_SIZE], intersection_point_normal [ARRAY_SIZE], intersection_point [ARRAY_SIZE] /*new origin, for new rays starting from previous ray's chosen intersection going to light sources*/;
-            const float ADJUSTED_CAMERA_POSITION [ARRAY_SIZE] = {camera_instance.position[0], camera_instance.position[1], static_cast<float>(camera_instance.position[2] + camera_instance.focal_length)};
-            std::pair<const struct Object_Light_Properties *, float> placeholder;//{intersected object, intersection distance from camera in terms of scalar}
-            output_image = cimg_library::CImg<float>(IMAGE_HORIZONTAL, IMAGE_VERTICAL, 1, 3, 0);//{R, G, B}
-            current_ray_target[2] = -1;
+            std::cout << NAME << " BVH refit in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - START).count() << "ms, cost " << cost
+                      << " (" << (tree.built_cost > 0.0f ? cost / tree.built_cost : 1.0f) << "x built)." << endl;
+            return;
+        }
+        std::cout << NAME << " BVH cost " << cost << " passed " << render_settings.refit_threshold << "x built cost " << tree.built_cost << ", rebuilding." << endl;
+    }
+    {
+        const char * BUILDER_NAMES [3] = {"median splits", "binned SAH", "Morton codes"};//in the order of BVH_Builder
+        const unsigned int THREAD_COUNT = render_settings.thread_count > 0 ? render_settings.thread_count : 1;
 
-            //TODO: consider mulithreading the the for loop interactions
-            for (unsigned int x = 0; x < IMAGE_HORIZONTAL; ++x)
-            {
-                current_ray_target[0] = static_cast<int>(x - HALF_IMAGE_HORIZONTAL);//subtraction is offset
-                for(unsigned int y = 0; y < IMAGE_VERTICAL; ++y)
-                {
-                    //reset placeholder values
-                    placeholder.first = nullptr;
-                    placeholder.second = FLT_MAX;//Slight problem if the closest intersection point is at FLT_MAX as scalar, though is improbable.
-                    current_ray_target[1] = static_cast<int>(HALF_IMAGE_VERTICLE - y);//subtraction is offset
-                    create_normailized_ray_direction(ADJUSTED_CAMERA_POSITION, current_ray_target, orginal_ray_direction);
-
-                    //original ray intersections
-                    if (plane_instance.active)//a plan exists
-                    {
-                        intersections_placeholder = plane_intersection(plane_instance, camera_instance.position, orginal_ray_direction);
+        build_bvh(tree, PRIMITIVE_BOUNDS, render_settings.bvh_builder, THREAD_COUNT, LEAF_SIZE);
+        if (!PRIMITIVE_BOUNDS.empty())
+            std::cout << NAME << " BVH built with " << BUILDER_NAMES[render_settings.bvh_builder] << " on " << THREAD_COUNT << (THREAD_COUNT > 1 ? " threads in " : " thread in ")
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - START).count() << "ms, " << tree.nodes.size() << " nodes, cost "
+                      << tree.built_cost << "." << endl;
+    }
+}
 
-                        if (intersections_placeholder != nullptr)
-                        {
-                            #ifdef DEBUG_3_HIT
-                                cerr << "There is an intersection with plane_instance, intersections_placeholder value " << *intersections_placeholder << endl;
-                            #endif
-                            if (*intersections_placeholder < placeholder.second)
-                            {
-                                #ifdef DEBUG_3_HIT
-                                    cerr << "New closer point found with plane_instance." << endl;
-                                #endif
-                                placeholder.first = &plane_instance;
-                                placeholder.second = *intersections_placeholder;
-                                for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
-                                {
-                                    intersection_point[i] = placeholder.second * orginal_ray_direction[i] + camera_instance.position[i];
-                                    intersection_point_normal[i] = plane_instance.normal[i];
-                                }
-                            }
-
-                            delete intersections_placeholder;
-                        }
-                        #ifdef DEBUG_3_MISS
-                            else
-                                cerr << "There is no intersection with plane_instance, with intersections_placeholder value " << *intersections_placeholder << endl;
-                        #endif
-                    }
-                    if (!sphere_container.empty())//spheres exist
-                    {
-                        smallest_distance_scalar = FLT_MAX;
+/*
+ * Collapses a BVH into the wide tree of render_settings.bvh_width, or compresses it with render_settings.compressed_bvh, emptying the others, all of them with a
+ * width of 2. Prints how long it took and the memory of the tree used per primitive, next to that of the binary tree, counting TREE.primitive_indices for both.
+ *
+ * TREE: tree collapsed, already up to date
+ * tree_4, tree_8, compressed_tree: its wide trees
+ * NAME: see update_bvh(...)
+ */
+static void update_wide_bvh(const struct BVH& TREE, struct Wide_BVH<4>& tree_4, struct Wide_BVH<8>& tree_8, struct Compressed_BVH& compressed_tree, const char * NAME)
+{
+    const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+    const double PRIMITIVE_COUNT = static_cast<double>(TREE.primitive_indices.size());
+    const double INDEX_BYTES = PRIMITIVE_COUNT * sizeof(unsigned int);
+    size_t node_count, node_bytes;
 
-                        for (unsigned int index = 0; index < sphere_container.size(); ++index)
-                        {
-                            intersections_placeholder = sphere_intersection(sphere_container[index], camera_instance.position, orginal_ray_direction);
-
-                            #ifdef DEBUG_3_HIT //&& intersections_placeholder[0] > 0
-                                if (intersections_placeholder[0] > 0)
-                                    cerr << "There are " << intersections_placeholder[0] << " intersections with sphere_container[" << index << "]." << endl;
-                            #endif
-                            #ifdef DEBUG_3_MISS //&& intersections_placeholder[0] < 1
-                                if (intersections_placeholder[0] < 1)
-                                    cerr << "No intersection with sphere_container[" << index << "], value of intersections_placeholder[0] is " << intersections_placeholder[0] << endl;
-                            #endif
-                            for (int i = 1; i < intersections_placeholder[0] + 1; ++i)//+ 1 is an offset for the indices
-                            {
-                                #ifdef DEBUG_3_HIT
-                                    cerr << "value of intersections_placeholder[" << i << "] is " << intersections_placeholder[i] << endl;
-                                #endif
-                                if (-1.0f < intersections_placeholder[i] && intersections_placeholder[i] < smallest_distance_scalar)
-                                {
-                                    smallest_distance_scalar = intersections_placeholder[i];
-                                    corresponding_index = index;
-                                }
-                            }
-
-                            delete[] intersections_placeholder;//clear memory
-                        }
+    tree_4 = Wide_BVH<4>();
+    tree_8 = Wide_BVH<8>();
+    compressed_tree = Compressed_BVH();
+    if (TREE.nodes.empty() || (render_settings.bvh_width == 2 && !render_settings.compressed_bvh))
+        return;
+    if (render_settings.compressed_bvh)
+    {
+        collapse_bvh(tree_4, TREE);
+        if (compress_bvh(compressed_tree, tree_4))
+            tree_4 = Wide_BVH<4>();
+        else
+            cerr << "Warning: " << NAME << " BVH has leaves of more than " << COMPRESSED_BVH_LEAF_LIMIT << " primitives or too many primitives to compress, keeping 4 wide nodes" << endl;
+    }
+    else if (render_settings.bvh_width == 4)
+        collapse_bvh(tree_4, TREE);
+    else
+        collapse_bvh(tree_8, TREE);
+    node_count = compressed_tree.nodes.size() + tree_4.nodes.size() + tree_8.nodes.size();
+    node_bytes = compressed_tree.nodes.size() * sizeof(struct Compressed_BVH_Node) + tree_4.nodes.size() * sizeof(struct Wide_BVH_Node<4>)
+                 + tree_8.nodes.size() * sizeof(struct Wide_BVH_Node<8>);
+    std::cout << NAME << " BVH " << (compressed_tree.nodes.empty() ? "collapsed to " : "compressed to ") << node_count << " nodes of " << node_bytes / node_count
+              << " bytes in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - START).count() << "ms, "
+              << (node_bytes + INDEX_BYTES) / PRIMITIVE_COUNT << " bytes per primitive (binary tree " << (TREE.nodes.size() * sizeof(struct BVH_Node) + INDEX_BYTES) / PRIMITIVE_COUNT
+              << ")." << endl;
+}
 
-                        if (-1.0f < smallest_distance_scalar && smallest_distance_scalar < placeholder.second)
-                        {
-                            #ifdef DEBUG_3_HIT
-                                cerr << "New closer point found with Sphere." << endl;
-                            #endif
-                            placeholder.first = &sphere_container[corresponding_index];
-                            placeholder.second = smallest_distance_scalar;
-                            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
-                                intersection_point_normal[i] = ((intersection_point[i] = placeholder.second * orginal_ray_direction[i] + camera_instance.position[i])
-                                                                - sphere_container[corresponding_index].position[i]) / sphere_container[corresponding_index].radius;
-                        }
-                    }
-                    if (mesh_instance.active)//mesh exists
-                    {
-                        smallest_distance_scalar = FLT_MAX;
+/*
+ * Visits the leaves of a BVH a ray passes through, in whichever of its wide trees is filled in, or in the binary tree if none is, see traverse_bvh_leaves(...)
+ * and traverse_wide_nodes(...).
+ *
+ * TREE: tree traversed, its leaves are ranges of TREE.primitive_indices whichever tree is used
+ * TREE_4, TREE_8, COMPRESSED_TREE: its wide trees, see update_wide_bvh(...)
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance: see traverse_bvh_leaves(...)
+ * ROOT: node of the tree used to start from, 0 for the whole tree, see leaves_entry_node(...)
+ * intersect_leaf: see traverse_bvh_leaves(...)
+ */
+template <typename Leaf_Function>
+static void traverse_leaves(const struct BVH& TREE, const struct Wide_BVH<4>& TREE_4, const struct Wide_BVH<8>& TREE_8, const struct Compressed_BVH& COMPRESSED_TREE,
+                            const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                            const unsigned int ROOT, Leaf_Function intersect_leaf)
+{
+    if (!COMPRESSED_TREE.nodes.empty())
+        traverse_compressed_bvh(COMPRESSED_TREE, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+    else if (!TREE_8.nodes.empty())
+        traverse_wide_bvh(TREE_8, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+    else if (!TREE_4.nodes.empty())
+        traverse_wide_bvh(TREE_4, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+    else
+        traverse_bvh_leaves(TREE, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+}
 
-                        for (unsigned int index = 0; index < mesh_instance.vertices.size(); index += 3)//3 vertices make a triangle
-                        {
-                            intersections_placeholder = triangle_intersection(mesh_instance.vertices[index], mesh_instance.vertices[index + 1], mesh_instance.vertices[index + 2],
-                                                                              camera_instance.position, orginal_ray_direction);
-                            if (intersections_placeholder != nullptr)
-                            {
-                                #ifdef DEBUG_3_HIT
-                                    cerr << "Intersection with triangle formed by mesh_instance.vertices[" << index << ", " << index + 2 << "]" << endl;
-                                #endif
-                                if (*intersections_placeholder < smallest_distance_scalar)
-                                {
-                                    smallest_distance_scalar = *intersections_placeholder;
-                                    corresponding_index = index;
-                                }
-                            }
-                            #ifdef DEBUG_3_MISS
-                                else
-                                    cerr << "No Intersection with triangle formed by mesh_instance.vertices[" << index << ", " << index + 2 << "]" << endl;
-                            #endif
-
-                            delete intersections_placeholder;//clear memory
-                        }
+/*
+ * Node of whichever tree traverse_leaves(...) uses that rays only entering boxes box_wanted accepts can start from, see bvh_entry_node(...) and
+ * wide_bvh_entry_node(...). BVH_NO_NODE if no box is accepted.
+ *
+ * TREE, TREE_4, TREE_8, COMPRESSED_TREE: see traverse_leaves(...)
+ * box_wanted: see bvh_entry_node(...)
+ */
+template <typename Box_Function>
+static unsigned int leaves_entry_node(const struct BVH& TREE, const struct Wide_BVH<4>& TREE_4, const struct Wide_BVH<8>& TREE_8, const struct Compressed_BVH& COMPRESSED_TREE,
+                                      Box_Function box_wanted)
+{
+    if (!COMPRESSED_TREE.nodes.empty())
+        return wide_bvh_entry_node<4>(COMPRESSED_TREE.nodes, box_wanted);
+    if (!TREE_8.nodes.empty())
+        return wide_bvh_entry_node<8>(TREE_8.nodes, box_wanted);
+    if (!TREE_4.nodes.empty())
+        return wide_bvh_entry_node<4>(TREE_4.nodes, box_wanted);
+    return bvh_entry_node(TREE, box_wanted);
+}
 
-                        if (-1.0f < smallest_distance_scalar && smallest_distance_scalar < placeholder.second)
-                        {
-                            #ifdef DEBUG_3_HIT
-                                cerr << "New closer point found with Mesh triangle." << endl;
-                            #endif
-                            placeholder.first = &mesh_instance;
-                            placeholder.second = smallest_distance_scalar;
-                            //calculate normal
-                            {
-                                unsigned int i;
-                                float first_vector [ARRAY_SIZE], second_vector [ARRAY_SIZE];
-                                for (i = 0; i < ARRAY_SIZE; ++i)
-                                {
-                                    intersection_point[i] = placeholder.second * orginal_ray_direction[i] + camera_instance.position[i];
-                                    first_vector[i] = (mesh_instance.vertices[corresponding_index + 1])[i] - (mesh_instance.vertices[corresponding_index])[i];
-                                    second_vector[i] = (mesh_instance.vertices[corresponding_index + 2])[i] - (mesh_instance.vertices[corresponding_index])[i];
-                                }
-                                cross_product(first_vector, second_vector, intersection_point_normal);
-                                //normalize
-                                {
-                                    const float UNNORMALIZED_LENGTH = sqrt(pow(intersection_point_normal[0], 2.0f) + pow(intersection_point_normal[1], 2.0f) + pow(intersection_point_normal[2], 2.0f));//calculate vector length
-                                    for (i = 0; i < ARRAY_SIZE; ++i)
-                                        intersection_point_normal[i] /= UNNORMALIZED_LENGTH;
-                                }
-                            }
-                        }
-                    }
+//Sphere geometry with one array per field, so leaves of the sphere BVH are tested 4 spheres at a time, see sphere_leaf_roots(...).
+struct Sphere_Arrays
+{
+    std::vector<float> centres_x, centres_y, centres_z, radii;
+}sphere_leaves;//sphere_container in the order of sphere_bvh.primitive_indices, with 3 unused spheres after the last, empty while sphere_grid is in use
 
-                    //calculates illumination
-                    if (placeholder.first != nullptr)
-                    {
-                        unsigned int i;//outer for loop counter
-                        {
-                            bool intersection_continue;//True means intersection found, false means no intersection. Is used to skip a a given loop iteration without having to recheck for an intersection.
-                            unsigned int j;//inner for loop counter
-                            float scalar_to_light;//calculate scalar to current light, acts as an upper bound
-                            float * placeholder_2;//is reused for various intersections
-                            float light_ray_direction [ARRAY_SIZE];//note points towards light from ray origin
-
-                            for (i = 0; i < light_container.size(); ++i)
-                            {
-                                //initialize loop specific values
-                                create_normailized_ray_direction(intersection_point, light_container[i].position, light_ray_direction);//new direction for new light
-                                for (j = 0; j < ARRAY_SIZE; ++j)
-                                    if ((scalar_to_light = light_container[i].position[j] / light_ray_direction[j]) > ZERO_TOLERANCE)//To make sure a 0 value in a given direction does not screw over calculations.
-                                        break;//Exit when a positive value has been found as it is a scalar thus should be the same for all the others that are not 0.
-
-                                //light ray intersection test
-                                if (plane_instance.active)//a plan exists
-                                {
-                                    placeholder_2 = plane_intersection(plane_instance, intersection_point, light_ray_direction);
-
-                                    if (placeholder_2 != nullptr)//thus intersection exist
-                                    {
-                                        if (SHADOW_BIAS < *placeholder_2 && *placeholder_2 < scalar_to_light)
-                                        {
-                                            #ifdef DEBUG_4_BLOCKED
-                                                cerr << "plane_instance blocked light_container[" << i << "] for intersection at image point {x, y} {" << x << ", " << y << "}." << endl;
-                                            #endif
-                                            delete placeholder_2;
-                                            continue;
-                                        }
-                                        delete placeholder_2;
-                                    }
-                                }
-                                if (!sphere_container.empty())//spheres exist
-                                {
-                                    intersection_continue = false;
-
-                                    for (j = 0; j < sphere_container.size(); ++j)
-                                    {
-                                        placeholder_2 = sphere_intersection(sphere_container[j], intersection_point, light_ray_direction);//only care about if there is an intersection
-
-                                        if (placeholder_2[0] > 0.0f /*thus intersection exist*/ && ((SHADOW_BIAS < placeholder_2[1] && placeholder_2[1] < scalar_to_light) ||
-                                           (placeholder_2[0] == 2.0f /*thus 2nd intersection exits*/ && SHADOW_BIAS < placeholder_2[2] && placeholder_2[2] < scalar_to_light)))//lower bound is greater than 0 to not block itself
-                                        {
-                                            #ifdef DEBUG_4_BLOCKED
-                                                cerr << "sphere_container[" << j << "] blocked light_container[" << i << "] for intersection at image point {x, y} {" << x << ", " << y << "}." << endl;
-                                            #endif
-                                            intersection_continue = true;
-                                            delete[] placeholder_2;
-                                            break;
-                                        }
-                                        delete[] placeholder_2;
-                                    }
-                                    if (intersection_continue)
-                                        continue;
-                                }
-                                if (mesh_instance.active)//mesh exists
-                                {
-                                    intersection_continue = false;
-
-                                    for (j = 0; j < mesh_instance.vertices.size(); j += 3)//3 vertices make a triangle
-                                    {
-                                        placeholder_2 = triangle_intersection(mesh_instance.vertices[j], mesh_instance.vertices[j + 1], mesh_instance.vertices[j + 2],
-                                                                              intersection_point, light_ray_direction);//only care about if there is an intersection
-                                        if (placeholder_2 != nullptr)
-                                        {
-                                            if (SHADOW_BIAS < *placeholder_2 && *placeholder_2 < scalar_to_light)//lower bound is greater than 0 to not block itself
-                                            {
-                                                #ifdef DEBUG_4_BLOCKED
-                                                    cerr << "mesh_instance.vertices[" << j << ", " << j + 2 << "] blocked light_container[" << i
-                                                         << "] for intersection at image point {x, y} {" << x << ", " << y << "}." << endl;
-                                                #endif
-                                                intersection_continue = true;
-                                                delete placeholder_2;
-                                                break;
-                                            }
-                                            delete placeholder_2;
-                                        }
-                                    }
-                                    if (intersection_continue)
-                                        continue;
-                                }
-
-                                //illumination, has to not be skipped (continue) to be run
-                                {
-                                    #ifdef DEBUG_4_NOT_BLOCKED
-                                        cerr << "Intersection at {x, y} {" << x << ", " << y << "} is illuminated by light_container[" << i << "]." << endl;
-                                    #endif
-
-                                    float diffuse_specular_dot_product [2] = {dot_product(light_ray_direction, intersection_point_normal), 0.0f};//for clamping, also to not repeat calculations
-
-                                    //clamp
-                                    if (diffuse_specular_dot_product[0] < 0.0f)
-                                        diffuse_specular_dot_product[0] = 0.0f;
-                                    {
-                                        const float DOUBLE_DIFFUSE_DOT_PRODUCT = 2.0f * diffuse_specular_dot_product[0];
-                                        for (j = 0; j < ARRAY_SIZE; ++j)
-                                            diffuse_specular_dot_product[1] += (DOUBLE_DIFFUSE_DOT_PRODUCT * intersection_point_normal[j] - light_ray_direction[j]) * -orginal_ray_direction[j];//minus on orginal_ray_direction is to negate/reverse direction
-                                    }
-                                    //clamp
-                                    if (diffuse_specular_dot_product[1] < 0.0f)
-                                        diffuse_specular_dot_product[1] = 0.0f;
-                                    //diffuse + specular
-                                    for (j = 0; j < ARRAY_SIZE; ++j)
-                                        output_image(x, y, j) += placeholder.first -> diffuse_colour[j] * diffuse_specular_dot_product[0] * light_container[i].diffuse_colour[j] +
-                                        pow(diffuse_specular_dot_product[1], placeholder.first -> shininess) * placeholder.first -> specular_colour[j] * light_container[i].specular_colour[j];
-                                }
-                            }
-                        }
+/*
+ * Copies the geometry of sphere_container into arrays, in the order of sphere_bvh.primitive_indices, so every leaf is a contiguous range of them.
+ *
+ * arrays: arrays filled
+ */
+static void fill_sphere_arrays(struct Sphere_Arrays& arrays)
+{
+    const size_t COUNT = sphere_bvh.primitive_indices.size();
 
-                        for (i = 0; i < ARRAY_SIZE; ++i)
-                        {
-                            output_image(x, y, i) += placeholder.first -> ambient_colour[i];//add global ambient colour
-                            output_image(x, y, i) = output_image(x, y, i) >= 1.0f ? 255.0f : output_image(x, y, i) * 255.0f;//scale colours and clamp
-                            #ifdef DEBUG_4_NOT_BLOCKED
-                                cerr << "Intersection at {x, y, channel} {" << x << ", " << y << ", " << i << "}, value: " << output_image(x, y, i) << endl;
-                            #endif
-                        }
-                    }
-                    #ifdef DEBUG_3_MISS
-                        else //no intersection found for given pixel
-                            cerr << "No intersection for image point {x, y} {" << x << ", " << y << "}" << endl;
-                    #endif
+    arrays.centres_x.assign(COUNT + 3, 0.0f);//padding, so reading 4 spheres from the last ones stays in bounds
+    arrays.centres_y.assign(COUNT + 3, 0.0f);
+    arrays.centres_z.assign(COUNT + 3, 0.0f);
+    arrays.radii.assign(COUNT + 3, 0.0f);
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+        const struct Sphere& SPHERE = sphere_container[sphere_bvh.primitive_indices[i]];
+
+        arrays.centres_x[i] = SPHERE.position[0];
+        arrays.centres_y[i] = SPHERE.position[1];
+        arrays.centres_z[i] = SPHERE.position[2];
+        arrays.radii[i] = SPHERE.radius;
+    }
+}
+
+/*
+ * sphere_roots(...) for 4 pairs of a sphere and a ray at once, one per SSE lane. Every operation is the same as in sphere_roots(...) and in the same order, so the
+ * roots only differ in the last bit where the compiler fuses a multiply and add of the scalar version, which moves a few silhouette pixels at most.
+ *
+ * ORIGIN_MINUS_CENTRE: origin of each ray minus the centre of its sphere
+ * RADIUS: radius of each sphere
+ * DIRECTION: normalized direction of each ray
+ * roots: where the roots of lane i are stored, in roots[0][i] and roots[1][i]
+ * root_counts: where the number of roots of lane i is stored, in root_counts[i]
+ */
+static void sphere_lane_roots(const __m128 ORIGIN_MINUS_CENTRE [ARRAY_SIZE], const __m128 RADIUS, const __m128 DIRECTION [ARRAY_SIZE], float roots [2][4], unsigned int root_counts [4])
+{
+    const __m128 QUADRATIC_B = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(DIRECTION[0], ORIGIN_MINUS_CENTRE[0]), _mm_mul_ps(DIRECTION[1], ORIGIN_MINUS_CENTRE[1])),
+                                                     _mm_mul_ps(DIRECTION[2], ORIGIN_MINUS_CENTRE[2])), _mm_set1_ps(2.0f));
+    const __m128 DETERMINANT = _mm_sub_ps(_mm_mul_ps(QUADRATIC_B, QUADRATIC_B),
+                                          _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ORIGIN_MINUS_CENTRE[0], ORIGIN_MINUS_CENTRE[0]),
+                                                                                      _mm_mul_ps(ORIGIN_MINUS_CENTRE[1], ORIGIN_MINUS_CENTRE[1])),
+                                                                           _mm_mul_ps(ORIGIN_MINUS_CENTRE[2], ORIGIN_MINUS_CENTRE[2])), _mm_mul_ps(RADIUS, RADIUS)),
+                                                     _mm_set1_ps(4.0f)));
+    const __m128 NEGATIVE_B = _mm_xor_ps(QUADRATIC_B, _mm_set1_ps(-0.0f)), PLACEHOLDER = _mm_sqrt_ps(DETERMINANT);//NaN where there are no roots, never read
+    const int TWO_ROOTS = _mm_movemask_ps(_mm_cmpgt_ps(DETERMINANT, _mm_setzero_ps())), NO_ROOTS = _mm_movemask_ps(_mm_cmplt_ps(DETERMINANT, _mm_setzero_ps()));
+
+    //dividing by 2 and multiplying by 0.5 round the same, and with 1 root PLACEHOLDER is 0 so roots[0] is -QUADRATIC_B / 2 as well
+    _mm_storeu_ps(roots[0], _mm_mul_ps(_mm_sub_ps(NEGATIVE_B, PLACEHOLDER), _mm_set1_ps(0.5f)));
+    _mm_storeu_ps(roots[1], _mm_mul_ps(_mm_add_ps(NEGATIVE_B, PLACEHOLDER), _mm_set1_ps(0.5f)));
+    for (unsigned int i = 0; i < 4; ++i)
+        root_counts[i] = (TWO_ROOTS >> i & 1) != 0 ? 2 : (NO_ROOTS >> i & 1) != 0 ? 0 : 1;
+}
+
+/*
+ * Roots of one ray with 4 spheres of a Sphere_Arrays at once, see sphere_lane_roots(...).
+ *
+ * SPHERES: arrays the spheres are in, sphere_leaves or a region's list, see Region_Candidates
+ * FIRST: index in SPHERES of the first of the 4 spheres
+ * RAY_ORIGIN, RAY_DIRECTION: see sphere_roots(...)
+ * roots: where the roots of sphere FIRST + i are stored, in roots[0][i] and roots[1][i]
+ * root_counts: where the number of roots of sphere FIRST + i is stored, in root_counts[i]
+ */
+static void sphere_leaf_roots(const struct Sphere_Arrays& SPHERES, const unsigned int FIRST, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE],
+                              float roots [2][4], unsigned int root_counts [4])
+{
+    const __m128 ORIGIN_MINUS_CENTRE [ARRAY_SIZE] = {_mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[0]), _mm_loadu_ps(&SPHERES.centres_x[FIRST])),
+                                                     _mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[1]), _mm_loadu_ps(&SPHERES.centres_y[FIRST])),
+                                                     _mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[2]), _mm_loadu_ps(&SPHERES.centres_z[FIRST]))};
+    const __m128 DIRECTION [ARRAY_SIZE] = {_mm_set1_ps(RAY_DIRECTION[0]), _mm_set1_ps(RAY_DIRECTION[1]), _mm_set1_ps(RAY_DIRECTION[2])};
+
+    sphere_lane_roots(ORIGIN_MINUS_CENTRE, _mm_loadu_ps(&SPHERES.radii[FIRST]), DIRECTION, roots, root_counts);
+}
+
+/*
+ * Roots of one sphere with the rays of 4 consecutive samples of a visibility buffer at once, see sphere_lane_roots(...). Each ray's roots are the same as
+ * sphere_leaf_roots(...) gives it.
+ *
+ * CENTRE, RADIUS: the sphere
+ * RAY_ORIGIN: origin of every ray
+ * BUFFER: visibility buffer the samples are in
+ * FIRST: first of the 4 samples
+ * roots, root_counts: see sphere_lane_roots(...), lane i is sample FIRST + i
+ */
+static void sphere_sample_roots(const float CENTRE [ARRAY_SIZE], const float RADIUS, const float RAY_ORIGIN [ARRAY_SIZE], const struct Visibility_Buffer& BUFFER, const size_t FIRST,
+                                float roots [2][4], unsigned int root_counts [4])
+{
+    const __m128 ORIGIN_MINUS_CENTRE [ARRAY_SIZE] = {_mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[0]), _mm_set1_ps(CENTRE[0])), _mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[1]), _mm_set1_ps(CENTRE[1])),
+                                                     _mm_sub_ps(_mm_set1_ps(RAY_ORIGIN[2]), _mm_set1_ps(CENTRE[2]))};
+    const __m128 DIRECTION [ARRAY_SIZE] = {_mm_loadu_ps(&BUFFER.directions[0][FIRST]), _mm_loadu_ps(&BUFFER.directions[1][FIRST]), _mm_loadu_ps(&BUFFER.directions[2][FIRST])};
+
+    sphere_lane_roots(ORIGIN_MINUS_CENTRE, _mm_set1_ps(RADIUS), DIRECTION, roots, root_counts);
+}
+
+
+/*
+ * Brings sphere_bvh, or sphere_grid when render_settings.sphere_structure picks it, up to date with sphere_container, emptying the other one. Grids are rebuilt
+ * every time, which is about as cheap as a refit. Prints which was used and how long it took. With the BVH, also collapses it, see update_wide_bvh(...), and
+ * fills sphere_leaves.
+ *
+ * REFIT: see update_bvh(...)
+ */
+static void update_sphere_structure(const bool REFIT)
+{
+    std::vector<struct Bounding_Box> bounds(sphere_container.size());
+    for (unsigned int i = 0; i < sphere_container.size(); ++i)
+        bounds[i] = sphere_bounding_box(sphere_container[i]);
+    if (!bounds.empty() && (render_settings.sphere_structure == ACCELERATION_GRID || (render_settings.sphere_structure == ACCELERATION_AUTOMATIC && grid_suits(bounds))))
+    {
+        const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+
+        sphere_bvh = BVH();
+        sphere_bvh_4 = Wide_BVH<4>();
+        sphere_bvh_8 = Wide_BVH<8>();
+        sphere_bvh_compressed = Compressed_BVH();
+        sphere_leaves = Sphere_Arrays();
+        build_grid(sphere_grid, bounds);
+        std::cout << "Sphere grid built in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - START).count() << "ms, " << sphere_grid.resolution[0]
+                  << "x" << sphere_grid.resolution[1] << "x" << sphere_grid.resolution[2] << " cells, " << static_cast<double>(sphere_grid.primitive_indices.size()) / bounds.size()
+                  << " references per sphere." << endl;
+        return;
+    }
+    sphere_grid = Grid();
+    update_bvh(sphere_bvh, bounds, "Sphere", REFIT, BVH_LEAF_SIZE);
+    update_wide_bvh(sphere_bvh, sphere_bvh_4, sphere_bvh_8, sphere_bvh_compressed, "Sphere");
+    fill_sphere_arrays(sphere_leaves);
+}
+
+//What primary rays of a region of the image test, the primitives that can be seen through it, see cull_region_primitives(...).
+struct Region_Candidates
+{
+    bool plane;//whether plane_instance can be
+    unsigned int sphere_node, mesh_node;//node the sphere and mesh trees are entered at, see leaves_entry_node(...), BVH_NO_NODE if no sphere or triangle can be
+    bool sphere_list;//whether the spheres that can be are listed below, then only those are tested, otherwise the sphere structure is traversed
+    struct Sphere_Arrays spheres;//those spheres, with 3 unused spheres after the last, see sphere_leaf_roots(...)
+    std::vector<unsigned int> sphere_indices;//index in sphere_container of each of them
+};
+
+/*
+ * Visits the spheres a ray may hit through sphere_grid when it is in use and sphere_bvh otherwise, see traverse_leaves(...) and traverse_grid(...), along with
+ * where the ray crosses them. intersect_sphere is called as intersect_sphere(index in sphere_container, number of roots, roots), see sphere_roots(...), and
+ * returns true to stop the traversal. The spheres of BVH leaves are tested 4 at a time, see sphere_leaf_roots(...), and handed over in leaf order. Primary
+ * rays of a region that listed its spheres only test those, also 4 at a time, and otherwise enter sphere_bvh at the region's node.
+ *
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance: see traverse_bvh(...)
+ * CANDIDATES: what the region of a primary ray can see, nullptr for other rays
+ * intersect_sphere: see above
+ */
+template <typename Sphere_Function>
+static void traverse_spheres(const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                             const struct Region_Candidates * CANDIDATES, Sphere_Function intersect_sphere)
+{
+    if (!sphere_grid.cell_starts.empty())
+    {
+        traverse_grid(sphere_grid, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, [&](const unsigned int INDEX)
+        {
+            float roots [2];
+            const unsigned int ROOT_COUNT = sphere_roots(sphere_container[INDEX].position, sphere_container[INDEX].radius, RAY_ORIGIN, RAY_DIRECTION, roots);
+
+            return intersect_sphere(INDEX, ROOT_COUNT, static_cast<const float *>(roots));
+        });
+        return;
+    }
+    if (CANDIDATES != nullptr && CANDIDATES -> sphere_list)
+    {
+        float roots [2][4];
+        unsigned int root_counts [4];
+
+        for (unsigned int batch = 0; batch < CANDIDATES -> sphere_indices.size(); batch += 4)
+        {
+            sphere_leaf_roots(CANDIDATES -> spheres, batch, RAY_ORIGIN, RAY_DIRECTION, roots, root_counts);
+            for (unsigned int i = 0; i < 4 && batch + i < CANDIDATES -> sphere_indices.size(); ++i)
+            {
+                const float SPHERE_ROOTS [2] = {roots[0][i], roots[1][i]};
+
+                if (intersect_sphere(CANDIDATES -> sphere_indices[batch + i], root_counts[i], SPHERE_ROOTS))
+                    return;
+            }
+        }
+        return;
+    }
+    traverse_leaves(sphere_bvh, sphere_bvh_4, sphere_bvh_8, sphere_bvh_compressed, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance,
+                    CANDIDATES != nullptr ? CANDIDATES -> sphere_node : 0, [&](const unsigned int FIRST, const unsigned int COUNT)
+    {
+        float roots [2][4];
+        unsigned int root_counts [4];
+
+        for (unsigned int batch = FIRST; batch < FIRST + COUNT; batch += 4)
+        {
+            sphere_leaf_roots(sphere_leaves, batch, RAY_ORIGIN, RAY_DIRECTION, roots, root_counts);
+            for (unsigned int i = 0; i < 4 && batch + i < FIRST + COUNT; ++i)
+            {
+                const float SPHERE_ROOTS [2] = {roots[0][i], roots[1][i]};
+
+                if (intersect_sphere(sphere_bvh.primitive_indices[batch + i], root_counts[i], SPHERE_ROOTS))
+                    return true;
+            }
+        }
+        return false;
+    });
+}
+
+//Triangles with one array per coordinate, so leaves of the mesh BVH are tested TRIANGLE_BATCH_SIZE triangles at a time, see triangle_leaf_hits(...).
+struct Triangle_Arrays
+{
+    std::vector<float> vertices [3][ARRAY_SIZE];//vertices[v][axis] is coordinate axis of vertex v + 1
+    std::vector<float> normals [ARRAY_SIZE];//cross product of the edges from the first vertex, unnormalized
+    std::vector<float> plane_offsets;//dot product of the normal and the first vertex
+}mesh_leaves;//mesh_instance's triangles in the order of mesh_bvh.primitive_indices, with TRIANGLE_BATCH_SIZE - 1 unused triangles after the last
+
+/*
+ * Copies the triangles of mesh_instance into arrays, in the order of mesh_bvh.primitive_indices, so every leaf is a contiguous range of them. Normals and plane
+ * offsets are worked out here once rather than for every ray. Unused triangles at the end have a normal of 0, so they are parallel to every ray.
+ *
+ * arrays: arrays filled
+ */
+static void fill_triangle_arrays(struct Triangle_Arrays& arrays)
+{
+    const size_t COUNT = mesh_bvh.primitive_indices.size();
+
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+    {
+        for (unsigned int vertex = 0; vertex < 3; ++vertex)
+            arrays.vertices[vertex][i].assign(COUNT + TRIANGLE_BATCH_SIZE - 1, 0.0f);//padding, so reading a batch from the last triangles stays in bounds
+        arrays.normals[i].assign(COUNT + TRIANGLE_BATCH_SIZE - 1, 0.0f);
+    }
+    arrays.plane_offsets.assign(COUNT + TRIANGLE_BATCH_SIZE - 1, 0.0f);
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+        const unsigned int INDEX = mesh_bvh.primitive_indices[i] * 3;//3 vertices make a triangle
+        float first_vector_2_minus_1 [ARRAY_SIZE], second_vector_3_minus_1 [ARRAY_SIZE], triangle_normal [ARRAY_SIZE];
+
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+        {
+            for (unsigned int vertex = 0; vertex < 3; ++vertex)
+                arrays.vertices[vertex][j][i] = mesh_instance.vertices[INDEX + vertex][j];
+            first_vector_2_minus_1[j] = mesh_instance.vertices[INDEX + 1][j] - mesh_instance.vertices[INDEX][j];
+            second_vector_3_minus_1[j] = mesh_instance.vertices[INDEX + 2][j] - mesh_instance.vertices[INDEX][j];
+        }
+        cross_product(first_vector_2_minus_1, second_vector_3_minus_1, triangle_normal);
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            arrays.normals[j][i] = triangle_normal[j];
+        arrays.plane_offsets[i] = dot_product(triangle_normal, mesh_instance.vertices[INDEX].data());
+    }
+}
+
+//Lanes of TRIANGLE_BATCH_SIZE floats and the operations triangle_leaf_hits(...) uses on them, AVX or SSE.
+#ifdef __AVX__
+    typedef __m256 Triangle_Lanes;
+    #define LANES_LOAD _mm256_loadu_ps
+    #define LANES_SET _mm256_set1_ps
+    #define LANES_ADD _mm256_add_ps
+    #define LANES_SUBTRACT _mm256_sub_ps
+    #define LANES_MULTIPLY _mm256_mul_ps
+    #define LANES_DIVIDE _mm256_div_ps
+    #define LANES_AND _mm256_and_ps
+    #define LANES_OR _mm256_or_ps
+    #define LANES_LESS(A, B) _mm256_cmp_ps(A, B, _CMP_LT_OQ)
+    #define LANES_MASK _mm256_movemask_ps
+    #define LANES_STORE _mm256_storeu_ps
+#else
+    typedef __m128 Triangle_Lanes;
+    #define LANES_LOAD _mm_loadu_ps
+    #define LANES_SET _mm_set1_ps
+    #define LANES_ADD _mm_add_ps
+    #define LANES_SUBTRACT _mm_sub_ps
+    #define LANES_MULTIPLY _mm_mul_ps
+    #define LANES_DIVIDE _mm_div_ps
+    #define LANES_AND _mm_and_ps
+    #define LANES_OR _mm_or_ps
+    #define LANES_LESS _mm_cmplt_ps
+    #define LANES_MASK _mm_movemask_ps
+    #define LANES_STORE _mm_storeu_ps
+#endif
+
+/*
+ * Dot product of NORMAL and the cross product of EDGE and POINT - CORNER, for TRIANGLE_BATCH_SIZE triangles at once, see cross_product(...). Negative where
+ * POINT is outside the edge.
+ *
+ * NORMAL: normals of the triangles
+ * EDGE: edge of the triangles, from CORNER to the next vertex
+ * CORNER: vertex of the triangles the edge starts at
+ * POINT: where the ray meets the plane of each triangle
+ */
+static Triangle_Lanes triangle_edge_side(const Triangle_Lanes NORMAL [ARRAY_SIZE], const Triangle_Lanes EDGE [ARRAY_SIZE], const Triangle_Lanes CORNER [ARRAY_SIZE],
+                                         const Triangle_Lanes POINT [ARRAY_SIZE])
+{
+    const Triangle_Lanes TO_POINT [ARRAY_SIZE] = {LANES_SUBTRACT(POINT[0], CORNER[0]), LANES_SUBTRACT(POINT[1], CORNER[1]), LANES_SUBTRACT(POINT[2], CORNER[2])};
+    const Triangle_Lanes CROSS [ARRAY_SIZE] = {LANES_SUBTRACT(LANES_MULTIPLY(EDGE[1], TO_POINT[2]), LANES_MULTIPLY(EDGE[2], TO_POINT[1])),
+                                               LANES_SUBTRACT(LANES_MULTIPLY(EDGE[2], TO_POINT[0]), LANES_MULTIPLY(EDGE[0], TO_POINT[2])),
+                                               LANES_SUBTRACT(LANES_MULTIPLY(EDGE[0], TO_POINT[1]), LANES_MULTIPLY(EDGE[1], TO_POINT[0]))};
+
+    return LANES_ADD(LANES_ADD(LANES_MULTIPLY(NORMAL[0], CROSS[0]), LANES_MULTIPLY(NORMAL[1], CROSS[1])), LANES_MULTIPLY(NORMAL[2], CROSS[2]));
+}
+
+/*
+ * Intersects TRIANGLE_BATCH_SIZE pairs of a ray and a triangle at once, one per lane, without branches. Finds where each ray meets the plane of its triangle,
+ * parallel when the dot product of the unnormalized normal and the direction is within ZERO_TOLERANCE of 0, then tests that point against each edge. Every
+ * test is worked out for every lane and the failures are or'ed into one mask, so a triangle failing early costs the same as one passing. Returns a bit mask of
+ * the lanes hit at a distance in [0, MAXIMUM_DISTANCE]. This is the test the mesh always used, done one triangle at a time before, and its operations are in
+ * the same order, so distances only differ in the last bit where the compiler fused a multiply and add of the scalar version, which moves a few edge pixels at most.
+ *
+ * NORMAL: unnormalized normal of each triangle, see Triangle_Arrays
+ * VERTICES: vertices of each triangle, VERTICES[v][axis]
+ * PLANE_OFFSET: dot product of each normal and the first vertex
+ * ORIGIN, DIRECTION: each ray, DIRECTION normalized
+ * MAXIMUM_DISTANCE: hits past MAXIMUM_DISTANCE along each ray are left out
+ * distances: where the distance of lane i is stored, in distances[i], only meaningful for hits
+ */
+static int triangle_lane_hits(const Triangle_Lanes NORMAL [ARRAY_SIZE], const Triangle_Lanes VERTICES [3][ARRAY_SIZE], const Triangle_Lanes PLANE_OFFSET,
+                              const Triangle_Lanes ORIGIN [ARRAY_SIZE], const Triangle_Lanes DIRECTION [ARRAY_SIZE], const Triangle_Lanes MAXIMUM_DISTANCE,
+                              float distances [TRIANGLE_BATCH_SIZE])
+{
+    const Triangle_Lanes ZERO = LANES_SET(0.0f);
+    Triangle_Lanes edges [3][ARRAY_SIZE], point [ARRAY_SIZE], misses;
+
+    for (unsigned int vertex = 0; vertex < 3; ++vertex)
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            edges[vertex][i] = LANES_SUBTRACT(VERTICES[(vertex + 1) % 3][i], VERTICES[vertex][i]);
+    {
+        const Triangle_Lanes NORMAL_DOT_DIRECTION = LANES_ADD(LANES_ADD(LANES_MULTIPLY(NORMAL[0], DIRECTION[0]), LANES_MULTIPLY(NORMAL[1], DIRECTION[1])),
+                                                              LANES_MULTIPLY(NORMAL[2], DIRECTION[2]));
+        const Triangle_Lanes NORMAL_DOT_ORIGIN = LANES_ADD(LANES_ADD(LANES_MULTIPLY(NORMAL[0], ORIGIN[0]), LANES_MULTIPLY(NORMAL[1], ORIGIN[1])),
+                                                           LANES_MULTIPLY(NORMAL[2], ORIGIN[2]));
+        const Triangle_Lanes DISTANCE = LANES_DIVIDE(LANES_SUBTRACT(PLANE_OFFSET, NORMAL_DOT_ORIGIN), NORMAL_DOT_DIRECTION);
+
+        //lines are parallel, the distance is negative or too far, NaN distances of parallel lanes are already misses
+        misses = LANES_AND(LANES_LESS(LANES_SET(-ZERO_TOLERANCE), NORMAL_DOT_DIRECTION), LANES_LESS(NORMAL_DOT_DIRECTION, LANES_SET(ZERO_TOLERANCE)));
+        LANES_STORE(distances, DISTANCE);
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            point[i] = LANES_ADD(ORIGIN[i], LANES_MULTIPLY(DISTANCE, DIRECTION[i]));
+        misses = LANES_OR(misses, LANES_OR(LANES_LESS(DISTANCE, ZERO), LANES_LESS(MAXIMUM_DISTANCE, DISTANCE)));
+    }
+    for (unsigned int vertex = 0; vertex < 3; ++vertex)
+        misses = LANES_OR(misses, LANES_LESS(triangle_edge_side(NORMAL, edges[vertex], VERTICES[vertex], point), ZERO));
+    return ~LANES_MASK(misses) & ((1 << TRIANGLE_BATCH_SIZE) - 1);
+}
+
+/*
+ * Intersects a ray with TRIANGLE_BATCH_SIZE triangles of mesh_leaves at once, see triangle_lane_hits(...). Returns a bit mask of the triangles hit at a distance
+ * in [0, MAXIMUM_DISTANCE], bit i for triangle FIRST + i.
+ *
+ * FIRST: index in mesh_leaves of the first triangle
+ * RAY_ORIGIN: array of size 3 represent point origin of the ray
+ * RAY_DIRECTION: array size 3 representing a mathematical vector of the ray's direction
+ * MAXIMUM_DISTANCE: hits past MAXIMUM_DISTANCE are left out
+ * distances: where the distance to triangle FIRST + i is stored, in distances[i], only meaningful for hits
+ */
+static int triangle_leaf_hits(const unsigned int FIRST, const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MAXIMUM_DISTANCE,
+                              float distances [TRIANGLE_BATCH_SIZE])
+{
+    const Triangle_Lanes ORIGIN [ARRAY_SIZE] = {LANES_SET(RAY_ORIGIN[0]), LANES_SET(RAY_ORIGIN[1]), LANES_SET(RAY_ORIGIN[2])};
+    const Triangle_Lanes DIRECTION [ARRAY_SIZE] = {LANES_SET(RAY_DIRECTION[0]), LANES_SET(RAY_DIRECTION[1]), LANES_SET(RAY_DIRECTION[2])};
+    const Triangle_Lanes NORMAL [ARRAY_SIZE] = {LANES_LOAD(&mesh_leaves.normals[0][FIRST]), LANES_LOAD(&mesh_leaves.normals[1][FIRST]),
+                                                LANES_LOAD(&mesh_leaves.normals[2][FIRST])};
+    Triangle_Lanes vertices [3][ARRAY_SIZE];
+
+    for (unsigned int vertex = 0; vertex < 3; ++vertex)
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            vertices[vertex][i] = LANES_LOAD(&mesh_leaves.vertices[vertex][i][FIRST]);
+    return triangle_lane_hits(NORMAL, vertices, LANES_LOAD(&mesh_leaves.plane_offsets[FIRST]), ORIGIN, DIRECTION, LANES_SET(MAXIMUM_DISTANCE), distances);
+}
+
+/*
+ * Intersects one triangle of mesh_leaves with the rays of TRIANGLE_BATCH_SIZE consecutive samples of a visibility buffer at once, see triangle_lane_hits(...).
+ * Each ray's distance is the same as triangle_leaf_hits(...) gives it. Returns a bit mask of the samples hit closer than their depth or at it, bit i for sample
+ * FIRST + i.
+ *
+ * TRIANGLE: index in mesh_leaves of the triangle
+ * RAY_ORIGIN: origin of every ray
+ * BUFFER: visibility buffer the samples are in
+ * FIRST: first of the samples
+ * distances: where the distance of sample FIRST + i is stored, in distances[i], only meaningful for hits
+ */
+static int triangle_sample_hits(const unsigned int TRIANGLE, const float RAY_ORIGIN [ARRAY_SIZE], const struct Visibility_Buffer& BUFFER, const size_t FIRST,
+                                float distances [TRIANGLE_BATCH_SIZE])
+{
+    const Triangle_Lanes ORIGIN [ARRAY_SIZE] = {LANES_SET(RAY_ORIGIN[0]), LANES_SET(RAY_ORIGIN[1]), LANES_SET(RAY_ORIGIN[2])};
+    const Triangle_Lanes DIRECTION [ARRAY_SIZE] = {LANES_LOAD(&BUFFER.directions[0][FIRST]), LANES_LOAD(&BUFFER.directions[1][FIRST]), LANES_LOAD(&BUFFER.directions[2][FIRST])};
+    const Triangle_Lanes NORMAL [ARRAY_SIZE] = {LANES_SET(mesh_leaves.normals[0][TRIANGLE]), LANES_SET(mesh_leaves.normals[1][TRIANGLE]),
+                                                LANES_SET(mesh_leaves.normals[2][TRIANGLE])};
+    Triangle_Lanes vertices [3][ARRAY_SIZE];
+
+    for (unsigned int vertex = 0; vertex < 3; ++vertex)
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            vertices[vertex][i] = LANES_SET(mesh_leaves.vertices[vertex][i][TRIANGLE]);
+    return triangle_lane_hits(NORMAL, vertices, LANES_SET(mesh_leaves.plane_offsets[TRIANGLE]), ORIGIN, DIRECTION, LANES_LOAD(&BUFFER.depths[FIRST]), distances);
+}
+
+/*
+ * Brings mesh_bvh up to date with mesh_instance with leaves of up to render_settings.mesh_leaf_size triangles, collapses it, see update_wide_bvh(...), and
+ * fills mesh_leaves.
+ *
+ * REFIT: see update_bvh(...)
+ */
+static void update_mesh_bvh(const bool REFIT)
+{
+    std::vector<struct Bounding_Box> bounds(mesh_instance.vertices.size() / 3);//3 vertices make a triangle
+    for (unsigned int i = 0; i < bounds.size(); ++i)
+        bounds[i] = triangle_bounding_box(i);
+    update_bvh(mesh_bvh, bounds, "Mesh", REFIT, render_settings.mesh_leaf_size);
+    update_wide_bvh(mesh_bvh, mesh_bvh_4, mesh_bvh_8, mesh_bvh_compressed, "Mesh");
+    fill_triangle_arrays(mesh_leaves);
+}
+
+/*
+ * Visits the triangles of mesh_instance a ray hits through mesh_bvh, see traverse_leaves(...). Leaves are tested TRIANGLE_BATCH_SIZE triangles at a time, see
+ * triangle_leaf_hits(...), and only hits closer than maximum_distance are handed over, in leaf order. hit_triangle is called as hit_triangle(triangle index,
+ * distance), see triangle_bounding_box(...), and returns true to stop the traversal. Primary rays enter the tree at their region's node.
+ *
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance: see traverse_bvh(...)
+ * CANDIDATES: see traverse_spheres(...)
+ * hit_triangle: see above
+ */
+template <typename Triangle_Function>
+static void traverse_triangles(const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MINIMUM_DISTANCE, const float& maximum_distance,
+                               const struct Region_Candidates * CANDIDATES, Triangle_Function hit_triangle)
+{
+    if (CANDIDATES != nullptr && CANDIDATES -> mesh_node == BVH_NO_NODE)
+        return;
+    traverse_leaves(mesh_bvh, mesh_bvh_4, mesh_bvh_8, mesh_bvh_compressed, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance,
+                    CANDIDATES != nullptr ? CANDIDATES -> mesh_node : 0, [&](const unsigned int FIRST, const unsigned int COUNT)
+    {
+        float distances [TRIANGLE_BATCH_SIZE];
+
+        for (unsigned int batch = FIRST; batch < FIRST + COUNT; batch += TRIANGLE_BATCH_SIZE)
+        {
+            const int HITS = triangle_leaf_hits(batch, RAY_ORIGIN, RAY_DIRECTION, maximum_distance, distances);
+
+            for (unsigned int i = 0; i < TRIANGLE_BATCH_SIZE && batch + i < FIRST + COUNT; ++i)
+                if ((HITS >> i & 1) != 0 && hit_triangle(mesh_bvh.primitive_indices[batch + i], distances[i]))
+                    return true;
+        }
+        return false;
+    });
+}
+
+//Side planes of the pyramid from the camera every primary ray of a region of the image stays in, see region_frustum(...).
+struct Region_Frustum
+{
+    float edges [4][ARRAY_SIZE];//directions of the pyramid's edges, going around it, not normalized
+    float normals [4][ARRAY_SIZE];//inward unit normals of the planes between consecutive edges, which go through camera_instance.position
+};
+
+/*
+ * Works out the pyramid the primary rays of a region stay in. Every ray target of the region lies in the region plus a one pixel apron on the image plane,
+ * which with the camera spans the pyramid.
+ *
+ * X_START, Y_START, X_END, Y_END: the region, see render_region(...)
+ * frustum: where the pyramid is stored
+ */
+static void region_frustum(const unsigned int X_START, const unsigned int Y_START, const unsigned int X_END, const unsigned int Y_END, struct Region_Frustum& frustum)
+{
+    const float LEFT = static_cast<float>(static_cast<int>(X_START) - static_cast<int>(image_plane.half_horizontal) - 1),
+                RIGHT = static_cast<float>(static_cast<int>(X_END) - static_cast<int>(image_plane.half_horizontal) + 1),
+                TOP = static_cast<float>(static_cast<int>(image_plane.half_vertical) - static_cast<int>(Y_START) + 1),
+                BOTTOM = static_cast<float>(static_cast<int>(image_plane.half_vertical) - static_cast<int>(Y_END) - 1);
+    const float CORNERS [4][2] = {{LEFT, TOP}, {RIGHT, TOP}, {RIGHT, BOTTOM}, {LEFT, BOTTOM}};//going around the pyramid
+    float centre [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};
+    unsigned int i, j;
+
+    for (i = 0; i < 4; ++i)//same directions as create_normailized_ray_direction(...) gives primary rays, not normalized
+    {
+        frustum.edges[i][0] = CORNERS[i][0] - image_plane.adjusted_camera_position[0];
+        frustum.edges[i][1] = CORNERS[i][1] - image_plane.adjusted_camera_position[1];
+        frustum.edges[i][2] = -1.0f - image_plane.adjusted_camera_position[2];
+        for (j = 0; j < ARRAY_SIZE; ++j)
+            centre[j] += frustum.edges[i][j];
+    }
+    for (i = 0; i < 4; ++i)
+    {
+        cross_product(frustum.edges[i], frustum.edges[(i + 1) & 3], frustum.normals[i]);
+        const float LENGTH = static_cast<float>(sqrt(dot_product(frustum.normals[i], frustum.normals[i]))) * (dot_product(frustum.normals[i], centre) < 0.0f ? -1.0f : 1.0f);
+        for (j = 0; j < ARRAY_SIZE; ++j)
+            frustum.normals[i][j] /= LENGTH;
+    }
+}
+
+/*
+ * Tests if a sphere may be seen through a region, that is it is not wholly outside one of the sides of its pyramid. The sides are pushed out by 1, as primary
+ * rays take hits up to 1 behind the camera.
+ *
+ * FRUSTUM: pyramid of the region
+ * CENTRE, RADIUS: the sphere
+ */
+static bool region_sees_sphere(const struct Region_Frustum& FRUSTUM, const float CENTRE [ARRAY_SIZE], const float RADIUS)
+{
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        float distance = 0.0f;
+
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            distance += FRUSTUM.normals[i][j] * (CENTRE[j] - camera_instance.position[j]);
+        if (distance <= -(RADIUS + 1.0f))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Tests if a box may be seen through a region, like region_sees_sphere(...) with the corner of the box furthest inside each side.
+ *
+ * FRUSTUM: pyramid of the region
+ * BOX: the box
+ */
+static bool region_sees_box(const struct Region_Frustum& FRUSTUM, const struct Bounding_Box& BOX)
+{
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        float distance = 0.0f;
+
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            distance += FRUSTUM.normals[i][j] * ((FRUSTUM.normals[i][j] > 0.0f ? BOX.maximum[j] : BOX.minimum[j]) - camera_instance.position[j]);
+        if (distance <= -1.0f)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Tests if a plane may be seen through a region. Primary rays only hit planes ahead of the camera, see plane_distance(...), which rays in the pyramid do if
+ * one of its edges heads towards the plane, as their directions are blends of the edges'.
+ *
+ * FRUSTUM: pyramid of the region
+ * INPUT_PLANE: the plane
+ */
+static bool region_sees_plane(const struct Region_Frustum& FRUSTUM, const struct Plane& INPUT_PLANE)
+{
+    const float CAMERA_MINUS_POSITION [ARRAY_SIZE] = {camera_instance.position[0] - INPUT_PLANE.position[0], camera_instance.position[1] - INPUT_PLANE.position[1],
+                                                      camera_instance.position[2] - INPUT_PLANE.position[2]};
+    const float SIDE = dot_product(CAMERA_MINUS_POSITION, INPUT_PLANE.normal);//which side of the plane the camera is on
+
+    if (SIDE == 0.0f)
+        return true;
+    for (unsigned int i = 0; i < 4; ++i)
+        if (dot_product(FRUSTUM.edges[i], INPUT_PLANE.normal) * SIDE < 0.0f)
+            return true;
+    return false;
+}
+
+/*
+ * Culls the primitives that cannot be seen through a region, so its primary rays only test the rest, see closest_intersection(...). The plane is kept if it can
+ * be seen, and the sphere and mesh trees are entered at the deepest node every box that can be seen is under, see leaves_entry_node(...), which skips whole
+ * trees nothing of can be seen. When up to REGION_SPHERE_LIMIT spheres can be seen, found by going down sphere_bvh, they are listed to be tested directly
+ * instead. Spheres in sphere_grid are left to the grid.
+ *
+ * X_START, Y_START, X_END, Y_END: the region, see render_region(...)
+ * candidates: where what can be seen is stored
+ * statistics: where what was kept is counted
+ */
+static void cull_region_primitives(const unsigned int X_START, const unsigned int Y_START, const unsigned int X_END, const unsigned int Y_END,
+                                   struct Region_Candidates& candidates, struct Sampling_Statistics& statistics)
+{
+    struct Region_Frustum frustum;
+    const auto BOX_WANTED = [&](const struct Bounding_Box& BOX)
+    {
+        return region_sees_box(frustum, BOX);
+    };
+
+    region_frustum(X_START, Y_START, X_END, Y_END, frustum);
+    candidates.plane = plane_instance.active && region_sees_plane(frustum, plane_instance);
+    candidates.sphere_node = leaves_entry_node(sphere_bvh, sphere_bvh_4, sphere_bvh_8, sphere_bvh_compressed, BOX_WANTED);
+    candidates.mesh_node = leaves_entry_node(mesh_bvh, mesh_bvh_4, mesh_bvh_8, mesh_bvh_compressed, BOX_WANTED);
+    candidates.sphere_list = !sphere_bvh.nodes.empty();
+    candidates.sphere_indices.clear();
+    if (candidates.sphere_list && candidates.sphere_node != BVH_NO_NODE)
+    {
+        unsigned int stack [BVH_STACK_SIZE], stack_size = 0;
+
+        stack[stack_size++] = 0;
+        while (stack_size > 0 && candidates.sphere_list)
+        {
+            const struct BVH_Node& NODE = sphere_bvh.nodes[stack[--stack_size]];
+
+            if (!region_sees_box(frustum, NODE.bounds))
+                continue;
+            if (NODE.count == 0)
+            {
+                stack[stack_size++] = NODE.first + 1;//left child first, so spheres are listed in the order of sphere_bvh.primitive_indices
+                stack[stack_size++] = NODE.first;
+                continue;
+            }
+            for (unsigned int i = NODE.first; i < NODE.first + NODE.count && candidates.sphere_list; ++i)
+            {
+                const struct Sphere& SPHERE = sphere_container[sphere_bvh.primitive_indices[i]];
+
+                if (region_sees_sphere(frustum, SPHERE.position, SPHERE.radius))
+                {
+                    candidates.sphere_indices.push_back(sphere_bvh.primitive_indices[i]);
+                    candidates.sphere_list = candidates.sphere_indices.size() <= REGION_SPHERE_LIMIT;
                 }
             }
         }
+    }
+    if (candidates.sphere_list)
+    {
+        const size_t COUNT = candidates.sphere_indices.size();
 
-        //render
+        candidates.spheres.centres_x.assign(COUNT + 3, 0.0f);//padding, like sphere_leaves
+        candidates.spheres.centres_y.assign(COUNT + 3, 0.0f);
+        candidates.spheres.centres_z.assign(COUNT + 3, 0.0f);
+        candidates.spheres.radii.assign(COUNT + 3, 0.0f);
+        for (size_t i = 0; i < COUNT; ++i)
         {
-            //time to uniquely create output file names
-            const time_t RAW_TIME = time(nullptr);
-            const struct tm * DATE_TIME = localtime(&RAW_TIME);
-            #ifdef DEBUG_2
-                cerr
-                #ifdef ABSOLUTE_PATH
-                    << ABSOLUTE_PATH
+            const struct Sphere& SPHERE = sphere_container[candidates.sphere_indices[i]];
+
+            candidates.spheres.centres_x[i] = SPHERE.position[0];
+            candidates.spheres.centres_y[i] = SPHERE.position[1];
+            candidates.spheres.centres_z[i] = SPHERE.position[2];
+            candidates.spheres.radii[i] = SPHERE.radius;
+        }
+        ++statistics.sphere_lists;
+        statistics.listed_spheres += COUNT;
+    }
+    ++statistics.primitive_lists;
+    statistics.plane_regions += candidates.plane ? 1 : 0;
+    statistics.mesh_regions += mesh_instance.active && candidates.mesh_node != BVH_NO_NODE ? 1 : 0;
+}
+
+/*
+ * Calculates the normalized normal of a triangle of mesh_instance, which is the same at every point of it.
+ *
+ * INDEX: index in mesh_instance.vertices of the triangle's first vertex
+ * normal: where the normal is stored
+ */
+static void mesh_triangle_normal(const unsigned int INDEX, float normal [ARRAY_SIZE])
+{
+    unsigned int i;
+    float first_vector [ARRAY_SIZE], second_vector [ARRAY_SIZE];
+    for (i = 0; i < ARRAY_SIZE; ++i)
+    {
+        first_vector[i] = (mesh_instance.vertices[INDEX + 1])[i] - (mesh_instance.vertices[INDEX])[i];
+        second_vector[i] = (mesh_instance.vertices[INDEX + 2])[i] - (mesh_instance.vertices[INDEX])[i];
+    }
+    cross_product(first_vector, second_vector, normal);
+    //normalize
+    {
+        const float UNNORMALIZED_LENGTH = sqrt(pow(normal[0], 2.0f) + pow(normal[1], 2.0f) + pow(normal[2], 2.0f));//calculate vector length
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            normal[i] /= UNNORMALIZED_LENGTH;
+    }
+}
+
+/*
+ * Finds the closest intersection of a ray with the objects in the scene. Returns {intersected object, intersection distance from RAY_ORIGIN in terms of scalar}, first is nullptr when nothing was hit.
+ *
+ * RAY_ORIGIN: array of size 3 represent point origin of the ray
+ * RAY_DIRECTION: array size 3 representing a mathematical vector of the ray's direction
+ * MINIMUM_DISTANCE: only intersections further than this along the ray count, -1.0f for primary rays as always, a small positive bias for rays leaving a surface
+ * CANDIDATES: for primary rays, what their region can see, see cull_region_primitives(...), only those primitives are tested, nullptr to test all of them
+ * intersection_point: where the closest intersection point is stored, only meaningful if something was hit
+ * intersection_point_normal: where the normal of the intersected object at intersection_point is stored, only meaningful if something was hit
+ */
+static std::pair<const struct Object_Light_Properties *, float> closest_intersection(const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MINIMUM_DISTANCE,
+                                                                                      const struct Region_Candidates * CANDIDATES, float intersection_point [ARRAY_SIZE],
+                                                                                      float intersection_point_normal [ARRAY_SIZE])
+{
+    unsigned int corresponding_index;
+    float smallest_distance_scalar;//Values to avoid constantly assigning placeholder.first a new value, figure the assignment will be faster this way.
+    float * intersections_placeholder;
+    std::pair<const struct Object_Light_Properties *, float> placeholder(nullptr, FLT_MAX);//{intersected object, intersection distance from camera in terms of scalar}, slight problem if the closest intersection point is at FLT_MAX as scalar, though is improbable.
+
+    if (plane_instance.active && (CANDIDATES == nullptr || CANDIDATES -> plane))//a plan exists
+    {
+        intersections_placeholder = plane_intersection(plane_instance, RAY_ORIGIN, RAY_DIRECTION);
+
+        if (intersections_placeholder != nullptr)
+        {
+            #ifdef DEBUG_3_HIT
+                cerr << "There is an intersection with plane_instance, intersections_placeholder value " << *intersections_placeholder << endl;
+            #endif
+            if (MINIMUM_DISTANCE < *intersections_placeholder && *intersections_placeholder < placeholder.second)
+            {
+                #ifdef DEBUG_3_HIT
+                    cerr << "New closer point found with plane_instance." << endl;
                 #endif
-                    << "Output/" << FILE_NAME << " " << DATE_TIME -> tm_year + 1900 << "-" << DATE_TIME -> tm_mon + 1 << "-" << DATE_TIME -> tm_mday
-                    << " " << DATE_TIME -> tm_hour << "_" << DATE_TIME -> tm_min << "_" << DATE_TIME -> tm_sec << ".bmp";
+                placeholder.first = &plane_instance;
+                placeholder.second = *intersections_placeholder;
+                for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                {
+                    intersection_point[i] = placeholder.second * RAY_DIRECTION[i] + RAY_ORIGIN[i];
+                    intersection_point_normal[i] = plane_instance.normal[i];
+                }
+            }
+
+            delete intersections_placeholder;
+        }
+        #ifdef DEBUG_3_MISS
+            else
+                cerr << "There is no intersection with plane_instance." << endl;
+        #endif
+    }
+    if (!sphere_container.empty())//spheres exist
+    {
+        smallest_distance_scalar = placeholder.second;//only closer intersections matter, also bounds the traversal
+
+        traverse_spheres(RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, smallest_distance_scalar, CANDIDATES, [&](const unsigned int INDEX, const unsigned int ROOT_COUNT, const float ROOTS [2])
+        {
+            #ifdef DEBUG_3_HIT
+                if (ROOT_COUNT > 0)
+                    cerr << "There are " << ROOT_COUNT << " intersections with sphere_container[" << INDEX << "]." << endl;
             #endif
-            output_image.save((
-            #ifdef ABSOLUTE_PATH
-                std::string(ABSOLUTE_PATH) +
+            #ifdef DEBUG_3_MISS
+                if (ROOT_COUNT < 1)
+                    cerr << "No intersection with sphere_container[" << INDEX << "]." << endl;
             #endif
-            "Output/" + FILE_NAME + " " + std::to_string(DATE_TIME-> tm_year + 1900) + "-" + std::to_string(DATE_TIME-> tm_mon + 1) + "-" + std::to_string(DATE_TIME-> tm_mday) +
-            " " + std::to_string(DATE_TIME-> tm_hour) + "_" + std::to_string(DATE_TIME-> tm_min) + "_" + std::to_string(DATE_TIME-> tm_sec) + ".bmp").c_str());
-            #ifdef DEBUG_2
-                cimg_library::CImgDisplay image_display(output_image, "Output Image");
-                while (!image_display.is_closed())
+            for (unsigned int i = 0; i < ROOT_COUNT; ++i)
+            {
+                #ifdef DEBUG_3_HIT
+                    cerr << "value of ROOTS[" << i << "] is " << ROOTS[i] << endl;
+                #endif
+                if (MINIMUM_DISTANCE < ROOTS[i] && ROOTS[i] < smallest_distance_scalar)
                 {
-                    image_display.wait();
+                    smallest_distance_scalar = ROOTS[i];
+                    corresponding_index = INDEX;
                 }
+            }
+            return false;
+        });
+
+        if (MINIMUM_DISTANCE < smallest_distance_scalar && smallest_distance_scalar < placeholder.second)
+        {
+            #ifdef DEBUG_3_HIT
+                cerr << "New closer point found with Sphere." << endl;
             #endif
+            placeholder.first = &sphere_container[corresponding_index];
+            placeholder.second = smallest_distance_scalar;
+            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                intersection_point_normal[i] = ((intersection_point[i] = placeholder.second * RAY_DIRECTION[i] + RAY_ORIGIN[i])
+                                                - sphere_container[corresponding_index].position[i]) / sphere_container[corresponding_index].radius;
+        }
+    }
+    if (mesh_instance.active)//mesh exists
+    {
+        smallest_distance_scalar = placeholder.second;//only closer intersections matter, also bounds the traversal
+
+        traverse_triangles(RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE > 0.0f ? MINIMUM_DISTANCE : 0.0f, smallest_distance_scalar, CANDIDATES, [&](const unsigned int TRIANGLE, const float DISTANCE)
+        {
+            const unsigned int INDEX = TRIANGLE * 3;//3 vertices make a triangle
+
+            #ifdef DEBUG_3_HIT
+                cerr << "Intersection with triangle formed by mesh_instance.vertices[" << INDEX << ", " << INDEX + 2 << "]" << endl;
+            #endif
+            if (MINIMUM_DISTANCE < DISTANCE && DISTANCE < smallest_distance_scalar)
+            {
+                smallest_distance_scalar = DISTANCE;
+                corresponding_index = INDEX;
+            }
+            return false;
+        });
+
+        if (-1.0f < smallest_distance_scalar && smallest_distance_scalar < placeholder.second)
+        {
+            #ifdef DEBUG_3_HIT
+                cerr << "New closer point found with Mesh triangle." << endl;
+            #endif
+            placeholder.first = &mesh_instance;
+            placeholder.second = smallest_distance_scalar;
+            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                intersection_point[i] = placeholder.second * RAY_DIRECTION[i] + RAY_ORIGIN[i];
+            mesh_triangle_normal(corresponding_index, intersection_point_normal);
+        }
+    }
+
+    return placeholder;
+}
+
+/*
+ * Tests if a light ray is blocked by any object in the scene before it reaches the light. Returns true if the light ray is blocked.
+ *
+ * INTERSECTION_POINT: origin of the light ray, a point on an intersected object
+ * LIGHT_RAY_DIRECTION: normalized mathematical vector pointing from INTERSECTION_POINT towards the light
+ * SCALAR_TO_LIGHT: scalar to the light, acts as an upper bound for blocking intersections
+ */
+static bool light_blocked(const float INTERSECTION_POINT [ARRAY_SIZE], const float LIGHT_RAY_DIRECTION [ARRAY_SIZE], const float SCALAR_TO_LIGHT)
+{
+    bool blocked = false;
+    float * placeholder_2;//is reused for various intersections
+
+    if (plane_instance.active)//a plan exists
+    {
+        placeholder_2 = plane_intersection(plane_instance, INTERSECTION_POINT, LIGHT_RAY_DIRECTION);
+
+        if (placeholder_2 != nullptr)//thus intersection exist
+        {
+            if (SHADOW_BIAS < *placeholder_2 && *placeholder_2 < SCALAR_TO_LIGHT)
+            {
+                #ifdef DEBUG_4_BLOCKED
+                    cerr << "plane_instance blocked light ray from intersection point {" << INTERSECTION_POINT[0] << ", " << INTERSECTION_POINT[1] << ", " << INTERSECTION_POINT[2] << "}." << endl;
+                #endif
+                delete placeholder_2;
+                return true;
+            }
+            delete placeholder_2;
+        }
+    }
+    if (!sphere_container.empty())//spheres exist
+    {
+        traverse_spheres(INTERSECTION_POINT, LIGHT_RAY_DIRECTION, SHADOW_BIAS, SCALAR_TO_LIGHT, nullptr, [&](const unsigned int INDEX, const unsigned int ROOT_COUNT, const float ROOTS [2])
+        {
+            if (ROOT_COUNT > 0 /*thus intersection exist*/ && ((SHADOW_BIAS < ROOTS[0] && ROOTS[0] < SCALAR_TO_LIGHT) ||
+               (ROOT_COUNT == 2 /*thus 2nd intersection exits*/ && SHADOW_BIAS < ROOTS[1] && ROOTS[1] < SCALAR_TO_LIGHT)))//lower bound is greater than 0 to not block itself
+            {
+                #ifdef DEBUG_4_BLOCKED
+                    cerr << "sphere_container[" << INDEX << "] blocked light ray from intersection point {" << INTERSECTION_POINT[0] << ", " << INTERSECTION_POINT[1] << ", " << INTERSECTION_POINT[2] << "}." << endl;
+                #else
+                    (void)INDEX;//only named for the debug output
+                #endif
+                blocked = true;
+            }
+            return blocked;
+        });
+        if (blocked)
+            return true;
+    }
+    if (mesh_instance.active)//mesh exists
+    {
+        traverse_triangles(INTERSECTION_POINT, LIGHT_RAY_DIRECTION, SHADOW_BIAS, SCALAR_TO_LIGHT, nullptr, [&](const unsigned int TRIANGLE, const float DISTANCE)
+        {
+            if (SHADOW_BIAS < DISTANCE)//lower bound is greater than 0 to not block itself
+            {
+                #ifdef DEBUG_4_BLOCKED
+                    cerr << "mesh_instance.vertices[" << TRIANGLE * 3 << ", " << TRIANGLE * 3 + 2 << "] blocked light ray from intersection point {"
+                         << INTERSECTION_POINT[0] << ", " << INTERSECTION_POINT[1] << ", " << INTERSECTION_POINT[2] << "}." << endl;
+                #else
+                    (void)TRIANGLE;//only named for the debug output
+                #endif
+                blocked = true;
+            }
+            return blocked;
+        });
+    }
+
+    return blocked;
+}
+
+/*
+ * Wavefront any hit kernel for plane_instance. Marks every active ray of queue that the plane blocks, see compact_ray_queue(...).
+ *
+ * queue: rays tested, sorted
+ */
+static void plane_any_hit_kernel(struct Ray_Queue& queue)
+{
+    float distance;
+
+    if (!plane_instance.active)
+        return;
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+
+        if (plane_distance(plane_instance, &queue.origins[RAY * ARRAY_SIZE], &queue.directions[RAY * ARRAY_SIZE], distance) &&
+            queue.minimum_distances[RAY] < distance && distance < queue.maximum_distances[RAY])
+            queue.hits[RAY] = 1;
+    }
+}
+
+/*
+ * Any hit kernel tracing the active rays of queue through TREE in packets of render_settings.shadow_packet_size, see next_ray_packet(...) and
+ * traverse_bvh_packet(...), instead of one by one. ray_hits_leaf is called as ray_hits_leaf(ray in queue, first, count) and returns true if a primitive in the
+ * range of TREE.primitive_indices blocks the ray. Marks the rays found blocked.
+ *
+ * queue: rays tested, sorted
+ * TREE: tree traversed
+ * ray_hits_leaf: see above
+ */
+template <typename Ray_Leaf_Function>
+static void trace_any_hit_packets(struct Ray_Queue& queue, const struct BVH& TREE, Ray_Leaf_Function ray_hits_leaf)
+{
+    struct Ray_Packet packet;
+
+    for (size_t start = 0, end; start < queue.active.size(); start = end)
+    {
+        end = next_ray_packet(queue, start, render_settings.shadow_packet_size, packet);
+        traverse_bvh_packet(TREE, packet, [&](const unsigned int RAY, const unsigned int FIRST, const unsigned int COUNT)
+        {
+            if (!ray_hits_leaf(queue.active[start + RAY], FIRST, COUNT))
+                return false;
+            queue.hits[queue.active[start + RAY]] = 1;
+            return true;
+        });
+    }
+}
+
+/*
+ * Wavefront any hit kernel for the spheres, traversing sphere_bvh or sphere_grid, see traverse_spheres(...). Marks every active ray of queue that a sphere blocks.
+ * Rays go through sphere_bvh in packets of render_settings.shadow_packet_size, see trace_any_hit_packets(...), the grid is walked one ray at a time.
+ *
+ * queue: rays tested, sorted
+ */
+static void sphere_any_hit_kernel(struct Ray_Queue& queue)
+{
+    if (sphere_container.empty())
+        return;
+    if (render_settings.shadow_packet_size > 1 && !sphere_bvh.nodes.empty())
+    {
+        trace_any_hit_packets(queue, sphere_bvh, [&](const unsigned int RAY, const unsigned int FIRST, const unsigned int COUNT)
+        {
+            const float MINIMUM = queue.minimum_distances[RAY], MAXIMUM = queue.maximum_distances[RAY];
+            float roots [2][4];
+            unsigned int root_counts [4];
+
+            for (unsigned int batch = FIRST; batch < FIRST + COUNT; batch += 4)
+            {
+                sphere_leaf_roots(sphere_leaves, batch, &queue.origins[RAY * ARRAY_SIZE], &queue.directions[RAY * ARRAY_SIZE], roots, root_counts);
+                for (unsigned int i = 0; i < 4 && batch + i < FIRST + COUNT; ++i)
+                    for (unsigned int j = 0; j < root_counts[i]; ++j)
+                        if (MINIMUM < roots[j][i] && roots[j][i] < MAXIMUM)
+                            return true;
+            }
+            return false;
+        });
+        return;
+    }
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+        const float * ORIGIN = &queue.origins[RAY * ARRAY_SIZE], * DIRECTION = &queue.directions[RAY * ARRAY_SIZE];
+        const float MINIMUM = queue.minimum_distances[RAY], MAXIMUM = queue.maximum_distances[RAY];
+
+        traverse_spheres(ORIGIN, DIRECTION, MINIMUM, MAXIMUM, nullptr, [&](const unsigned int, const unsigned int ROOT_COUNT, const float ROOTS [2])
+        {
+            for (unsigned int j = 0; j < ROOT_COUNT; ++j)
+                if (MINIMUM < ROOTS[j] && ROOTS[j] < MAXIMUM)
+                    queue.hits[RAY] = 1;
+            return queue.hits[RAY] != 0;
+        });
+    }
+}
+
+/*
+ * Wavefront any hit kernel for the mesh, traversing mesh_bvh. Marks every active ray of queue that a triangle blocks. Rays go through the tree in packets of
+ * render_settings.shadow_packet_size, see trace_any_hit_packets(...).
+ *
+ * queue: rays tested, sorted
+ */
+static void triangle_any_hit_kernel(struct Ray_Queue& queue)
+{
+    if (!mesh_instance.active)
+        return;
+    if (render_settings.shadow_packet_size > 1)
+    {
+        trace_any_hit_packets(queue, mesh_bvh, [&](const unsigned int RAY, const unsigned int FIRST, const unsigned int COUNT)
+        {
+            float distances [TRIANGLE_BATCH_SIZE];
+
+            for (unsigned int batch = FIRST; batch < FIRST + COUNT; batch += TRIANGLE_BATCH_SIZE)
+            {
+                const int HITS = triangle_leaf_hits(batch, &queue.origins[RAY * ARRAY_SIZE], &queue.directions[RAY * ARRAY_SIZE], queue.maximum_distances[RAY], distances);
+
+                for (unsigned int i = 0; i < TRIANGLE_BATCH_SIZE && batch + i < FIRST + COUNT; ++i)
+                    if ((HITS >> i & 1) != 0 && queue.minimum_distances[RAY] < distances[i])
+                        return true;
+            }
+            return false;
+        });
+        return;
+    }
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+        const float * ORIGIN = &queue.origins[RAY * ARRAY_SIZE], * DIRECTION = &queue.directions[RAY * ARRAY_SIZE];
+        const float MINIMUM = queue.minimum_distances[RAY], MAXIMUM = queue.maximum_distances[RAY];
+
+        traverse_triangles(ORIGIN, DIRECTION, MINIMUM, MAXIMUM, nullptr, [&](const unsigned int, const float DISTANCE)
+        {
+            if (MINIMUM < DISTANCE)
+                queue.hits[RAY] = 1;
+            return queue.hits[RAY] != 0;
+        });
+    }
+}
+
+/*
+ * Wavefront closest hit kernel for plane_instance, see closest_intersection(...). Records the plane as the closest hit of every active ray of queue that hits it
+ * closer than anything the ray hit so far.
+ *
+ * queue: rays tested, sorted
+ */
+static void plane_closest_hit_kernel(struct Ray_Queue& queue)
+{
+    float distance;
+
+    if (!plane_instance.active)
+        return;
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+
+        if (plane_distance(plane_instance, &queue.origins[RAY * ARRAY_SIZE], &queue.directions[RAY * ARRAY_SIZE], distance) &&
+            queue.minimum_distances[RAY] < distance && distance < queue.maximum_distances[RAY])
+        {
+            queue.maximum_distances[RAY] = distance;
+            queue.hits[RAY] = RAY_HIT_PLANE;
+        }
+    }
+}
+
+/*
+ * Wavefront closest hit kernel for the spheres, traversing sphere_bvh or sphere_grid, see traverse_spheres(...). Records the closest sphere each active ray of
+ * queue hits, if it is closer than anything the ray hit so far. Rays are traversed one at a time in sort order, so rays going the same way visit the same nodes
+ * one after another, and each picks the sphere closest_intersection(...) would.
+ *
+ * queue: rays tested, sorted
+ */
+static void sphere_closest_hit_kernel(struct Ray_Queue& queue)
+{
+    if (sphere_container.empty())
+        return;
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+        const float * ORIGIN = &queue.origins[RAY * ARRAY_SIZE], * DIRECTION = &queue.directions[RAY * ARRAY_SIZE];
+        const float MINIMUM = queue.minimum_distances[RAY];
+        float smallest = queue.maximum_distances[RAY];//also bounds the traversal
+        unsigned int closest = 0;
+
+        traverse_spheres(ORIGIN, DIRECTION, MINIMUM, smallest, nullptr, [&](const unsigned int INDEX, const unsigned int ROOT_COUNT, const float ROOTS [2])
+        {
+            for (unsigned int j = 0; j < ROOT_COUNT; ++j)
+                if (MINIMUM < ROOTS[j] && ROOTS[j] < smallest)
+                {
+                    smallest = ROOTS[j];
+                    closest = INDEX;
+                }
+            return false;
+        });
+        if (MINIMUM < smallest && smallest < queue.maximum_distances[RAY])
+        {
+            queue.maximum_distances[RAY] = smallest;
+            queue.hits[RAY] = RAY_HIT_SPHERE;
+            queue.hit_primitives[RAY] = closest;
+        }
+    }
+}
+
+/*
+ * Wavefront closest hit kernel for the mesh, traversing mesh_bvh, see traverse_triangles(...). Records the closest triangle each active ray of queue hits, if it
+ * is closer than anything the ray hit so far, the same way as sphere_closest_hit_kernel(...).
+ *
+ * queue: rays tested, sorted
+ */
+static void triangle_closest_hit_kernel(struct Ray_Queue& queue)
+{
+    if (!mesh_instance.active)
+        return;
+    for (size_t i = 0; i < queue.active.size(); ++i)
+    {
+        const unsigned int RAY = queue.active[i];
+        const float * ORIGIN = &queue.origins[RAY * ARRAY_SIZE], * DIRECTION = &queue.directions[RAY * ARRAY_SIZE];
+        const float MINIMUM = queue.minimum_distances[RAY];
+        float smallest = queue.maximum_distances[RAY];//also bounds the traversal
+        unsigned int closest = 0;
+
+        traverse_triangles(ORIGIN, DIRECTION, MINIMUM > 0.0f ? MINIMUM : 0.0f, smallest, nullptr, [&](const unsigned int TRIANGLE, const float DISTANCE)
+        {
+            if (MINIMUM < DISTANCE && DISTANCE < smallest)
+            {
+                smallest = DISTANCE;
+                closest = TRIANGLE;
+            }
+            return false;
+        });
+        if (-1.0f < smallest && smallest < queue.maximum_distances[RAY])
+        {
+            queue.maximum_distances[RAY] = smallest;
+            queue.hits[RAY] = RAY_HIT_TRIANGLE;
+            queue.hit_primitives[RAY] = closest;
+        }
+    }
+}
+
+/*
+ * Works out the object, point and normal of a ray's hit from what it hit and how far along, the way closest_intersection(...) does.
+ *
+ * KIND: what was hit
+ * PRIMITIVE: which sphere or triangle was hit, see Ray_Hit
+ * RAY_ORIGIN: origin of the ray
+ * hit: surface hit whose distance and direction are already set, hit.object is set to nullptr if nothing was hit
+ */
+static void primitive_surface_hit(const enum Ray_Hit KIND, const unsigned int PRIMITIVE, const float RAY_ORIGIN [ARRAY_SIZE], struct Surface_Hit& hit)
+{
+    unsigned int i;
+
+    if (KIND == RAY_HIT_NOTHING)
+        hit.object = nullptr;
+    else if (KIND == RAY_HIT_PLANE)
+    {
+        hit.object = &plane_instance;
+        for (i = 0; i < ARRAY_SIZE; ++i)
+        {
+            hit.point[i] = hit.distance * hit.direction[i] + RAY_ORIGIN[i];
+            hit.normal[i] = plane_instance.normal[i];
+        }
+    }
+    else if (KIND == RAY_HIT_SPHERE)
+    {
+        hit.object = &sphere_container[PRIMITIVE];
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            hit.normal[i] = ((hit.point[i] = hit.distance * hit.direction[i] + RAY_ORIGIN[i]) - sphere_container[PRIMITIVE].position[i]) / sphere_container[PRIMITIVE].radius;
+    }
+    else
+    {
+        hit.object = &mesh_instance;
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            hit.point[i] = hit.distance * hit.direction[i] + RAY_ORIGIN[i];
+        mesh_triangle_normal(PRIMITIVE * 3, hit.normal);//3 vertices make a triangle
+    }
+}
+
+/*
+ * Traces a ray, finding what it hits without any shading.
+ *
+ * RAY_ORIGIN: origin of the ray
+ * RAY_DIRECTION: normalized direction of the ray
+ * MINIMUM_DISTANCE, CANDIDATES: see closest_intersection(...)
+ * hit: where what was hit is stored, hit.object is nullptr if nothing was
+ */
+static void trace_ray(const float RAY_ORIGIN [ARRAY_SIZE], const float RAY_DIRECTION [ARRAY_SIZE], const float MINIMUM_DISTANCE, const struct Region_Candidates * CANDIDATES,
+                      struct Surface_Hit& hit)
+{
+    const std::pair<const struct Object_Light_Properties *, float> PLACEHOLDER = closest_intersection(RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, CANDIDATES, hit.point, hit.normal);
+
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        hit.direction[i] = RAY_DIRECTION[i];
+    hit.object = PLACEHOLDER.first;
+    hit.distance = PLACEHOLDER.second;
+}
+
+/*
+ * Traces a single primary ray from the camera through a point on the image plane, finding what it hits without any shading.
+ *
+ * RAY_TARGET: point on the image plane the ray goes through, in the same coordinates as the pixel offsets
+ * CANDIDATES: what the region RAY_TARGET is in can see, see cull_region_primitives(...), nullptr to test every primitive
+ * hit: where what was hit is stored, hit.object is nullptr if nothing was
+ */
+static void trace_visibility(const float RAY_TARGET [ARRAY_SIZE], const struct Region_Candidates * CANDIDATES, struct Surface_Hit& hit)
+{
+    float ray_direction [ARRAY_SIZE];
+
+    create_normailized_ray_direction(image_plane.adjusted_camera_position, RAY_TARGET, ray_direction);
+    trace_ray(camera_instance.position, ray_direction, -1.0f, CANDIDATES, hit);
+    #ifdef DEBUG_3_MISS
+        if (hit.object == nullptr)//no intersection found for given ray
+            cerr << "No intersection for ray target {x, y} {" << RAY_TARGET[0] << ", " << RAY_TARGET[1] << "}" << endl;
+    #endif
+}
+
+/*
+ * Calculates the ray from an intersection point towards a light.
+ *
+ * INTERSECTION_POINT: origin of the light ray
+ * LIGHT_INDEX: light in light_container
+ * light_ray_direction: where the normalized direction towards the light is stored
+ * scalar_to_light: where the scalar to the light is stored, acts as an upper bound for blocking intersections
+ */
+static void light_ray(const float INTERSECTION_POINT [ARRAY_SIZE], const unsigned int LIGHT_INDEX, float light_ray_direction [ARRAY_SIZE], float& scalar_to_light)
+{
+    create_normailized_ray_direction(INTERSECTION_POINT, light_container[LIGHT_INDEX].position, light_ray_direction);//new direction for new light
+    for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+        if ((scalar_to_light = light_container[LIGHT_INDEX].position[j] / light_ray_direction[j]) > ZERO_TOLERANCE)//To make sure a 0 value in a given direction does not screw over calculations.
+            break;//Exit when a positive value has been found as it is a scalar thus should be the same for all the others that are not 0.
+}
+
+/*
+ * Smooth falloff of a light with a range, (1 - d^2 / range^2)^2, which is 1 at the light and reaches 0, with a flat slope, at the range.
+ *
+ * DISTANCE_SQUARED: squared distance from the light
+ * RANGE: range of the light, more than 0
+ */
+static float range_falloff(const float DISTANCE_SQUARED, const float RANGE)
+{
+    const float FRACTION = DISTANCE_SQUARED / (RANGE * RANGE);
+
+    return FRACTION >= 1.0f ? 0.0f : (1.0f - FRACTION) * (1.0f - FRACTION);
+}
+
+/*
+ * How much of a light reaches a point, see range_falloff(...). Exactly 1 for lights without a range, so they are shaded as always.
+ *
+ * LIGHT: light in question
+ * POINT: point being lit
+ */
+static float light_attenuation(const struct Light& LIGHT, const float POINT [ARRAY_SIZE])
+{
+    float distance_squared = 0.0f;
+
+    if (LIGHT.range <= 0.0f)
+        return 1.0f;
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        distance_squared += (POINT[i] - LIGHT.position[i]) * (POINT[i] - LIGHT.position[i]);
+    return range_falloff(distance_squared, LIGHT.range);
+}
+
+/*
+ * Hashes a pixel and sample index into a pseudo random value in [0, 1). Used to jitter samples within their stratum, being a pure function of its inputs keeps the pattern deterministic and free of shared state.
+ *
+ * X, Y: pixel being sampled
+ * SAMPLE: index of the value wanted for the pixel
+ */
+static float sample_jitter(const unsigned int X, const unsigned int Y, const unsigned int SAMPLE)
+{
+    unsigned int hash = (X * 73856093u) ^ (Y * 19349663u) ^ (SAMPLE * 83492791u);
+    hash ^= hash >> 16;
+    hash *= 0x7feb352du;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68bu;
+    hash ^= hash >> 16;
+    return (hash >> 8) * (1.0f / 16777216.0f);//top 24 bits, exactly representable as float
+}
+
+/*
+ * Whether a light is an area light, see area_light_visibility(...).
+ *
+ * LIGHT: light in question
+ */
+static bool area_light(const struct Light& LIGHT)
+{
+    return LIGHT.radius > 0.0f || dot_product(LIGHT.edge_u, LIGHT.edge_u) > 0.0f || dot_product(LIGHT.edge_v, LIGHT.edge_v) > 0.0f;
+}
+
+/*
+ * Picks a point on an area light, uniformly within a stratum of a square grid. Spherical lights are sampled over the disc they show INTERSECTION_POINT, with the
+ * concentric mapping so strata stay compact, rectangular ones over their area.
+ *
+ * INTERSECTION_POINT: point the light is seen from
+ * LIGHT: area light
+ * U, V: position in [0, 1) of the square being mapped
+ * sample_point: where the point on the light is stored
+ */
+static void area_light_point(const float INTERSECTION_POINT [ARRAY_SIZE], const struct Light& LIGHT, const float U, const float V, float sample_point [ARRAY_SIZE])
+{
+    unsigned int i;
+
+    if (LIGHT.radius <= 0.0f)
+    {
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            sample_point[i] = LIGHT.position[i] + (U - 0.5f) * LIGHT.edge_u[i] + (V - 0.5f) * LIGHT.edge_v[i];
+        return;
+    }
+    {
+        const float A = 2.0f * U - 1.0f, B = 2.0f * V - 1.0f, QUARTER_PI = 0.785398163f;
+        float axis [ARRAY_SIZE], tangent [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f}, bitangent [ARRAY_SIZE], radius, angle, length;
+
+        if (A * A > B * B)
+        {
+            radius = A;
+            angle = QUARTER_PI * (B / A);
+        }
+        else
+        {
+            radius = B;
+            angle = B != 0.0f ? 2.0f * QUARTER_PI - QUARTER_PI * (A / B) : 0.0f;
+        }
+        create_normailized_ray_direction(INTERSECTION_POINT, LIGHT.position, axis);
+        tangent[fabs(axis[0]) < 0.9f ? 0 : 1] = 1.0f;//any vector not parallel to axis
+        cross_product(axis, tangent, bitangent);
+        length = sqrt(dot_product(bitangent, bitangent));
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            bitangent[i] /= length;
+        cross_product(bitangent, axis, tangent);
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            sample_point[i] = LIGHT.position[i] + LIGHT.radius * radius * (static_cast<float>(cos(angle)) * tangent[i] + static_cast<float>(sin(angle)) * bitangent[i]);
+    }
+}
+
+/*
+ * Fraction of an area light that reaches a point, from stratified shadow rays. The corner strata are traced first, and only if they disagree, so the point is in
+ * a penumbra, are the rest of the strata traced as well. Fully lit and fully shadowed points thus cost 4 rays, and the cost of soft shadows grows with the area
+ * of their penumbrae instead of the image. Jitter is a hash of the point, so the noise is the same every frame.
+ *
+ * INTERSECTION_POINT: point being lit
+ * LIGHT_INDEX: area light in light_container
+ * statistics: where the shadow rays and penumbra points are counted
+ */
+static float area_light_visibility(const float INTERSECTION_POINT [ARRAY_SIZE], const unsigned int LIGHT_INDEX, struct Sampling_Statistics& statistics)
+{
+    const unsigned int SAMPLES_PER_AXIS = static_cast<unsigned int>(sqrt(static_cast<float>(render_settings.light_samples))) > 1 ?
+                                          static_cast<unsigned int>(sqrt(static_cast<float>(render_settings.light_samples))) : 1;
+    const unsigned int LAST = SAMPLES_PER_AXIS - 1;
+    unsigned int point_bits [ARRAY_SIZE], reaching = 0, traced = 0;
+
+    memcpy(point_bits, INTERSECTION_POINT, sizeof(point_bits));
+    //traces the shadow ray of stratum {COLUMN, ROW}, returns whether it reaches the light
+    auto sample_reaches = [&](const unsigned int COLUMN, const unsigned int ROW)
+    {
+        const unsigned int STRATUM = ROW * SAMPLES_PER_AXIS + COLUMN;
+        float sample_point [ARRAY_SIZE], direction [ARRAY_SIZE], distance = 0.0f;
+
+        area_light_point(INTERSECTION_POINT, light_container[LIGHT_INDEX], (COLUMN + sample_jitter(point_bits[0] ^ LIGHT_INDEX, point_bits[1], STRATUM * 2)) / SAMPLES_PER_AXIS,
+                         (ROW + sample_jitter(point_bits[2] ^ LIGHT_INDEX, point_bits[1], STRATUM * 2 + 1)) / SAMPLES_PER_AXIS, sample_point);
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            distance += (sample_point[i] - INTERSECTION_POINT[i]) * (sample_point[i] - INTERSECTION_POINT[i]);
+        create_normailized_ray_direction(INTERSECTION_POINT, sample_point, direction);
+        ++traced;
+        return !light_blocked(INTERSECTION_POINT, direction, sqrt(distance));
+    };
+
+    ++statistics.area_light_points;
+    if (SAMPLES_PER_AXIS < 2)
+        reaching = sample_reaches(0, 0);
+    else
+    {
+        reaching = sample_reaches(0, 0) + sample_reaches(LAST, 0) + sample_reaches(0, LAST) + sample_reaches(LAST, LAST);
+        if (reaching % 4 != 0)//penumbra
+        {
+            ++statistics.penumbra_points;
+            for (unsigned int row = 0; row < SAMPLES_PER_AXIS; ++row)
+                for (unsigned int column = 0; column < SAMPLES_PER_AXIS; ++column)
+                    if ((row != 0 && row != LAST) || (column != 0 && column != LAST))//not a corner
+                        reaching += sample_reaches(column, row);
+        }
+    }
+    statistics.area_shadow_rays += traced;
+    return static_cast<float>(reaching) / traced;
+}
+
+/*
+ * Traces a shadow ray per point light from a surface hit and records which lights reach it. Area lights are left out, their bits stay clear, as they are only
+ * partly blocked, see area_light_visibility(...), and so are lights the hit is out of range of.
+ *
+ * HIT: surface hit, must have hit an object
+ * LIGHTS: lights that may reach HIT, see cull_tile_lights(...), nullptr for every light
+ * light_mask: one bit per light, bit i of word i / 32, set when light i is not blocked
+ */
+static void compute_light_mask(const struct Surface_Hit& HIT, const std::vector<unsigned int> * LIGHTS, unsigned int * light_mask)
+{
+    const size_t LIGHT_COUNT = LIGHTS != nullptr ? LIGHTS -> size() : light_container.size();
+    float light_ray_direction [ARRAY_SIZE], scalar_to_light;
+
+    for (unsigned int i = 0; i < (light_container.size() + 31) / 32; ++i)
+        light_mask[i] = 0;
+    for (size_t light = 0; light < LIGHT_COUNT; ++light)
+    {
+        const unsigned int i = LIGHTS != nullptr ? (*LIGHTS)[light] : static_cast<unsigned int>(light);
+
+        if (area_light(light_container[i]) || light_attenuation(light_container[i], HIT.point) <= 0.0f)
+            continue;
+        light_ray(HIT.point, i, light_ray_direction, scalar_to_light);
+        if (!light_blocked(HIT.point, light_ray_direction, scalar_to_light))
+            light_mask[i >> 5] |= 1u << (i & 31);
+    }
+}
+
+/*
+ * Adds the Phong diffuse and specular illumination of one light to a surface hit's colour.
+ *
+ * HIT: surface hit, must have hit an object
+ * LIGHT_RAY_DIRECTION: normalized direction from HIT.point towards the light
+ * DIFFUSE_COLOUR, SPECULAR_COLOUR: colours of the light
+ * VISIBILITY: fraction of the light that is not blocked
+ * colour: where the illumination is added
+ */
+static void add_light_colour(const struct Surface_Hit& HIT, const float LIGHT_RAY_DIRECTION [ARRAY_SIZE], const float DIFFUSE_COLOUR [ARRAY_SIZE],
+                             const float SPECULAR_COLOUR [ARRAY_SIZE], const float VISIBILITY, float colour [ARRAY_SIZE])
+{
+    unsigned int j;//for loop counter
+    float diffuse_specular_dot_product [2] = {dot_product(LIGHT_RAY_DIRECTION, HIT.normal), 0.0f};//for clamping, also to not repeat calculations
+
+    //clamp
+    if (diffuse_specular_dot_product[0] < 0.0f)
+        diffuse_specular_dot_product[0] = 0.0f;
+    {
+        const float DOUBLE_DIFFUSE_DOT_PRODUCT = 2.0f * diffuse_specular_dot_product[0];
+        for (j = 0; j < ARRAY_SIZE; ++j)
+            diffuse_specular_dot_product[1] += (DOUBLE_DIFFUSE_DOT_PRODUCT * HIT.normal[j] - LIGHT_RAY_DIRECTION[j]) * -HIT.direction[j];//minus on direction is to negate/reverse direction
+    }
+    //clamp
+    if (diffuse_specular_dot_product[1] < 0.0f)
+        diffuse_specular_dot_product[1] = 0.0f;
+    //diffuse + specular
+    for (j = 0; j < ARRAY_SIZE; ++j)
+    {
+        const float LIGHT_COLOUR = HIT.object -> diffuse_colour[j] * diffuse_specular_dot_product[0] * DIFFUSE_COLOUR[j] +
+        pow(diffuse_specular_dot_product[1], HIT.object -> shininess) * HIT.object -> specular_colour[j] * SPECULAR_COLOUR[j];
+        colour[j] += VISIBILITY < 1.0f ? VISIBILITY * LIGHT_COLOUR : LIGHT_COLOUR;//soft shadows of area lights
+    }
+}
+
+/*
+ * Calculates the Phong illumination of a surface hit.
+ *
+ * HIT: surface hit, black if nothing was hit
+ * LIGHTS: lights that may reach HIT, see cull_tile_lights(...), nullptr for every light, or every light not in light_tree with a light tree
+ * light_reaches: called as light_reaches(light index, light ray direction, scalar to light), fraction of the light that is not blocked, 1 or 0 for point lights,
+ *                only for lights HIT is in range of
+ * colour: where the resulting {R, G, B} is stored, not clamped, that is left to the frame buffer
+ */
+template <typename Visibility_Function>
+static void shade_hit(const struct Surface_Hit& HIT, const std::vector<unsigned int> * LIGHTS, Visibility_Function light_reaches, float colour [ARRAY_SIZE])
+{
+    unsigned int i;//outer for loop counter
+
+    for (i = 0; i < ARRAY_SIZE; ++i)
+        colour[i] = 0.0f;
+    if (HIT.object == nullptr)
+        return;
+
+    //calculates illumination
+    {
+        const bool LIGHT_TREE = render_settings.light_tree_tolerance > 0.0f;//point lights are shaded by add_light_cut(...), only the rest are looped over
+        const size_t LIGHT_COUNT = LIGHTS != nullptr ? LIGHTS -> size() : LIGHT_TREE ? light_tree.excluded_lights.size() : light_container.size();
+        float scalar_to_light;//calculate scalar to current light, acts as an upper bound
+        float light_ray_direction [ARRAY_SIZE];//note points towards light from ray origin
+
+        for (size_t light = 0; light < LIGHT_COUNT; ++light)
+        {
+            //initialize loop specific values
+            i = LIGHTS != nullptr ? (*LIGHTS)[light] : LIGHT_TREE ? light_tree.excluded_lights[light] : static_cast<unsigned int>(light);
+            const float ATTENUATION = light_attenuation(light_container[i], HIT.point);
+            if (ATTENUATION <= 0.0f)//out of range
+                continue;
+            light_ray(HIT.point, i, light_ray_direction, scalar_to_light);
+
+            //light ray intersection test
+            const float VISIBILITY = light_reaches(i, light_ray_direction, scalar_to_light) * ATTENUATION;
+            if (VISIBILITY <= 0.0f)
+                continue;
+
+            //illumination, has to not be skipped (continue) to be run
+            #ifdef DEBUG_4_NOT_BLOCKED
+                cerr << "Intersection point {" << HIT.point[0] << ", " << HIT.point[1] << ", " << HIT.point[2] << "} is illuminated by light_container[" << i << "]." << endl;
+            #endif
+            add_light_colour(HIT, light_ray_direction, light_container[i].diffuse_colour, light_container[i].specular_colour, VISIBILITY, colour);
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE; ++i)
+    {
+        colour[i] += HIT.object -> ambient_colour[i];//add global ambient colour
+        #ifdef DEBUG_4_NOT_BLOCKED
+            cerr << "Intersection point {" << HIT.point[0] << ", " << HIT.point[1] << ", " << HIT.point[2] << "}, channel " << i << ", value: " << colour[i] << endl;
+        #endif
+    }
+}
+
+//Entry of a light cut, a node of light_tree shaded as if all its lights were at its representative, or a single light.
+struct Light_Cut_Entry
+{
+    float bound;//upper bound on the light the entry's lights can add to any channel, 0 for single lights, which are exact
+    unsigned int node;//node of light_tree, NO_LIGHT_CUT_NODE for single lights
+    unsigned int representative;//light shaded, index in light_container
+    float visibility;//whether the representative reaches the point, 1 or 0, 0 when it is out of range
+    float estimate [ARRAY_SIZE];//light the entry adds
+};
+
+/*
+ * Builds light_tree over the point lights of light_container and prints how long it took. Area lights are left out, they are always shaded one by one.
+ */
+static void update_light_tree()
+{
+    const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+    std::vector<unsigned int> point_lights;
+
+    light_tree.excluded_lights.clear();
+    for (unsigned int i = 0; i < light_container.size(); ++i)
+        (area_light(light_container[i]) ? light_tree.excluded_lights : point_lights).push_back(i);
+    build_light_tree(light_tree, light_container, point_lights);
+    std::cout << "Light tree over " << point_lights.size() << " lights built in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - START).count()
+              << "ms, " << light_tree.tree.nodes.size() << " nodes." << endl;
+}
+
+/*
+ * Adds the illumination of light_tree's lights to a surface hit, lightcuts style. The cut starts at the root, shaded as one light of the summed colours of every
+ * light at the position of the brightest, and the entry whose error could be largest is split into its children until no entry's bound on the light it adds is
+ * over render_settings.light_tree_tolerance of the hit's colour, or the cut holds LIGHT_CUT_LIMIT entries. The bound is the summed colours times the largest
+ * diffuse and specular factors anywhere in the node's box, and the falloff of its largest range at the box's nearest point, so boxes behind the surface, far off
+ * the highlight or out of range stop refining early. Each entry traces one shadow ray, unless its representative is out of range, and a child that shares its
+ * parent's representative reuses its parent's, so the cost grows with the size of the cut, not the number of lights.
+ *
+ * HIT: surface hit, must have hit an object
+ * colour: where the illumination is added
+ * statistics: where the cut sizes and shadow rays are counted
+ */
+static void add_light_cut(const struct Surface_Hit& HIT, float colour [ARRAY_SIZE], struct Sampling_Statistics& statistics)
+{
+    struct Light_Cut_Entry cut [LIGHT_CUT_LIMIT];
+    float reflected_view [ARRAY_SIZE], total [ARRAY_SIZE], ambient = 0.0f;
+    const float VIEW_NORMAL_DOT_PRODUCT = -dot_product(HIT.direction, HIT.normal);
+    unsigned int size = 0, i;
+
+    if (light_tree.tree.nodes.empty())
+        return;
+    for (i = 0; i < ARRAY_SIZE; ++i)
+    {
+        reflected_view[i] = 2.0f * VIEW_NORMAL_DOT_PRODUCT * HIT.normal[i] + HIT.direction[i];//view direction mirrored about the normal, where highlights are
+        total[i] = 0.0f;
+        ambient = std::max(ambient, HIT.object -> ambient_colour[i]);
+    }
+
+    //fills in an entry, reusing the parent's shadow ray when the representative is the same
+    auto evaluate = [&](struct Light_Cut_Entry& entry, const unsigned int PARENT_REPRESENTATIVE, const float PARENT_VISIBILITY)
+    {
+        const float * DIFFUSE_COLOUR = entry.node != NO_LIGHT_CUT_NODE ? &light_tree.diffuse_sums[entry.node * ARRAY_SIZE] : light_container[entry.representative].diffuse_colour;
+        const float * SPECULAR_COLOUR = entry.node != NO_LIGHT_CUT_NODE ? &light_tree.specular_sums[entry.node * ARRAY_SIZE] : light_container[entry.representative].specular_colour;
+        const float ATTENUATION = light_attenuation(light_container[entry.representative], HIT.point);
+        float light_ray_direction [ARRAY_SIZE], scalar_to_light;
+
+        entry.bound = 0.0f;
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            entry.estimate[j] = 0.0f;
+        if (entry.node != NO_LIGHT_CUT_NODE)
+        {
+            const struct Bounding_Box& BOX = light_tree.tree.nodes[entry.node].bounds;
+            const float DIFFUSE_BOUND = cosine_bound(BOX, HIT.point, HIT.normal);
+            const float SPECULAR_COSINE = std::max(cosine_bound(BOX, HIT.point, reflected_view), cosine_bound(BOX, HIT.point, HIT.direction));//the latter for lights behind the surface
+            const float SPECULAR_BOUND = SPECULAR_COSINE <= 0.0f ? 0.0f : HIT.object -> shininess > 0.0f ? static_cast<float>(pow(SPECULAR_COSINE, HIT.object -> shininess)) : 1.0f;
+            const float RANGE_BOUND = light_tree.ranges[entry.node] < FLT_MAX ? range_falloff(box_distance_squared(BOX, HIT.point), light_tree.ranges[entry.node]) : 1.0f;
+
+            for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                entry.bound = std::max(entry.bound, HIT.object -> diffuse_colour[j] * DIFFUSE_COLOUR[j] * DIFFUSE_BOUND + HIT.object -> specular_colour[j] * SPECULAR_COLOUR[j] * SPECULAR_BOUND);
+            entry.bound *= RANGE_BOUND;
+            if (entry.bound <= 0.0f)//nothing in the box can light the point
+                return;
+        }
+        entry.visibility = 0.0f;
+        if (ATTENUATION > 0.0f)//otherwise the representative is out of range and the estimate stays 0
+        {
+            light_ray(HIT.point, entry.representative, light_ray_direction, scalar_to_light);
+            if (entry.representative == PARENT_REPRESENTATIVE)
+                entry.visibility = PARENT_VISIBILITY;
+            else
+            {
+                entry.visibility = light_blocked(HIT.point, light_ray_direction, scalar_to_light) ? 0.0f : 1.0f;
+                ++statistics.light_cut_shadow_rays;
+            }
+        }
+        if (entry.visibility > 0.0f)
+            add_light_colour(HIT, light_ray_direction, DIFFUSE_COLOUR, SPECULAR_COLOUR, entry.visibility * ATTENUATION, entry.estimate);
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            total[j] += entry.estimate[j];
+    };
+    auto smaller_bound = [](const struct Light_Cut_Entry& A, const struct Light_Cut_Entry& B) {return A.bound < B.bound;};
+
+    cut[size].node = 0;
+    cut[size].representative = light_tree.representatives[0];
+    evaluate(cut[size++], NO_LIGHT_CUT_NODE, 0.0f);
+    while (size + BVH_LEAF_SIZE - 1 <= LIGHT_CUT_LIMIT && cut[0].bound > 0.0f &&
+           cut[0].bound > render_settings.light_tree_tolerance * (ambient + std::max(total[0], std::max(total[1], total[2]))))
+    {
+        const struct Light_Cut_Entry PARENT = cut[0];
+        const struct BVH_Node& NODE = light_tree.tree.nodes[PARENT.node];
+
+        std::pop_heap(cut, cut + size--, smaller_bound);
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            total[i] -= PARENT.estimate[i];
+        for (unsigned int child = 0; child < (NODE.count > 0 ? NODE.count : 2); ++child)
+        {
+            struct Light_Cut_Entry& entry = cut[size];
+
+            entry.node = NODE.count > 0 ? NO_LIGHT_CUT_NODE : NODE.first + child;
+            entry.representative = NODE.count > 0 ? light_tree.lights[light_tree.tree.primitive_indices[NODE.first + child]] : light_tree.representatives[NODE.first + child];
+            evaluate(entry, PARENT.representative, PARENT.visibility);
+            std::push_heap(cut, cut + ++size, smaller_bound);
+        }
+    }
+    for (i = 0; i < size; ++i)
+        for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+            colour[j] += cut[i].estimate[j];
+    statistics.light_cut_entries += size;
+    ++statistics.light_cut_points;
+}
+
+/*
+ * Calculates the Phong illumination of a surface hit whose shadow rays were already traced. Area lights are not in the mask, their shadow rays are traced here.
+ *
+ * HIT: surface hit
+ * LIGHTS: see shade_hit(...)
+ * LIGHT_MASK: which point lights reach HIT, see compute_light_mask(...)
+ * colour: where the resulting {R, G, B} is stored
+ * statistics: where area light shadow rays are counted
+ */
+static void shade_masked_hit(const struct Surface_Hit& HIT, const std::vector<unsigned int> * LIGHTS, const unsigned int * LIGHT_MASK, float colour [ARRAY_SIZE],
+                             struct Sampling_Statistics& statistics)
+{
+    shade_hit(HIT, LIGHTS, [&](const unsigned int LIGHT_INDEX, const float *, const float)
+    {
+        if (area_light(light_container[LIGHT_INDEX]))
+            return area_light_visibility(HIT.point, LIGHT_INDEX, statistics);
+        return (LIGHT_MASK[LIGHT_INDEX >> 5] >> (LIGHT_INDEX & 31) & 1u) != 0 ? 1.0f : 0.0f;
+    }, colour);
+}
+
+/*
+ * Calculates the Phong illumination of a surface hit, tracing its shadow rays. With a light tree its point lights are shaded through a light cut instead.
+ *
+ * HIT: surface hit
+ * LIGHTS: see shade_hit(...)
+ * colour: where the resulting {R, G, B} is stored
+ * statistics: where area light shadow rays are counted
+ */
+static void shade_traced_hit(const struct Surface_Hit& HIT, const std::vector<unsigned int> * LIGHTS, float colour [ARRAY_SIZE], struct Sampling_Statistics& statistics)
+{
+    const bool LIGHT_TREE = render_settings.light_tree_tolerance > 0.0f;
+
+    shade_hit(HIT, LIGHTS, [&](const unsigned int LIGHT_INDEX, const float LIGHT_RAY_DIRECTION [ARRAY_SIZE], const float SCALAR_TO_LIGHT)
+    {
+        if (area_light(light_container[LIGHT_INDEX]))
+            return area_light_visibility(HIT.point, LIGHT_INDEX, statistics);
+        return light_blocked(HIT.point, LIGHT_RAY_DIRECTION, SCALAR_TO_LIGHT) ? 0.0f : 1.0f;
+    }, colour);
+    if (LIGHT_TREE && HIT.object != nullptr)
+        add_light_cut(HIT, colour, statistics);
+}
+
+/*
+ * Takes a secondary ray out of the frame's budget. Returns false if the budget is used up.
+ */
+static bool take_secondary_ray()
+{
+    unsigned long long left;
+
+    if (render_settings.ray_budget == 0)//unlimited
+        return true;
+    left = secondary_rays_left.load(std::memory_order_relaxed);
+    do
+        if (left == 0)
+            return false;
+    while (!secondary_rays_left.compare_exchange_weak(left, left - 1, std::memory_order_relaxed));
+    return true;
+}
+
+const float PRIMARY_WEIGHT [ARRAY_SIZE] = {1.0f, 1.0f, 1.0f};//weight of primary hits in add_secondary_light(...), all of their colour reaches the pixel
+
+/*
+ * Works out the secondary ray of one kind a surface hit sends, if it sends one: a mirror reflection ray if it is reflective and a refraction ray if it is transparent.
+ * Past render_settings.roulette_depth rays are continued with a probability of the largest channel of what they can still add to the pixel, and scaled up by its
+ * inverse when they are, so the image is the same on average. Total internal reflection turns refraction into reflection. Returns false if no ray is sent.
+ *
+ * HIT: surface hit being shaded, something was hit
+ * DEPTH, WEIGHT: see add_secondary_light(...)
+ * KIND: 0 for the reflection ray, 1 for the refraction ray
+ * factor: where how much of the ray's colour is added to HIT's is stored
+ * weight: where how much of the ray's colour ends up in the pixel is stored
+ * ray_direction: where the normalized direction of the ray is stored
+ * statistics: where the ray, or its being cut by the budget, is counted
+ */
+static bool secondary_ray(const struct Surface_Hit& HIT, const unsigned int DEPTH, const float WEIGHT [ARRAY_SIZE], const unsigned int KIND, float factor [ARRAY_SIZE],
+                          float weight [ARRAY_SIZE], float ray_direction [ARRAY_SIZE], struct Sampling_Statistics& statistics)
+{
+    const float * FACTOR = KIND == 0 ? HIT.object -> reflectivity : HIT.object -> transmission;
+    float normal [ARRAY_SIZE];
+    const float COSINE = -dot_product(HIT.direction, HIT.normal);//negative when leaving an object
+    const bool LEAVING = COSINE < 0.0f;
+    float largest = 0.0f, k = -1.0f, eta = 1.0f;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE; ++i)
+    {
+        factor[i] = FACTOR[i];
+        weight[i] = WEIGHT[i] * factor[i];
+        if (weight[i] > largest)
+            largest = weight[i];
+        normal[i] = LEAVING ? -HIT.normal[i] : HIT.normal[i];//facing the ray
+    }
+    if (largest <= 0.0f)
+        return false;
+    if (DEPTH >= render_settings.roulette_depth && largest < 1.0f)
+    {
+        unsigned int point_bits [ARRAY_SIZE];
+
+        memcpy(point_bits, HIT.point, sizeof(point_bits));
+        if (sample_jitter(point_bits[0] ^ point_bits[2], point_bits[1], DEPTH * 2 + KIND) >= largest)
+            return false;
+        for (i = 0; i < ARRAY_SIZE; ++i)
+        {
+            factor[i] /= largest;
+            weight[i] /= largest;
+        }
+    }
+    if (!take_secondary_ray())
+    {
+        ++statistics.budget_cut_rays;
+        return false;
+    }
+    {
+        const float COSINE_FACING = LEAVING ? -COSINE : COSINE;
+
+        if (KIND == 1)//Snell's law, k < 0 is total internal reflection
+        {
+            eta = LEAVING ? HIT.object -> refractive_index : 1.0f / HIT.object -> refractive_index;
+            k = 1.0f - eta * eta * (1.0f - COSINE_FACING * COSINE_FACING);
+        }
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            ray_direction[i] = k >= 0.0f ? eta * HIT.direction[i] + (eta * COSINE_FACING - sqrt(k)) * normal[i] : HIT.direction[i] + 2.0f * COSINE_FACING * normal[i];
+    }
+    ++statistics.secondary_rays[DEPTH];
+    return true;
+}
+
+/*
+ * Adds the light an object reflects and transmits from elsewhere in the scene to its direct illumination, tracing the rays secondary_ray(...) sends recursively,
+ * reflection first, up to render_settings.max_depth.
+ *
+ * HIT: surface hit being shaded
+ * DEPTH: number of secondary rays traced to reach HIT, 0 for primary hits
+ * WEIGHT: how much of HIT's colour ends up in the pixel, {1, 1, 1} for primary hits
+ * colour: HIT's colour so far, the secondary light is added to it
+ * statistics: where the rays traced, or cut by the budget, are counted
+ */
+static void add_secondary_light(const struct Surface_Hit& HIT, const unsigned int DEPTH, const float WEIGHT [ARRAY_SIZE], float colour [ARRAY_SIZE],
+                                struct Sampling_Statistics& statistics)
+{
+    if (HIT.object == nullptr || DEPTH >= render_settings.max_depth)
+        return;
+    for (unsigned int kind = 0; kind < 2; ++kind)//0 reflection, 1 refraction
+    {
+        float factor [ARRAY_SIZE], weight [ARRAY_SIZE], ray_direction [ARRAY_SIZE], secondary_colour [ARRAY_SIZE];
+        struct Surface_Hit secondary_hit;
+
+        if (!secondary_ray(HIT, DEPTH, WEIGHT, kind, factor, weight, ray_direction, statistics))
+            continue;
+        trace_ray(HIT.point, ray_direction, SECONDARY_RAY_BIAS, nullptr, secondary_hit);
+        shade_traced_hit(secondary_hit, nullptr, secondary_colour, statistics);//seen from elsewhere than the camera, so not culled to the tile
+        add_secondary_light(secondary_hit, DEPTH + 1, weight, secondary_colour, statistics);
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            colour[i] += factor[i] * secondary_colour[i];
+    }
+}
+
+/*
+ * Traces a single primary ray from the camera through a point on the image plane and calculates its illumination. Returns the intersected object, nullptr if nothing was hit, which also serves as the sample's object ID.
+ *
+ * RAY_TARGET: point on the image plane the ray goes through, in the same coordinates as the pixel offsets
+ * LIGHTS: lights of the tile RAY_TARGET is in, see cull_tile_lights(...)
+ * CANDIDATES: see trace_visibility(...)
+ * colour: where the resulting {R, G, B} is stored, not clamped, that is left to the frame buffer
+ * statistics: where secondary rays are counted
+ */
+static const struct Object_Light_Properties * trace_primary_ray(const float RAY_TARGET [ARRAY_SIZE], const std::vector<unsigned int> * LIGHTS, const struct Region_Candidates * CANDIDATES,
+                                                              float colour [ARRAY_SIZE], struct Sampling_Statistics& statistics)
+{
+    struct Surface_Hit hit;
+
+    trace_visibility(RAY_TARGET, CANDIDATES, hit);
+    shade_traced_hit(hit, LIGHTS, colour, statistics);
+    add_secondary_light(hit, 0, PRIMARY_WEIGHT, colour, statistics);
+    return hit.object;
+}
+
+/*
+ * Tests if a pixel's base sample differs enough from any of its 8 neighbours' to be worth supersampling. True if a neighbour hit a different object or a colour channel differs by more than render_settings.contrast_threshold.
+ *
+ * BASE_COLOURS: {R, G, B} of the base samples, row major over a WIDTH x HEIGHT window
+ * BASE_IDS: object hit by each base sample, same layout as BASE_COLOURS
+ * WIDTH, HEIGHT: size of the window
+ * X, Y: pixel being tested, relative to the window
+ */
+static bool needs_refinement(const std::vector<float>& BASE_COLOURS, const std::vector<const struct Object_Light_Properties *>& BASE_IDS, const unsigned int WIDTH, const unsigned int HEIGHT,
+                             const unsigned int X, const unsigned int Y)
+{
+    const unsigned int INDEX = Y * WIDTH + X;
+
+    for (unsigned int neighbour_y = Y > 0 ? Y - 1 : 0; neighbour_y <= Y + 1 && neighbour_y < HEIGHT; ++neighbour_y)
+        for (unsigned int neighbour_x = X > 0 ? X - 1 : 0; neighbour_x <= X + 1 && neighbour_x < WIDTH; ++neighbour_x)
+        {
+            const unsigned int NEIGHBOUR_INDEX = neighbour_y * WIDTH + neighbour_x;
+
+            if (BASE_IDS[NEIGHBOUR_INDEX] != BASE_IDS[INDEX])
+                return true;
+            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                if (fabs(BASE_COLOURS[NEIGHBOUR_INDEX * ARRAY_SIZE + i] - BASE_COLOURS[INDEX * ARRAY_SIZE + i]) > render_settings.contrast_threshold)
+                    return true;
+        }
+    return false;
+}
+
+/*
+ * Ray target of a pixel's only sample with 1 sample per pixel, its corner, as it always has been.
+ *
+ * X, Y: pixel in image coordinates
+ * ray_target: where the point on the image plane is stored
+ */
+static void pixel_corner_target(const unsigned int X, const unsigned int Y, float ray_target [ARRAY_SIZE])
+{
+    ray_target[0] = static_cast<float>(static_cast<int>(X) - static_cast<int>(image_plane.half_horizontal));//subtraction is offset
+    ray_target[1] = static_cast<float>(static_cast<int>(image_plane.half_vertical) - static_cast<int>(Y));//subtraction is offset
+    ray_target[2] = -1.0f;
+}
+
+/*
+ * Ray target of a pixel's base sample when anti-aliasing, its centre.
+ *
+ * X, Y: pixel in image coordinates
+ * ray_target: where the point on the image plane is stored
+ */
+static void pixel_centre_target(const unsigned int X, const unsigned int Y, float ray_target [ARRAY_SIZE])
+{
+    ray_target[0] = static_cast<int>(X) - static_cast<int>(image_plane.half_horizontal) + 0.5f;
+    ray_target[1] = static_cast<int>(image_plane.half_vertical) - static_cast<int>(Y) - 0.5f;
+    ray_target[2] = -1.0f;
+}
+
+/*
+ * Ray target of one of a pixel's supersamples, jittered within its stratum.
+ *
+ * X, Y: pixel in image coordinates
+ * SAMPLE: stratum, row major in a SAMPLES_PER_AXIS x SAMPLES_PER_AXIS grid
+ * SAMPLES_PER_AXIS: strata per side of the pixel
+ * ray_target: where the point on the image plane is stored
+ */
+static void supersample_target(const unsigned int X, const unsigned int Y, const unsigned int SAMPLE, const unsigned int SAMPLES_PER_AXIS, float ray_target [ARRAY_SIZE])
+{
+    const float STRATUM_SIZE = 1.0f / SAMPLES_PER_AXIS;
+
+    ray_target[0] = static_cast<int>(X) - static_cast<int>(image_plane.half_horizontal) + (SAMPLE % SAMPLES_PER_AXIS + sample_jitter(X, Y, SAMPLE << 1)) * STRATUM_SIZE;
+    ray_target[1] = static_cast<int>(image_plane.half_vertical) - static_cast<int>(Y) - (SAMPLE / SAMPLES_PER_AXIS + sample_jitter(X, Y, (SAMPLE << 1) + 1)) * STRATUM_SIZE;
+    ray_target[2] = -1.0f;
+}
+
+/*
+ * Pixels whose base samples are needed to anti-alias a region, the region plus a one pixel apron, clamped to the image.
+ *
+ * X_START, Y_START, X_END, Y_END: the region, see render_region(...)
+ */
+static struct Tile sampling_window(const unsigned int X_START, const unsigned int Y_START, const unsigned int X_END, const unsigned int Y_END)
+{
+    struct Tile window;
+
+    window.x_start = X_START > 0 ? X_START - 1 : 0;
+    window.y_start = Y_START > 0 ? Y_START - 1 : 0;
+    window.x_end = X_END < image_plane.horizontal ? X_END + 1 : image_plane.horizontal;
+    window.y_end = Y_END < image_plane.vertical ? Y_END + 1 : image_plane.vertical;
+    return window;
+}
+
+/*
+ * Culls the lights that cannot reach anything seen through a region, so shading its primary hits only loops over the rest. A light whose range sphere cannot be
+ * seen through the region, see region_sees_sphere(...), cannot light any point seen through it. Lights without a range are always kept, so without ranges
+ * nothing is culled.
+ *
+ * X_START, Y_START, X_END, Y_END: the region, see render_region(...)
+ * CANDIDATES: lights culled, nullptr for every light
+ * region_lights: where the lights left are stored, in the order of CANDIDATES
+ * statistics: where the lights before and after culling are counted
+ */
+static void cull_region_lights(const unsigned int X_START, const unsigned int Y_START, const unsigned int X_END, const unsigned int Y_END, const std::vector<unsigned int> * CANDIDATES,
+                               std::vector<unsigned int>& region_lights, struct Sampling_Statistics& statistics)
+{
+    const size_t CANDIDATE_COUNT = CANDIDATES != nullptr ? CANDIDATES -> size() : light_container.size();
+    struct Region_Frustum frustum;
+
+    region_frustum(X_START, Y_START, X_END, Y_END, frustum);
+    region_lights.clear();
+    for (size_t candidate = 0; candidate < CANDIDATE_COUNT; ++candidate)
+    {
+        const unsigned int LIGHT = CANDIDATES != nullptr ? (*CANDIDATES)[candidate] : static_cast<unsigned int>(candidate);
+        const struct Light& CURRENT = light_container[LIGHT];
+
+        if (CURRENT.range <= 0.0f || region_sees_sphere(frustum, CURRENT.position, CURRENT.range))
+            region_lights.push_back(LIGHT);
+    }
+    ++statistics.light_lists;
+    statistics.light_list_candidates += CANDIDATE_COUNT;
+    statistics.light_list_entries += region_lights.size();
+}
+
+/*
+ * Traces the shadow rays of every sample recorded in a G-buffer again for lights that moved, updating their bits of the light masks. Every sample is refreshed,
+ * not only those the next render takes, as samples it does not take keep their masks for later frames. Returns the number of shadow rays traced.
+ *
+ * g_buffer: G-buffer whose light masks are updated
+ * MOVED_LIGHTS: lights whose bits in the light masks are out of date
+ */
+static unsigned long long refresh_light_masks(struct G_Buffer& g_buffer, const std::vector<unsigned int>& MOVED_LIGHTS)
+{
+    unsigned long long shadow_rays = 0;
+    struct Surface_Hit hit;
+
+    for (size_t sample = 0; sample < g_buffer.objects.size(); ++sample)
+    {
+        unsigned int * light_mask = &g_buffer.light_masks[sample * g_buffer.mask_words];
+
+        load_g_buffer_sample(g_buffer, sample, hit);
+        if (hit.object == nullptr)
+            continue;
+        for (size_t moved = 0; moved < MOVED_LIGHTS.size(); ++moved)
+        {
+            float light_ray_direction [ARRAY_SIZE], scalar_to_light;
+            const unsigned int LIGHT = MOVED_LIGHTS[moved];
+
+            if (area_light(light_container[LIGHT]) || light_attenuation(light_container[LIGHT], hit.point) <= 0.0f)//not in the mask
+            {
+                light_mask[LIGHT >> 5] &= ~(1u << (LIGHT & 31));
+                continue;
+            }
+            light_ray(hit.point, LIGHT, light_ray_direction, scalar_to_light);
+            if (light_blocked(hit.point, light_ray_direction, scalar_to_light))
+                light_mask[LIGHT >> 5] &= ~(1u << (LIGHT & 31));
+            else
+                light_mask[LIGHT >> 5] |= 1u << (LIGHT & 31);
+            ++shadow_rays;
+        }
+    }
+    return shadow_rays;
+}
+
+/*
+ * Renders the pixels in [X_START, X_END) x [Y_START, Y_END) into a tile sized float buffer. Returns how much sampling work was done.
+ *
+ * With 1 sample per pixel the single ray goes through the pixel corner, as it always has. Otherwise every pixel, plus a one pixel apron so the region can be rendered
+ * on its own, gets a base sample through its centre. Pixels whose base sample differs from a neighbour's are then resampled with a SAMPLES_PER_AXIS x SAMPLES_PER_AXIS
+ * jittered stratified pattern, or every pixel is when render_settings.adaptive is off, which is plain supersampling.
+ *
+ * With a cache every sample's surface hit and light mask is recorded in it. When REUSE_CACHE is set the cache holds the samples of an earlier render of the same
+ * region with the same camera and geometry, they are only re-shaded, and rays are traced just for pixels that newly need supersampling because their colours
+ * changed. Light colours do not matter to the cache, and for MOVED_LIGHTS only the shadow rays are traced again to update their bits of the light masks, see
+ * refresh_light_masks(...).
+ *
+ * X_START, Y_START: inclusive upper left corner of the region
+ * X_END, Y_END: exclusive lower right corner of the region
+ * tile_pixels: where the region's {R, G, B} radiance is stored, interleaved and row major, resized to fit
+ * cache: samples of the region, nullptr to trace without recording anything
+ * REUSE_CACHE: whether the samples in cache can be re-shaded
+ * MOVED_LIGHTS: lights whose bits in the cached light masks are out of date
+ */
+static struct Sampling_Statistics render_region(const unsigned int X_START, const unsigned int Y_START, const unsigned int X_END, const unsigned int Y_END, std::vector<float>& tile_pixels,
+                                                struct Tile_Cache * cache, const bool REUSE_CACHE, const std::vector<unsigned int>& MOVED_LIGHTS)
+{
+    #define TILE_PIXEL(X, Y) (&tile_pixels[(((Y) - Y_START) * (X_END - X_START) + ((X) - X_START)) * ARRAY_SIZE])//{R, G, B} of image pixel {X, Y}
+
+    const unsigned int SAMPLES_PER_AXIS = static_cast<unsigned int>(sqrt(static_cast<float>(render_settings.samples_per_pixel)));//largest square that fits, for stratification
+    const unsigned int MASK_WORDS = static_cast<unsigned int>((light_container.size() + 31) / 32);
+    const size_t RECORDED_SAMPLES = cache != nullptr && REUSE_CACHE ? cache -> samples.objects.size() : 0;//samples that can be re-shaded
+    struct Sampling_Statistics statistics;
+    std::vector<unsigned int> region_lights;//see cull_region_lights(...)
+    struct Region_Candidates region_candidates;//see cull_region_primitives(...)
+    const struct Region_Candidates * CANDIDATES = render_settings.frustum_culling ? &region_candidates : nullptr;
+    float current_ray_target [ARRAY_SIZE], colour [ARRAY_SIZE];//variables are reused
+    unsigned int x, y, i;
+    tile_pixels.resize((X_END - X_START) * (Y_END - Y_START) * ARRAY_SIZE);
+    cull_region_lights(X_START, Y_START, X_END, Y_END, render_settings.light_tree_tolerance > 0.0f ? &light_tree.excluded_lights : nullptr, region_lights, statistics);
+    if (CANDIDATES != nullptr)
+        cull_region_primitives(X_START, Y_START, X_END, Y_END, region_candidates, statistics);
+    if (RECORDED_SAMPLES > 0 && !MOVED_LIGHTS.empty())
+        statistics.refreshed_shadow_rays += refresh_light_masks(cache -> samples, MOVED_LIGHTS);
+
+    //takes sample SAMPLE_INDEX of the cache, re-shading it if it was recorded, tracing and recording it if not
+    auto take_sample = [&](const float RAY_TARGET [ARRAY_SIZE], float sample_colour [ARRAY_SIZE], const size_t SAMPLE_INDEX) -> const struct Object_Light_Properties *
+    {
+        struct Surface_Hit hit;
+
+        if (cache == nullptr)
+        {
+            ++statistics.primary_rays;
+            return trace_primary_ray(RAY_TARGET, &region_lights, CANDIDATES, sample_colour, statistics);
+        }
+        if (SAMPLE_INDEX < RECORDED_SAMPLES)
+        {
+            const unsigned int * LIGHT_MASK = load_g_buffer_sample(cache -> samples, SAMPLE_INDEX, hit);
+
+            shade_masked_hit(hit, &region_lights, LIGHT_MASK, sample_colour, statistics);
+            if (SAMPLE_INDEX < cache -> secondary_colours.size() / (2 * ARRAY_SIZE))//gathered by the deferred secondary pass, reflection first as add_secondary_light(...) adds it
+                for (unsigned int kind = 0; kind < 2; ++kind)
+                    for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                        sample_colour[j] += cache -> secondary_colours[(SAMPLE_INDEX * 2 + kind) * ARRAY_SIZE + j];
+            else
+                add_secondary_light(hit, 0, PRIMARY_WEIGHT, sample_colour, statistics);
+            ++statistics.reshaded_samples;
+            return hit.object;
+        }
+        {
+            unsigned int * light_mask;
+
+            trace_visibility(RAY_TARGET, CANDIDATES, hit);
+            light_mask = store_g_buffer_sample(cache -> samples, SAMPLE_INDEX, hit);
+            if (hit.object != nullptr)
+                compute_light_mask(hit, &region_lights, light_mask);
+            shade_masked_hit(hit, &region_lights, light_mask, sample_colour, statistics);
+            add_secondary_light(hit, 0, PRIMARY_WEIGHT, sample_colour, statistics);
+            ++statistics.primary_rays;
+            return hit.object;
+        }
+    };
+
+    if (cache != nullptr && !REUSE_CACHE)
+    {
+        resize_g_buffer(cache -> samples, 0, MASK_WORDS);
+        cache -> refined_samples.assign((X_END - X_START) * (Y_END - Y_START), NO_SAMPLES);
+    }
+
+    if (SAMPLES_PER_AXIS < 2)
+    {
+        if (cache != nullptr && !REUSE_CACHE)
+            resize_g_buffer(cache -> samples, (X_END - X_START) * (Y_END - Y_START), MASK_WORDS);
+        for (x = X_START; x < X_END; ++x)
+            for (y = Y_START; y < Y_END; ++y)
+            {
+                pixel_corner_target(x, y, current_ray_target);
+                take_sample(current_ray_target, TILE_PIXEL(x, y), (y - Y_START) * (X_END - X_START) + (x - X_START));
+            }
+        return statistics;
+    }
+
+    {
+        const struct Tile WINDOW = sampling_window(X_START, Y_START, X_END, Y_END);
+        const unsigned int WINDOW_X_START = WINDOW.x_start, WINDOW_Y_START = WINDOW.y_start, WINDOW_X_END = WINDOW.x_end, WINDOW_Y_END = WINDOW.y_end,
+                           WINDOW_WIDTH = WINDOW_X_END - WINDOW_X_START, WINDOW_HEIGHT = WINDOW_Y_END - WINDOW_Y_START;
+        std::vector<float> base_colours(render_settings.adaptive ? WINDOW_WIDTH * WINDOW_HEIGHT * ARRAY_SIZE : 0);
+        std::vector<const struct Object_Light_Properties *> base_ids(render_settings.adaptive ? WINDOW_WIDTH * WINDOW_HEIGHT : 0);
+
+        //base samples through pixel centres, only needed to find what to refine, they come first in the cache
+        if (render_settings.adaptive)
+        {
+            if (cache != nullptr && !REUSE_CACHE)
+                resize_g_buffer(cache -> samples, WINDOW_WIDTH * WINDOW_HEIGHT, MASK_WORDS);
+            for (y = WINDOW_Y_START; y < WINDOW_Y_END; ++y)
+                for (x = WINDOW_X_START; x < WINDOW_X_END; ++x)
+                {
+                    const unsigned int INDEX = (y - WINDOW_Y_START) * WINDOW_WIDTH + (x - WINDOW_X_START);
+
+                    pixel_centre_target(x, y, current_ray_target);
+                    base_ids[INDEX] = take_sample(current_ray_target, &base_colours[INDEX * ARRAY_SIZE], INDEX);
+                }
+        }
+
+        //refinement
+        for (y = Y_START; y < Y_END; ++y)
+            for (x = X_START; x < X_END; ++x)
+            {
+                const unsigned int INDEX = (y - WINDOW_Y_START) * WINDOW_WIDTH + (x - WINDOW_X_START);
+                size_t first_sample = 0;
+
+                if (render_settings.adaptive && !needs_refinement(base_colours, base_ids, WINDOW_WIDTH, WINDOW_HEIGHT, x - WINDOW_X_START, y - WINDOW_Y_START))
+                {
+                    for (i = 0; i < ARRAY_SIZE; ++i)
+                        TILE_PIXEL(x, y)[i] = base_colours[INDEX * ARRAY_SIZE + i];
+                    continue;
+                }
+
+                //supersamples are appended to the cache the first time a pixel needs them
+                if (cache != nullptr)
+                {
+                    unsigned int& refined_samples = cache -> refined_samples[(y - Y_START) * (X_END - X_START) + (x - X_START)];
+
+                    if (refined_samples == NO_SAMPLES)
+                    {
+                        refined_samples = static_cast<unsigned int>(cache -> samples.objects.size());
+                        resize_g_buffer(cache -> samples, refined_samples + SAMPLES_PER_AXIS * SAMPLES_PER_AXIS, MASK_WORDS);
+                    }
+                    first_sample = refined_samples;
+                }
+
+                {
+                    float sum [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};
+
+                    for (unsigned int sample = 0; sample < SAMPLES_PER_AXIS * SAMPLES_PER_AXIS; ++sample)
+                    {
+                        supersample_target(x, y, sample, SAMPLES_PER_AXIS, current_ray_target);
+                        take_sample(current_ray_target, colour, first_sample + sample);
+                        for (i = 0; i < ARRAY_SIZE; ++i)
+                            sum[i] += colour[i];
+                    }
+                    for (i = 0; i < ARRAY_SIZE; ++i)
+                        TILE_PIXEL(x, y)[i] = sum[i] / (SAMPLES_PER_AXIS * SAMPLES_PER_AXIS);//average
+                    ++statistics.refined_pixels;
+                }
+            }
+    }
+    return statistics;
+    #undef TILE_PIXEL
+}
+
+/*
+ * Reads the whole number that follows a command line option into setting. Text that is not all a whole number, or that setting cannot hold, is reported and
+ * setting is kept.
+ *
+ * OPTION: option the number follows, for the warning
+ * TEXT: text of the number
+ * setting: where the number is stored
+ */
+template <typename Whole_Number>
+static void read_whole_number_option(const std::string& OPTION, const char * TEXT, Whole_Number& setting)
+{
+    char * end;
+    unsigned long long value;
+
+    errno = 0;
+    value = strtoull(TEXT, &end, 10);
+    if (end == TEXT || *end != '\0' || errno == ERANGE || strchr(TEXT, '-') != nullptr || value > std::numeric_limits<Whole_Number>::max())
+        cerr << "Warning: ignoring " << OPTION << " \"" << TEXT << "\", expected a whole number up to " << std::numeric_limits<Whole_Number>::max() << ", keeping " << setting << endl;
+    else
+        setting = static_cast<Whole_Number>(value);
+}
+
+/*
+ * Reads the number that follows a command line option into setting. Text that is not all a number, or that does not fit a float, is reported and setting is kept.
+ *
+ * OPTION: option the number follows, for the warning
+ * TEXT: text of the number
+ * setting: where the number is stored
+ */
+static void read_float_option(const std::string& OPTION, const char * TEXT, float& setting)
+{
+    char * end;
+    float value;
+
+    errno = 0;
+    value = strtof(TEXT, &end);
+    if (end == TEXT || *end != '\0' || errno == ERANGE)
+        cerr << "Warning: ignoring " << OPTION << " \"" << TEXT << "\", expected a number, keeping " << setting << endl;
+    else
+        setting = value;
+}
+
+/*
+ * Reads the optional command line arguments that follow the scene name into render_settings. Unknown arguments are reported and ignored, as are option values
+ * that are not numbers where one is expected, which keep the setting as it was.
+ *
+ * name_of_arguments, argument_container: as given to main
+ */
+static void read_command_line_options(const int name_of_arguments, char * argument_container [])
+{
+    for (int i = 2; i < name_of_arguments; ++i)
+    {
+        const std::string OPTION = argument_container[i];
+
+        if (OPTION == "--spp" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.samples_per_pixel);
+        else if (OPTION == "--aa-threshold" && i + 1 < name_of_arguments)
+            read_float_option(OPTION, argument_container[++i], render_settings.contrast_threshold);
+        else if (OPTION == "--aa-full")
+            render_settings.adaptive = false;
+        else if (OPTION == "--no-frustum-culling")
+            render_settings.frustum_culling = false;
+        else if (OPTION == "--threads" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.thread_count);
+        else if (OPTION == "--tile-size" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.tile_size);
+        else if (OPTION == "--workers" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.worker_count);
+        else if (OPTION == "--sequence" && i + 1 < name_of_arguments)
+            render_settings.sequence_name = argument_container[++i];
+        else if (OPTION == "--refit-threshold" && i + 1 < name_of_arguments)
+            read_float_option(OPTION, argument_container[++i], render_settings.refit_threshold);
+        else if (OPTION == "--bvh-builder" && i + 1 < name_of_arguments)
+        {
+            const std::string BUILDER = argument_container[++i];
+
+            if (BUILDER == "median")
+                render_settings.bvh_builder = BVH_BUILDER_MEDIAN;
+            else if (BUILDER == "sah")
+                render_settings.bvh_builder = BVH_BUILDER_SAH;
+            else if (BUILDER == "morton")
+                render_settings.bvh_builder = BVH_BUILDER_MORTON;
+            else
+                cerr << "Warning: unknown BVH builder \"" << BUILDER << "\", keeping sah" << endl;
+        }
+        else if (OPTION == "--bvh-width" && i + 1 < name_of_arguments)
+        {
+            unsigned int width = render_settings.bvh_width;
+
+            read_whole_number_option(OPTION, argument_container[++i], width);
+            if (width == 2 || width == 4 || width == 8)
+                render_settings.bvh_width = width;
+            else
+                cerr << "Warning: BVH width " << width << " is not 2, 4 or 8, keeping " << render_settings.bvh_width << endl;
+        }
+        else if (OPTION == "--compressed-bvh")
+            render_settings.compressed_bvh = true;
+        else if (OPTION == "--mesh-leaf-size" && i + 1 < name_of_arguments)
+        {
+            unsigned int leaf_size = render_settings.mesh_leaf_size;
+
+            read_whole_number_option(OPTION, argument_container[++i], leaf_size);
+            if (1 <= leaf_size && leaf_size <= COMPRESSED_BVH_LEAF_LIMIT)
+                render_settings.mesh_leaf_size = leaf_size;
+            else
+                cerr << "Warning: mesh leaf size " << leaf_size << " is not in [1, " << COMPRESSED_BVH_LEAF_LIMIT << "], keeping " << render_settings.mesh_leaf_size << endl;
+        }
+        else if (OPTION == "--format" && i + 1 < name_of_arguments)
+        {
+            if (!read_image_format(argument_container[++i], render_settings.output_format))
+                cerr << "Warning: unknown format \"" << argument_container[i] << "\", keeping .bmp" << endl;
+        }
+        else if (OPTION == "--framebuffer" && i + 1 < name_of_arguments)
+        {
+            if (!read_frame_buffer_depth(argument_container[++i], render_settings.frame_buffer_depth))
+                cerr << "Warning: unknown frame buffer depth \"" << argument_container[i] << "\", expected 8, 16 or float" << endl;
+        }
+        else if (OPTION == "--tonemap" && i + 1 < name_of_arguments)
+        {
+            const std::string TONEMAP = argument_container[++i];
+
+            if (TONEMAP == "clamp")
+                render_settings.tonemap = TONEMAP_CLAMP;
+            else if (TONEMAP == "reinhard")
+                render_settings.tonemap = TONEMAP_REINHARD;
+            else
+                cerr << "Warning: unknown tonemap \"" << TONEMAP << "\", keeping clamp" << endl;
+        }
+        else if (OPTION == "--sphere-structure" && i + 1 < name_of_arguments)
+        {
+            const std::string STRUCTURE = argument_container[++i];
+
+            if (STRUCTURE == "auto")
+                render_settings.sphere_structure = ACCELERATION_AUTOMATIC;
+            else if (STRUCTURE == "bvh")
+                render_settings.sphere_structure = ACCELERATION_BVH;
+            else if (STRUCTURE == "grid")
+                render_settings.sphere_structure = ACCELERATION_GRID;
+            else
+                cerr << "Warning: unknown sphere structure \"" << STRUCTURE << "\", keeping auto" << endl;
+        }
+        else if (OPTION == "--srgb")
+            render_settings.srgb = true;
+        else if (OPTION == "--stream")
+            render_settings.stream = true;
+        else if (OPTION == "--crop" && i + 1 < name_of_arguments)
+        {
+            struct Tile crop;
+
+            if (sscanf(argument_container[++i], "%u,%u,%u,%u", &crop.x_start, &crop.y_start, &crop.x_end, &crop.y_end) == 4 && crop.x_start < crop.x_end && crop.y_start < crop.y_end)
+                render_settings.crop = crop;
+            else
+                cerr << "Warning: ignoring crop \"" << argument_container[i] << "\", expected x0,y0,x1,y1 with x0 < x1 and y0 < y1" << endl;
+        }
+        else if (OPTION == "--composite" && i + 1 < name_of_arguments)
+            render_settings.composite_path = argument_container[++i];
+        else if (OPTION == "--gbuffer")
+            render_settings.g_buffer = true;
+        else if (OPTION == "--deferred")
+            render_settings.deferred = true;
+        else if (OPTION == "--rasterize")
+            render_settings.rasterize = render_settings.deferred = true;
+        else if (OPTION == "--shadow-packets" && i + 1 < name_of_arguments)
+        {
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.shadow_packet_size);
+            render_settings.shadow_packet_size = std::min(std::max(render_settings.shadow_packet_size, 1u), static_cast<unsigned int>(RAY_PACKET_LIMIT));
+        }
+        else if (OPTION == "--max-depth" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.max_depth);
+        else if (OPTION == "--roulette-depth" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.roulette_depth);
+        else if (OPTION == "--ray-budget" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.ray_budget);
+        else if (OPTION == "--light-samples" && i + 1 < name_of_arguments)
+            read_whole_number_option(OPTION, argument_container[++i], render_settings.light_samples);
+        else if (OPTION == "--light-tree" && i + 1 < name_of_arguments)
+            read_float_option(OPTION, argument_container[++i], render_settings.light_tree_tolerance);
+        else
+            cerr << "Warning: ignoring unknown or incomplete option \"" << OPTION << "\"" << endl;
+    }
+    if (render_settings.stream && render_settings.output_format != IMAGE_FORMAT_PPM && render_settings.output_format != IMAGE_FORMAT_TIFF)
+    {
+        cerr << "Warning: only ppm and tiff can be streamed, writing tiff" << endl;
+        render_settings.output_format = IMAGE_FORMAT_TIFF;
+    }
+    if (render_settings.g_buffer && (render_settings.stream || render_settings.worker_count > 0))
+    {
+        cerr << "Warning: the G-buffer needs the whole frame rendered by threads in this process, not keeping one" << endl;
+        render_settings.g_buffer = false;
+    }
+    if (render_settings.deferred && (render_settings.stream || render_settings.worker_count > 0))
+    {
+        cerr << "Warning: the deferred passes need the whole frame rendered by threads in this process, rendering one tile at a time" << endl;
+        render_settings.deferred = false;
+    }
+    if (render_settings.stream && !render_settings.composite_path.empty())
+    {
+        cerr << "Warning: streamed images cannot be composited, writing the crop on its own" << endl;
+        render_settings.composite_path.clear();
+    }
+    if (render_settings.light_tree_tolerance > 0.0f && (render_settings.g_buffer || render_settings.deferred))
+    {
+        cerr << "Warning: light cuts trace their shadow rays while shading, not keeping a G-buffer or rendering in deferred passes" << endl;
+        render_settings.g_buffer = render_settings.deferred = false;
+    }
+    render_settings.rasterize = render_settings.rasterize && render_settings.deferred;//it fills the deferred visibility pass, the warnings above say why there is none
+    if (render_settings.max_depth > MAX_TRACE_DEPTH)
+    {
+        cerr << "Warning: secondary rays go at most " << MAX_TRACE_DEPTH << " deep, clamping the maximum depth" << endl;
+        render_settings.max_depth = MAX_TRACE_DEPTH;
+    }
+}
+
+/*
+ * Sets image_plane up for the current camera.
+ */
+static void set_up_image_plane()
+{
+    const float TAN_CALCULATION = tan(camera_instance.field_of_view / 2.0f * 3.14159265f / 180.0f);//3.14159265f / 180.0f to convert from degrees to radians, is used to define subsequent values
+    image_plane.vertical = static_cast<unsigned int>(TAN_CALCULATION * camera_instance.focal_length * 2);
+    image_plane.half_vertical = image_plane.vertical >> 1;
+    image_plane.horizontal = static_cast<unsigned int>(camera_instance.aspect_ratio * image_plane.vertical);
+    image_plane.half_horizontal = image_plane.horizontal >> 1;
+    image_plane.adjusted_camera_position[0] = camera_instance.position[0];
+    image_plane.adjusted_camera_position[1] = camera_instance.position[1];
+    image_plane.adjusted_camera_position[2] = static_cast<float>(camera_instance.position[2] + camera_instance.focal_length);
+}
+
+/*
+ * Part of the image that gets rendered, render_settings.crop limited to the image, or the whole image without a crop. image_plane must be set up.
+ */
+static struct Tile frame_region()
+{
+    struct Tile region = {0, 0, image_plane.horizontal, image_plane.vertical};
+
+    if (render_settings.crop.x_end > 0)
+    {
+        region.x_start = render_settings.crop.x_start < region.x_end ? render_settings.crop.x_start : region.x_end;
+        region.y_start = render_settings.crop.y_start < region.y_end ? render_settings.crop.y_start : region.y_end;
+        region.x_end = render_settings.crop.x_end < region.x_end ? render_settings.crop.x_end : region.x_end;
+        region.y_end = render_settings.crop.y_end < region.y_end ? render_settings.crop.y_end : region.y_end;
+    }
+    return region;
+}
+
+/*
+ * Sizes frame_buffer and gives it the depth and tonemap chosen in render_settings.
+ *
+ * frame_buffer: frame buffer set up
+ * WIDTH, HEIGHT: size in pixels
+ */
+static void set_up_frame_buffer(struct Frame_Buffer& frame_buffer, const unsigned int WIDTH, const unsigned int HEIGHT)
+{
+    frame_buffer.depth = render_settings.frame_buffer_depth != FRAME_BUFFER_AUTOMATIC ? render_settings.frame_buffer_depth :
+                         render_settings.output_format == IMAGE_FORMAT_PFM ? FRAME_BUFFER_FLOAT : FRAME_BUFFER_8_BIT;//only keep floats if they get written
+    frame_buffer.tonemap = render_settings.tonemap;
+    frame_buffer.srgb = render_settings.srgb;
+    allocate_frame_buffer(frame_buffer, WIDTH, HEIGHT);
+}
+
+/*
+ * Renders tiles with the threads or worker processes asked for in render_settings. Every tile is rendered into a float scratch buffer of its own and only then stored,
+ * and for quantized frame buffers tonemapped, into frame_buffer.
+ *
+ * TILES: tiles to render, in image coordinates
+ * frame_buffer: frame buffer the tiles are stored in, holding part of the image from {X_OFFSET, Y_OFFSET} on
+ * X_OFFSET, Y_OFFSET: image pixel frame_buffer's upper left corner is
+ * thread_statistics, reports: one per thread or worker, the work done is added to them
+ * cache: samples of every tile, in the order of TILES, nullptr to not record any, not supported with worker processes
+ * REUSE_CACHE: whether the samples in cache are still valid, see render_region(...)
+ */
+static void render_tiles_into(const std::vector<struct Tile>& TILES, struct Frame_Buffer& frame_buffer, const unsigned int X_OFFSET, const unsigned int Y_OFFSET,
+                              std::vector<struct Sampling_Statistics>& thread_statistics, std::vector<struct Thread_Report>& reports, struct Render_Cache * cache,
+                              const bool REUSE_CACHE)
+{
+    const unsigned int THREAD_COUNT = static_cast<unsigned int>(thread_statistics.size());
+    std::vector<std::vector<float> > tile_scratch(THREAD_COUNT);//one float tile per thread, reused for every tile it renders
+    std::vector<struct Thread_Report> new_reports;
+
+    if (render_settings.worker_count > 0)
+        new_reports = render_tiles_in_processes<struct Sampling_Statistics>(TILES, THREAD_COUNT, [&](const struct Tile& TILE, std::vector<float>& tile_pixels)
+        {
+            return render_region(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, tile_pixels, nullptr, false, std::vector<unsigned int>());
+        },
+        [&](const struct Sampling_Statistics& TILE_STATISTICS, const unsigned int WORKER_INDEX, const struct Tile& TILE, const std::vector<float>& TILE_PIXELS)
+        {
+            store_tile(frame_buffer, TILE.x_start - X_OFFSET, TILE.y_start - Y_OFFSET, TILE.x_end - TILE.x_start, TILE.y_end - TILE.y_start, TILE_PIXELS.data());
+            add_sampling_statistics(thread_statistics[WORKER_INDEX], TILE_STATISTICS);
+        });
+    else
+        new_reports = render_tiles(TILES, THREAD_COUNT, [&](const struct Tile& TILE, const unsigned int THREAD_INDEX)
+        {
+            const struct Sampling_Statistics TILE_STATISTICS = render_region(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, tile_scratch[THREAD_INDEX],
+                                                                             cache != nullptr ? &cache -> tiles[&TILE - TILES.data()] : nullptr, REUSE_CACHE,
+                                                                             cache != nullptr ? cache -> moved_lights : std::vector<unsigned int>());
+
+            store_tile(frame_buffer, TILE.x_start - X_OFFSET, TILE.y_start - Y_OFFSET, TILE.x_end - TILE.x_start, TILE.y_end - TILE.y_start, tile_scratch[THREAD_INDEX].data());
+            add_sampling_statistics(thread_statistics[THREAD_INDEX], TILE_STATISTICS);
+        });
+
+    add_thread_reports(reports, new_reports);
+}
+
+/*
+ * Projects a point onto the image plane along the primary ray that would reach it, giving that ray's target, see pixel_corner_target(...). Returns false if the
+ * point is not ahead of the camera, as then no ray target leads to it.
+ *
+ * POINT: point projected
+ * target: where the x and y of the ray target are stored
+ */
+static bool project_to_image_plane(const float POINT [ARRAY_SIZE], float target [2])
+{
+    const float DEPTH = -1.0f - image_plane.adjusted_camera_position[2];//z of every primary ray direction before it is normalized
+    const float TO_POINT_Z = POINT[2] - camera_instance.position[2];
+
+    if (!(TO_POINT_Z * DEPTH > 0.0f))
+        return false;
+    for (unsigned int i = 0; i < 2; ++i)
+        target[i] = image_plane.adjusted_camera_position[i] + (POINT[i] - camera_instance.position[i]) * (DEPTH / TO_POINT_Z);
+    return true;
+}
+
+/*
+ * Finds the pixels of a visibility buffer whose samples may see anything in the convex hull of some points, from where the points project to, see
+ * project_to_image_plane(...). Every sample of a pixel has its ray target in the pixel's square, from its corner target one to the right and one down, so pixels
+ * whose squares meet the projected bounds, grown by RASTER_MARGIN, are taken. If a point is not ahead of the camera the whole window is. Returns false if no
+ * pixel of the window is left.
+ *
+ * BUFFER: visibility buffer in question
+ * POINTS, COUNT: the points
+ * span: where the inclusive {first x, first y, last x, last y} of the pixels is stored, in image coordinates
+ */
+static bool visibility_span(const struct Visibility_Buffer& BUFFER, const float POINTS [][ARRAY_SIZE], const unsigned int COUNT, unsigned int span [4])
+{
+    float low [2] = {FLT_MAX, FLT_MAX}, high [2] = {-FLT_MAX, -FLT_MAX}, first [2], last [2];
+
+    for (unsigned int i = 0; i < COUNT; ++i)
+    {
+        float target [2];
+
+        if (!project_to_image_plane(POINTS[i], target))
+        {
+            low[0] = low[1] = -FLT_MAX;
+            high[0] = high[1] = FLT_MAX;
+            break;
+        }
+        for (unsigned int j = 0; j < 2; ++j)
+        {
+            low[j] = std::min(low[j], target[j]);
+            high[j] = std::max(high[j], target[j]);
+        }
+    }
+    //pixel x covers x - half_horizontal up to one more, pixel y covers half_vertical - y down to one less
+    first[0] = std::max(static_cast<float>(ceil(low[0] + image_plane.half_horizontal - 1.0f - RASTER_MARGIN)), static_cast<float>(BUFFER.x_start));
+    last[0] = std::min(static_cast<float>(floor(high[0] + image_plane.half_horizontal + RASTER_MARGIN)), static_cast<float>(BUFFER.x_start + BUFFER.width - 1));
+    first[1] = std::max(static_cast<float>(ceil(image_plane.half_vertical - 1.0f - high[1] - RASTER_MARGIN)), static_cast<float>(BUFFER.y_start));
+    last[1] = std::min(static_cast<float>(floor(image_plane.half_vertical - low[1] + RASTER_MARGIN)), static_cast<float>(BUFFER.y_start + BUFFER.height - 1));
+    if (!(first[0] <= last[0] && first[1] <= last[1]))//NaN points span nothing, their rays would not hit them either
+        return false;
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        span[i] = static_cast<unsigned int>(first[i]);
+        span[i + 2] = static_cast<unsigned int>(last[i]);
+    }
+    return true;
+}
+
+/*
+ * Calls draw_row(first sample, end sample) for the samples of every row of pixels of a span, see visibility_span(...). Returns the number of samples.
+ *
+ * BUFFER: visibility buffer the span is in
+ * SPAN: the span
+ * draw_row: see above
+ */
+template <typename Row_Function>
+static size_t draw_visibility_span(const struct Visibility_Buffer& BUFFER, const unsigned int SPAN [4], Row_Function draw_row)
+{
+    size_t samples = 0;
+
+    for (unsigned int y = SPAN[1]; y <= SPAN[3]; ++y)
+    {
+        const size_t FIRST = visibility_sample(BUFFER, SPAN[0], y), END = visibility_sample(BUFFER, SPAN[2], y) + BUFFER.samples_per_pixel;
+
+        draw_row(FIRST, END);
+        samples += END - FIRST;
+    }
+    return samples;
+}
+
+/*
+ * Tests if something can be left out of a visibility buffer as it is behind every sample's hit already. Primary rays take hits up to 1 behind the camera, which
+ * can only come from something nearer than 1, so that is never left out.
+ *
+ * buffer: visibility buffer in question, see farthest_visibility_depth(...)
+ * NEAREST_SQUARED: squared distance from the camera to the nearest point of it
+ */
+static bool visibility_occluded(struct Visibility_Buffer& buffer, const float NEAREST_SQUARED)
+{
+    const float NEAREST = static_cast<float>(sqrt(NEAREST_SQUARED));
+
+    return NEAREST >= 1.0f && NEAREST * (1.0f - RASTER_DEPTH_TOLERANCE) > farthest_visibility_depth(buffer);
+}
+
+/*
+ * Calls draw_leaf(first, count) for every leaf of a BVH whose box can be seen through a region, see region_sees_box(...), and is not behind everything drawn
+ * into a visibility buffer so far, see visibility_occluded(...). The child nearer the camera goes first, so near leaves are drawn early and hide far ones.
+ *
+ * TREE: BVH gone down
+ * FRUSTUM: pyramid of the region
+ * buffer: visibility buffer draw_leaf draws into
+ * draw_leaf: see above, first and count as in BVH_Node
+ */
+template <typename Leaf_Function>
+static void visit_visible_leaves(const struct BVH& TREE, const struct Region_Frustum& FRUSTUM, struct Visibility_Buffer& buffer, Leaf_Function draw_leaf)
+{
+    unsigned int stack [BVH_STACK_SIZE], stack_size = 0;
+
+    if (!TREE.nodes.empty())
+        stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        const struct BVH_Node& NODE = TREE.nodes[stack[--stack_size]];
+
+        if (!region_sees_box(FRUSTUM, NODE.bounds) || visibility_occluded(buffer, box_distance_squared(NODE.bounds, camera_instance.position)))
+            continue;
+        if (NODE.count > 0)
+            draw_leaf(NODE.first, NODE.count);
+        else
+        {
+            const bool RIGHT_NEARER = box_distance_squared(TREE.nodes[NODE.first + 1].bounds, camera_instance.position)
+                                      < box_distance_squared(TREE.nodes[NODE.first].bounds, camera_instance.position);
+
+            stack[stack_size++] = RIGHT_NEARER ? NODE.first : NODE.first + 1;
+            stack[stack_size++] = RIGHT_NEARER ? NODE.first + 1 : NODE.first;
+        }
+    }
+}
+
+/*
+ * Calls draw_cell(first, count) for every cell of a grid that can be seen through a region and is not behind everything drawn into a visibility buffer so far,
+ * like visit_visible_leaves(...). Blocks of cells are halved along their longest side, nearer half first, down to single cells, so a region only looks at the
+ * cells around what it sees. A primitive overlapping several cells is passed for each of them.
+ *
+ * GRID: grid gone through
+ * FRUSTUM: pyramid of the region
+ * buffer: visibility buffer draw_cell draws into
+ * draw_cell: see above, first and count in GRID.primitive_indices
+ */
+template <typename Cell_Function>
+static void visit_visible_cells(const struct Grid& GRID, const struct Region_Frustum& FRUSTUM, struct Visibility_Buffer& buffer, Cell_Function draw_cell)
+{
+    //each block is its first and last cells, inclusive, halving takes at most 9 levels per axis, see GRID_MAX_RESOLUTION, with one block left waiting per level
+    unsigned int stack [BVH_STACK_SIZE][6], stack_size = 0;
+    const auto BLOCK_BOUNDS = [&](const unsigned int BLOCK [6])
+    {
+        struct Bounding_Box box;
+
+        for (unsigned int i = 0; i < 3; ++i)//grown by a quarter cell, cells primitives were sorted into are rounded differently
+        {
+            box.minimum[i] = GRID.bounds.minimum[i] + (BLOCK[i] - 0.25f) * GRID.cell_size[i];
+            box.maximum[i] = GRID.bounds.minimum[i] + (BLOCK[i + 3] + 1.25f) * GRID.cell_size[i];
+        }
+        return box;
+    };
+
+    if (GRID.cell_starts.empty())
+        return;
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        stack[0][i] = 0;
+        stack[0][i + 3] = GRID.resolution[i] - 1;
+    }
+    stack_size = 1;
+    while (stack_size > 0)
+    {
+        unsigned int block [6], low [6], high [6], axis = 0;
+        struct Bounding_Box box;
+
+        --stack_size;
+        for (unsigned int i = 0; i < 6; ++i)
+            block[i] = low[i] = high[i] = stack[stack_size][i];
+        box = BLOCK_BOUNDS(block);
+        if (!region_sees_box(FRUSTUM, box) || visibility_occluded(buffer, box_distance_squared(box, camera_instance.position)))
+            continue;
+        for (unsigned int i = 1; i < 3; ++i)
+            if (block[i + 3] - block[i] > block[axis + 3] - block[axis])
+                axis = i;
+        if (block[axis + 3] == block[axis])//a single cell
+        {
+            const size_t CELL = (static_cast<size_t>(block[2]) * GRID.resolution[1] + block[1]) * GRID.resolution[0] + block[0];
+
+            draw_cell(GRID.cell_starts[CELL], GRID.cell_starts[CELL + 1] - GRID.cell_starts[CELL]);
+            continue;
+        }
+        low[axis + 3] = block[axis] + (block[axis + 3] - block[axis]) / 2;
+        high[axis] = low[axis + 3] + 1;
+        const bool HIGH_NEARER = box_distance_squared(BLOCK_BOUNDS(high), camera_instance.position) < box_distance_squared(BLOCK_BOUNDS(low), camera_instance.position);
+
+        for (unsigned int i = 0; i < 6; ++i)
+        {
+            stack[stack_size][i] = HIGH_NEARER ? low[i] : high[i];
+            stack[stack_size + 1][i] = HIGH_NEARER ? high[i] : low[i];
+        }
+        stack_size += 2;
+    }
+}
+
+/*
+ * Rasterizes what the samples of a tile's visibility buffer see, instead of tracing their primary rays. buffer must be reset for the tile's window with every
+ * sample's direction filled in. The plane is tested for every sample, then spheres and triangles are drawn one at a time over the pixels their projection spans,
+ * see visibility_span(...): spheres as impostors, the square their box projects to, and triangles as the bounds of their corners. Each sample in a span is then
+ * tested with exactly the intersection its traced ray would have used, 4 or TRIANGLE_BATCH_SIZE samples at a time, see sphere_sample_roots(...) and
+ * triangle_sample_hits(...), and kept by a depth test, see store_visibility_hit(...). The plane, spheres and triangles are drawn in the order closest_intersection(...)
+ * tests them and accept the same hits, so every sample that is not marked as tied ends up with the hit its ray would have found. Spheres and triangles are found
+ * by going down the sphere and mesh BVHs to the leaves that can be seen through the tile, see visit_visible_leaves(...), or through sphere_grid's cells, see
+ * visit_visible_cells(...), nearest first. Once every sample has a hit, whatever is further away than all of them is skipped, see visibility_occluded(...).
+ *
+ * TILE: tile in image coordinates, the window of buffer is it or it with its apron
+ * buffer: visibility buffer drawn into
+ * drawn: number of triangles and spheres drawn and of samples they were tested against, in that order, are added to it
+ */
+static void rasterize_tile_visibility(const struct Tile& TILE, struct Visibility_Buffer& buffer, unsigned long long drawn [3])
+{
+    const size_t SAMPLE_COUNT = buffer.kinds.size();
+    const float * RAY_ORIGIN = camera_instance.position;//of every primary ray
+    struct Region_Frustum frustum;
+    unsigned int span [4];
+
+    region_frustum(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, frustum);
+    if (plane_instance.active && region_sees_plane(frustum, plane_instance))
+        for (size_t sample = 0; sample < SAMPLE_COUNT; ++sample)
+        {
+            const float RAY_DIRECTION [ARRAY_SIZE] = {buffer.directions[0][sample], buffer.directions[1][sample], buffer.directions[2][sample]};
+            float distance;
+
+            if (plane_distance(plane_instance, RAY_ORIGIN, RAY_DIRECTION, distance))
+                store_visibility_hit(buffer, sample, distance, RAY_HIT_PLANE, 0);
+        }
+    if (!sphere_container.empty())
+    {
+        const auto DRAW_SPHERE = [&](const unsigned int INDEX)
+        {
+            const struct Sphere& SPHERE = sphere_container[INDEX];
+            const struct Bounding_Box BOX = sphere_bounding_box(SPHERE);
+            float corners [8][ARRAY_SIZE], centre_distance_squared = 0.0f;
+
+            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                centre_distance_squared += (SPHERE.position[i] - RAY_ORIGIN[i]) * (SPHERE.position[i] - RAY_ORIGIN[i]);
+
+            const float NEAREST = static_cast<float>(sqrt(centre_distance_squared)) - SPHERE.radius;//0 or less with the camera inside
+
+            if (!region_sees_sphere(frustum, SPHERE.position, SPHERE.radius) || (NEAREST > 0.0f && visibility_occluded(buffer, NEAREST * NEAREST)))
+                return;
+            for (unsigned int corner = 0; corner < 8; ++corner)
+                for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                    corners[corner][i] = (corner >> i & 1) != 0 ? BOX.maximum[i] : BOX.minimum[i];
+            if (!visibility_span(buffer, corners, 8, span))
+                return;
+            ++drawn[1];
+            drawn[2] += draw_visibility_span(buffer, span, [&](const size_t FIRST, const size_t END)
+            {
+                float roots [2][4];
+                unsigned int root_counts [4];
+
+                for (size_t batch = FIRST; batch < END; batch += 4)
+                {
+                    if (!sphere_grid.cell_starts.empty())//the grid finds spheres one ray at a time, see traverse_spheres(...)
+                        for (size_t i = 0; i < 4 && batch + i < END; ++i)
+                        {
+                            const float RAY_DIRECTION [ARRAY_SIZE] = {buffer.directions[0][batch + i], buffer.directions[1][batch + i], buffer.directions[2][batch + i]};
+                            float sphere_roots_found [2];
+
+                            root_counts[i] = sphere_roots(SPHERE.position, SPHERE.radius, RAY_ORIGIN, RAY_DIRECTION, sphere_roots_found);
+                            roots[0][i] = sphere_roots_found[0];
+                            roots[1][i] = sphere_roots_found[1];
+                        }
+                    else
+                        sphere_sample_roots(SPHERE.position, SPHERE.radius, RAY_ORIGIN, buffer, batch, roots, root_counts);
+                    for (size_t i = 0; i < 4 && batch + i < END; ++i)
+                        for (unsigned int root = 0; root < root_counts[i]; ++root)
+                            if (-1.0f < roots[root][i])//primary rays take hits up to 1 behind the camera
+                                store_visibility_hit(buffer, batch + i, roots[root][i], RAY_HIT_SPHERE, INDEX);
+                }
+            });
+        };
+
+        if (!sphere_grid.cell_starts.empty())
+            visit_visible_cells(sphere_grid, frustum, buffer, [&](const unsigned int FIRST, const unsigned int COUNT)
+            {
+                for (unsigned int i = FIRST; i < FIRST + COUNT; ++i)
+                    if (mark_visibility_drawn(buffer, sphere_grid.primitive_indices[i], sphere_container.size()))
+                        DRAW_SPHERE(sphere_grid.primitive_indices[i]);
+            });
+        else
+            visit_visible_leaves(sphere_bvh, frustum, buffer, [&](const unsigned int FIRST, const unsigned int COUNT)
+            {
+                for (unsigned int i = FIRST; i < FIRST + COUNT; ++i)
+                    DRAW_SPHERE(sphere_bvh.primitive_indices[i]);
+            });
+    }
+    if (mesh_instance.active)
+        visit_visible_leaves(mesh_bvh, frustum, buffer, [&](const unsigned int FIRST, const unsigned int COUNT)
+        {
+            for (unsigned int triangle = FIRST; triangle < FIRST + COUNT; ++triangle)
+            {
+                float vertices [3][ARRAY_SIZE];
+                struct Bounding_Box box;
+
+                for (unsigned int vertex = 0; vertex < 3; ++vertex)
+                    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+                    {
+                        vertices[vertex][i] = mesh_leaves.vertices[vertex][i][triangle];
+                        box.minimum[i] = std::min(box.minimum[i], vertices[vertex][i]);
+                        box.maximum[i] = std::max(box.maximum[i], vertices[vertex][i]);
+                    }
+                if (visibility_occluded(buffer, box_distance_squared(box, RAY_ORIGIN)) || !visibility_span(buffer, vertices, 3, span))
+                    continue;
+                ++drawn[0];
+                drawn[2] += draw_visibility_span(buffer, span, [&](const size_t FIRST_SAMPLE, const size_t END)
+                {
+                    float distances [TRIANGLE_BATCH_SIZE];
+
+                    for (size_t batch = FIRST_SAMPLE; batch < END; batch += TRIANGLE_BATCH_SIZE)
+                    {
+                        const int HITS = triangle_sample_hits(triangle, RAY_ORIGIN, buffer, batch, distances);
+
+                        for (unsigned int i = 0; i < TRIANGLE_BATCH_SIZE && batch + i < END; ++i)
+                            if ((HITS >> i & 1) != 0)
+                                store_visibility_hit(buffer, batch + i, distances[i], RAY_HIT_TRIANGLE, mesh_bvh.primitive_indices[triangle]);
+                    }
+                });
+            }
+        });
+}
+
+/*
+ * Reads a sample's hit back from a visibility buffer as the surface hit its traced primary ray would have given, see primitive_surface_hit(...).
+ *
+ * BUFFER: visibility buffer rasterized into, see rasterize_tile_visibility(...)
+ * SAMPLE: sample read
+ * hit: where the sample's surface hit is stored, hit.object is nullptr if nothing was hit
+ */
+static void visibility_surface_hit(const struct Visibility_Buffer& BUFFER, const size_t SAMPLE, struct Surface_Hit& hit)
+{
+    hit.distance = BUFFER.depths[SAMPLE];
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        hit.direction[i] = BUFFER.directions[i][SAMPLE];
+    primitive_surface_hit(static_cast<enum Ray_Hit>(BUFFER.kinds[SAMPLE]), BUFFER.primitives[SAMPLE], camera_instance.position, hit);
+}
+
+/*
+ * Deferred pipeline, visibility pass: traces the primary rays render_region(...) takes before it knows any colours, that is every sample with 1 sample per pixel or
+ * without adaptive anti-aliasing, otherwise the base samples of the tile and its apron, and records what they hit with cleared light masks. Returns the number of rays traced.
+ * With render_settings.rasterize the rays are not traced, their directions go into a visibility buffer that is rasterized, see rasterize_tile_visibility(...),
+ * and the hits are read back from it. Only the rays of samples it found tied hits for are traced, so the hits are the same either way.
+ *
+ * TILE: tile in image coordinates
+ * cache: where the samples are recorded, in render_region(...)'s order
+ * buffer: scratch visibility buffer, reused between tiles
+ * drawn: see rasterize_tile_visibility(...), the number of tied samples traced is added to drawn[3]
+ */
+static unsigned long long trace_tile_visibility(const struct Tile& TILE, struct Tile_Cache& cache, struct Visibility_Buffer& buffer, unsigned long long drawn [4])
+{
+    const unsigned int SAMPLES_PER_AXIS = static_cast<unsigned int>(sqrt(static_cast<float>(render_settings.samples_per_pixel)));
+    const unsigned int MASK_WORDS = static_cast<unsigned int>((light_container.size() + 31) / 32);
+    const unsigned int WIDTH = TILE.x_end - TILE.x_start, HEIGHT = TILE.y_end - TILE.y_start;
+    const struct Tile WINDOW = SAMPLES_PER_AXIS >= 2 && render_settings.adaptive ? sampling_window(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end) : TILE;
+    const unsigned int SAMPLES_PER_PIXEL = SAMPLES_PER_AXIS >= 2 && !render_settings.adaptive ? SAMPLES_PER_AXIS * SAMPLES_PER_AXIS : 1;
+    struct Region_Candidates candidates;//see cull_region_primitives(...)
+    struct Sampling_Statistics uncounted;//counted when the tile is shaded, which culls the same primitives
+    struct Surface_Hit hit;
+    float ray_target [ARRAY_SIZE];
+    size_t sample = 0;
+
+    if (render_settings.frustum_culling && !render_settings.rasterize)
+        cull_region_primitives(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, candidates, uncounted);
+    cache.refined_samples.assign(WIDTH * HEIGHT, NO_SAMPLES);
+    resize_g_buffer(cache.samples, static_cast<size_t>(WINDOW.x_end - WINDOW.x_start) * (WINDOW.y_end - WINDOW.y_start) * SAMPLES_PER_PIXEL, MASK_WORDS);
+    if (render_settings.rasterize)
+        reset_visibility_buffer(buffer, WINDOW.x_start, WINDOW.y_start, WINDOW.x_end - WINDOW.x_start, WINDOW.y_end - WINDOW.y_start, SAMPLES_PER_PIXEL);
+    for (unsigned int y = WINDOW.y_start; y < WINDOW.y_end; ++y)
+        for (unsigned int x = WINDOW.x_start; x < WINDOW.x_end; ++x)
+        {
+            if (SAMPLES_PER_PIXEL > 1)//every pixel is supersampled, in the order render_region(...) appends them
+                cache.refined_samples[(y - TILE.y_start) * WIDTH + (x - TILE.x_start)] = static_cast<unsigned int>(sample);
+            for (unsigned int i = 0; i < SAMPLES_PER_PIXEL; ++i)
+            {
+                if (SAMPLES_PER_PIXEL > 1)
+                    supersample_target(x, y, i, SAMPLES_PER_AXIS, ray_target);
+                else if (SAMPLES_PER_AXIS >= 2)
+                    pixel_centre_target(x, y, ray_target);
+                else
+                    pixel_corner_target(x, y, ray_target);
+                if (render_settings.rasterize)
+                {
+                    float ray_direction [ARRAY_SIZE];
+
+                    create_normailized_ray_direction(image_plane.adjusted_camera_position, ray_target, ray_direction);
+                    for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                        buffer.directions[j][sample] = ray_direction[j];
+                    ++sample;
+                    continue;
+                }
+                trace_visibility(ray_target, render_settings.frustum_culling ? &candidates : nullptr, hit);
+                store_g_buffer_sample(cache.samples, sample++, hit);
+            }
+        }
+    if (render_settings.rasterize)
+    {
+        rasterize_tile_visibility(TILE, buffer, drawn);
+        for (size_t i = 0; i < sample; ++i)
+        {
+            if (buffer.ties[i] != 0)
+            {
+                const float RAY_DIRECTION [ARRAY_SIZE] = {buffer.directions[0][i], buffer.directions[1][i], buffer.directions[2][i]};
+
+                trace_ray(camera_instance.position, RAY_DIRECTION, -1.0f, nullptr, hit);
+                ++drawn[3];
+            }
+            else
+                visibility_surface_hit(buffer, i, hit);
+            store_g_buffer_sample(cache.samples, i, hit);
+        }
+    }
+    std::fill(cache.samples.light_masks.begin(), cache.samples.light_masks.end(), 0u);
+    return sample;
+}
+
+/*
+ * Deferred pipeline, shadow pass: queues a shadow ray from every sample of a tile that hit something to each light, sorts the queue by light and direction and
+ * runs it through the plane, sphere and triangle kernels, each only seeing rays the ones before did not find blocked. Then updates the lights' bits of the light
+ * masks. Samples out of a light's range get no ray, their bit is cleared. Returns the number of rays traced.
+ *
+ * cache: samples of the tile
+ * LIGHTS: lights whose bits are traced, other bits are left alone, see cull_region_lights(...)
+ * queue: scratch queue, reused between tiles
+ * blocked: number of rays the plane, the spheres and the mesh blocked, in that order, are added to it
+ */
+static unsigned long long trace_tile_shadows(struct Tile_Cache& cache, const std::vector<unsigned int>& LIGHTS, struct Ray_Queue& queue, unsigned long long blocked [3])
+{
+    struct G_Buffer& samples = cache.samples;
+    float light_ray_direction [ARRAY_SIZE], scalar_to_light;
+    size_t ray = 0;
+
+    resize_ray_queue(queue, (samples.objects.size() - std::count(samples.objects.begin(), samples.objects.end(), nullptr)) * LIGHTS.size());
+    queue.direction_keys = render_settings.shadow_packet_size <= 1;//packets take neighbouring samples together, which is the order they are added in
+    for (size_t i = 0; i < LIGHTS.size(); ++i)
+        for (size_t sample = 0; sample < samples.objects.size(); ++sample)
+            if (samples.objects[sample] != nullptr)
+            {
+                const float * POINT = &samples.points[sample * ARRAY_SIZE];
+
+                if (light_attenuation(light_container[LIGHTS[i]], POINT) <= 0.0f)
+                {
+                    samples.light_masks[sample * samples.mask_words + (LIGHTS[i] >> 5)] &= ~(1u << (LIGHTS[i] & 31));
+                    continue;
+                }
+                light_ray(POINT, LIGHTS[i], light_ray_direction, scalar_to_light);
+                store_ray(queue, ray++, RAY_TYPE_SHADOW, LIGHTS[i], POINT, light_ray_direction, SHADOW_BIAS, scalar_to_light, static_cast<unsigned int>(sample));
+            }
+    resize_ray_queue(queue, ray);
+    sort_ray_queue(queue);
+
+    plane_any_hit_kernel(queue);
+    blocked[0] += compact_ray_queue(queue);
+    sphere_any_hit_kernel(queue);
+    blocked[1] += compact_ray_queue(queue);
+    triangle_any_hit_kernel(queue);
+    blocked[2] += compact_ray_queue(queue);
+
+    for (ray = 0; ray < queue.owners.size(); ++ray)
+    {
+        unsigned int& mask_word = samples.light_masks[queue.owners[ray] * samples.mask_words + (queue.groups[ray] >> 5)];
+        const unsigned int BIT = 1u << (queue.groups[ray] & 31);
+
+        if (queue.hits[ray] != 0)
+            mask_word &= ~BIT;
+        else
+            mask_word |= BIT;
+    }
+    return queue.owners.size();
+}
+
+/*
+ * Deferred pipeline, secondary pass: traces the reflection and refraction rays of every sample of a tile a depth at a time instead of depth first. The rays each
+ * hit sends, see secondary_ray(...), are queued as one batch per depth, sorted by type and direction and run through the plane, sphere and triangle closest hit
+ * kernels, then what they hit is shaded and sends the rays of the next depth. Once every depth is traced, colours are gathered back up the paths, last vertex
+ * first, adding reflected before refracted light as add_secondary_light(...) does, so each sample gets exactly the light the recursion would give it. That light is
+ * stored in cache.secondary_colours for render_region(...) to add. The rays are counted in statistics.secondary_rays like those of the recursion.
+ *
+ * cache: samples of the tile
+ * queue: scratch queue, reused between tiles
+ * statistics: where the rays traced or cut by the budget, and what shading their hits traces, are counted
+ */
+static void trace_tile_secondary_rays(struct Tile_Cache& cache, struct Ray_Queue& queue, struct Sampling_Statistics& statistics)
+{
+    const size_t SAMPLE_COUNT = cache.samples.objects.size();
+    std::vector<struct Surface_Hit> frontier(SAMPLE_COUNT);//hits of the path vertices of the current depth
+    std::vector<unsigned int> frontier_vertices(SAMPLE_COUNT);//path vertex of each hit of frontier, samples are vertices [0, SAMPLE_COUNT), what rays hit come after
+    std::vector<float> frontier_weights(SAMPLE_COUNT * ARRAY_SIZE), ray_factors, ray_weights;//see secondary_ray(...)
+    std::vector<unsigned int> parents;//per vertex past the samples, vertex whose ray hit it times 2 plus the kind of ray
+    std::vector<float> colours, factors;//per vertex past the samples, its colour and how much of it its parent gets, ARRAY_SIZE floats each
+    std::vector<float> secondary_colours;//per vertex past the samples, 2 * ARRAY_SIZE, as cache.secondary_colours
+    size_t vertex, ray;
+    unsigned int i;
+
+    for (vertex = 0; vertex < SAMPLE_COUNT; ++vertex)
+    {
+        load_g_buffer_sample(cache.samples, vertex, frontier[vertex]);
+        frontier_vertices[vertex] = static_cast<unsigned int>(vertex);
+        for (i = 0; i < ARRAY_SIZE; ++i)
+            frontier_weights[vertex * ARRAY_SIZE + i] = PRIMARY_WEIGHT[i];
+    }
+    queue.direction_keys = true;
+    for (unsigned int depth = 0; depth < render_settings.max_depth && !frontier.empty(); ++depth)
+    {
+        resize_ray_queue(queue, frontier.size() * 2);
+        ray_factors.resize(frontier.size() * 2 * ARRAY_SIZE);
+        ray_weights.resize(frontier.size() * 2 * ARRAY_SIZE);
+        ray = 0;
+        for (size_t j = 0; j < frontier.size(); ++j)
+            for (unsigned int kind = 0; frontier[j].object != nullptr && kind < 2; ++kind)//0 reflection, 1 refraction
+            {
+                float ray_direction [ARRAY_SIZE];
+
+                if (secondary_ray(frontier[j], depth, &frontier_weights[j * ARRAY_SIZE], kind, &ray_factors[ray * ARRAY_SIZE], &ray_weights[ray * ARRAY_SIZE], ray_direction, statistics))
+                    store_ray(queue, ray++, kind == 0 ? RAY_TYPE_REFLECTION : RAY_TYPE_REFRACTION, 0, frontier[j].point, ray_direction, SECONDARY_RAY_BIAS, FLT_MAX,
+                              frontier_vertices[j] * 2 + kind);
+            }
+        resize_ray_queue(queue, ray);
+        sort_ray_queue(queue);
+        plane_closest_hit_kernel(queue);
+        sphere_closest_hit_kernel(queue);
+        triangle_closest_hit_kernel(queue);
+
+        //what the rays hit is the next depth's frontier
+        frontier.resize(ray);
+        frontier_vertices.resize(ray);
+        frontier_weights.resize(ray * ARRAY_SIZE);
+        colours.resize(colours.size() + ray * ARRAY_SIZE);
+        for (size_t j = 0; j < ray; ++j)
+        {
+            struct Surface_Hit& hit = frontier[j];
+
+            hit.distance = queue.maximum_distances[j];
+            for (i = 0; i < ARRAY_SIZE; ++i)
+                hit.direction[i] = queue.directions[j * ARRAY_SIZE + i];
+            primitive_surface_hit(static_cast<enum Ray_Hit>(queue.hits[j]), queue.hit_primitives[j], &queue.origins[j * ARRAY_SIZE], hit);
+            frontier_vertices[j] = static_cast<unsigned int>(SAMPLE_COUNT + parents.size());
+            shade_traced_hit(hit, nullptr, &colours[parents.size() * ARRAY_SIZE], statistics);//seen from elsewhere than the camera, so not culled to the tile
+            parents.push_back(queue.owners[j]);
+            for (i = 0; i < ARRAY_SIZE; ++i)
+            {
+                factors.push_back(ray_factors[j * ARRAY_SIZE + i]);
+                frontier_weights[j * ARRAY_SIZE + i] = ray_weights[j * ARRAY_SIZE + i];
+            }
+        }
+    }
+
+    //gathering, a vertex's rays always hit vertices made after it
+    cache.secondary_colours.assign(SAMPLE_COUNT * 2 * ARRAY_SIZE, 0.0f);
+    secondary_colours.assign(parents.size() * 2 * ARRAY_SIZE, 0.0f);
+    for (vertex = parents.size(); vertex-- > 0;)
+    {
+        const unsigned int PARENT = parents[vertex] >> 1, KIND = parents[vertex] & 1u;
+        float * parent_light = PARENT < SAMPLE_COUNT ? &cache.secondary_colours[(PARENT * 2 + KIND) * ARRAY_SIZE]
+                                                     : &secondary_colours[((PARENT - SAMPLE_COUNT) * 2 + KIND) * ARRAY_SIZE];
+
+        for (i = 0; i < ARRAY_SIZE; ++i)
+        {
+            float& colour = colours[vertex * ARRAY_SIZE + i];
+
+            colour += secondary_colours[vertex * 2 * ARRAY_SIZE + i];
+            colour += secondary_colours[(vertex * 2 + 1) * ARRAY_SIZE + i];
+            parent_light[i] = factors[vertex * ARRAY_SIZE + i] * colour;
+        }
+    }
+}
+
+/*
+ * Ray traces TILES in four passes, each spread over the threads and finished for every tile before the next starts: visibility records the primary hits of
+ * every tile in cache, shadows traces them one light at a time, secondary traces their reflection and refraction rays a depth at a time, and shading runs
+ * render_region(...) on the recorded samples, which only traces pixels that turn out to need supersampling. Passes work through the contiguous arrays of the
+ * G-buffers instead of following one ray at a time. How long each took is printed.
+ * Each tile only traces shadow rays to the lights cull_region_lights(...) leaves it, the same ones its shading loops over, so bits of the other lights are never read.
+ *
+ * TILES, frame_buffer, X_OFFSET, Y_OFFSET, thread_statistics, reports: see render_tiles_into(...)
+ * cache: samples of every tile, in the order of TILES
+ * REUSE_CACHE: whether cache already holds the hits, then only the shadows of cache.moved_lights are traced
+ */
+static void render_tiles_deferred(const std::vector<struct Tile>& TILES, struct Frame_Buffer& frame_buffer, const unsigned int X_OFFSET, const unsigned int Y_OFFSET,
+                                  std::vector<struct Sampling_Statistics>& thread_statistics, std::vector<struct Thread_Report>& reports, struct Render_Cache& cache,
+                                  const bool REUSE_CACHE)
+{
+    const unsigned int THREAD_COUNT = static_cast<unsigned int>(thread_statistics.size());
+    std::vector<std::vector<float> > tile_scratch(THREAD_COUNT);
+    std::vector<struct Ray_Queue> ray_queues(THREAD_COUNT);//one per thread, reused for every tile it traces
+    std::vector<struct Visibility_Buffer> visibility_buffers(THREAD_COUNT);//one per thread, reused for every tile it rasterizes
+    std::vector<unsigned long long> drawn(THREAD_COUNT * 4, 0);//triangles, spheres, sample tests and tied samples traced per thread, see trace_tile_visibility(...)
+    std::vector<std::vector<unsigned int> > tile_lights(THREAD_COUNT);//one per thread, see cull_region_lights(...)
+    std::vector<unsigned long long> shadow_rays(THREAD_COUNT, 0), blocked(THREAD_COUNT * 3, 0);//blocked by the plane, spheres and mesh per thread
+    std::vector<unsigned int> shadowed_lights = cache.moved_lights;
+    unsigned long long shadow_ray_total = 0, blocked_total [3] = {0, 0, 0}, drawn_total [4] = {0, 0, 0, 0};
+    double pass_seconds [4];//visibility, shadows, secondary, shading
+    std::chrono::steady_clock::time_point pass_start = std::chrono::steady_clock::now();
+
+    if (!REUSE_CACHE)
+    {
+        shadowed_lights.clear();
+        for (unsigned int i = 0; i < light_container.size(); ++i)
+            shadowed_lights.push_back(i);
+        add_thread_reports(reports, render_tiles(TILES, THREAD_COUNT, [&](const struct Tile& TILE, const unsigned int THREAD_INDEX)
+        {
+            thread_statistics[THREAD_INDEX].primary_rays += trace_tile_visibility(TILE, cache.tiles[&TILE - TILES.data()], visibility_buffers[THREAD_INDEX], &drawn[THREAD_INDEX * 4]);
+        }));
+    }
+    pass_seconds[0] = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+
+    pass_start = std::chrono::steady_clock::now();
+    shadowed_lights.erase(std::remove_if(shadowed_lights.begin(), shadowed_lights.end(), [](const unsigned int LIGHT)
+    {
+        return area_light(light_container[LIGHT]);//traced when shading, see area_light_visibility(...)
+    }), shadowed_lights.end());
+    if (!shadowed_lights.empty())
+        add_thread_reports(reports, render_tiles(TILES, THREAD_COUNT, [&](const struct Tile& TILE, const unsigned int THREAD_INDEX)
+        {
+            struct Sampling_Statistics uncounted;//lists are counted when the tile is shaded
+
+            cull_region_lights(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, &shadowed_lights, tile_lights[THREAD_INDEX], uncounted);
+            shadow_rays[THREAD_INDEX] += trace_tile_shadows(cache.tiles[&TILE - TILES.data()], tile_lights[THREAD_INDEX], ray_queues[THREAD_INDEX], &blocked[THREAD_INDEX * 3]);
+        }));
+    pass_seconds[1] = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+
+    pass_start = std::chrono::steady_clock::now();
+    add_thread_reports(reports, render_tiles(TILES, THREAD_COUNT, [&](const struct Tile& TILE, const unsigned int THREAD_INDEX)
+    {
+        trace_tile_secondary_rays(cache.tiles[&TILE - TILES.data()], ray_queues[THREAD_INDEX], thread_statistics[THREAD_INDEX]);
+    }));
+    pass_seconds[2] = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+
+    pass_start = std::chrono::steady_clock::now();
+    add_thread_reports(reports, render_tiles(TILES, THREAD_COUNT, [&](const struct Tile& TILE, const unsigned int THREAD_INDEX)
+    {
+        struct Sampling_Statistics tile_statistics = render_region(TILE.x_start, TILE.y_start, TILE.x_end, TILE.y_end, tile_scratch[THREAD_INDEX],
+                                                                   &cache.tiles[&TILE - TILES.data()], true, std::vector<unsigned int>());
+
+        if (!REUSE_CACHE)
+            tile_statistics.reshaded_samples = 0;//shaded from this frame's own passes, not re-shaded from an earlier frame
+        add_sampling_statistics(thread_statistics[THREAD_INDEX], tile_statistics);
+        store_tile(frame_buffer, TILE.x_start - X_OFFSET, TILE.y_start - Y_OFFSET, TILE.x_end - TILE.x_start, TILE.y_end - TILE.y_start, tile_scratch[THREAD_INDEX].data());
+    }));
+    pass_seconds[3] = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+
+    for (unsigned int i = 0; i < THREAD_COUNT; ++i)
+    {
+        shadow_ray_total += shadow_rays[i];
+        for (unsigned int j = 0; j < 3; ++j)
+            blocked_total[j] += blocked[i * 3 + j];
+        for (unsigned int j = 0; j < 4; ++j)
+            drawn_total[j] += drawn[i * 4 + j];
+        if (REUSE_CACHE)
+            thread_statistics[i].refreshed_shadow_rays += shadow_rays[i];
+    }
+    std::cout << "Deferred passes: visibility " << pass_seconds[0] << "s, shadows " << pass_seconds[1] << "s, secondary " << pass_seconds[2] << "s, shading "
+              << pass_seconds[3] << "s." << endl;
+    if (render_settings.rasterize && !REUSE_CACHE)
+        std::cout << "Rasterized visibility: " << drawn_total[0] << " triangles and " << drawn_total[1] << " spheres drawn, tested against " << drawn_total[2]
+                  << " samples in all, " << drawn_total[3] << " samples with tied hits traced." << endl;
+    std::cout << "Shadow rays: " << shadow_ray_total << " for " << shadowed_lights.size() << " lights";
+    if (render_settings.shadow_packet_size > 1)
+        std::cout << " in packets of up to " << render_settings.shadow_packet_size;
+    if (pass_seconds[1] > 0.0)
+        std::cout << " (" << shadow_ray_total / pass_seconds[1] / 1000000.0 << "M/s)";
+    std::cout << ", blocked by the plane " << blocked_total[0] << ", spheres " << blocked_total[1] << ", mesh " << blocked_total[2] << "." << endl;
+}
+
+/*
+ * Prints how the work of a frame was spread out and how much memory its pixels took.
+ *
+ * REGION: part of the image that was rendered
+ * TILE_COUNT: number of tiles rendered
+ * THREAD_STATISTICS, REPORTS: one per thread or worker
+ * FRAME_BUFFER_BYTES: size of the frame buffer, or of the band for streamed images
+ */
+static void print_render_report(const struct Tile& REGION, const size_t TILE_COUNT, const std::vector<struct Sampling_Statistics>& THREAD_STATISTICS,
+                                const std::vector<struct Thread_Report>& REPORTS, const size_t FRAME_BUFFER_BYTES)
+{
+    const unsigned int THREAD_COUNT = static_cast<unsigned int>(THREAD_STATISTICS.size()), TILE_SIZE = render_settings.tile_size > 0 ? render_settings.tile_size : DEFAULT_TILE_SIZE;
+    const unsigned long long PIXEL_COUNT = static_cast<unsigned long long>(REGION.x_end - REGION.x_start) * (REGION.y_end - REGION.y_start);
+    struct Sampling_Statistics statistics;
+    double busy_seconds_total = 0.0, busy_seconds_max = 0.0;
+
+    for (unsigned int i = 0; i < THREAD_COUNT; ++i)
+    {
+        std::cout << (render_settings.worker_count > 0 ? "Worker " : "Thread ") << i << ": busy " << REPORTS[i].busy_seconds << "s, " << REPORTS[i].tiles_rendered << " tiles ("
+                  << REPORTS[i].tiles_stolen << (render_settings.worker_count > 0 ? " taken over), " : " stolen), ") << THREAD_STATISTICS[i].primary_rays << " primary rays" << endl;
+        add_sampling_statistics(statistics, THREAD_STATISTICS[i]);
+        busy_seconds_total += REPORTS[i].busy_seconds;
+        if (REPORTS[i].busy_seconds > busy_seconds_max)
+            busy_seconds_max = REPORTS[i].busy_seconds;
+    }
+    if (busy_seconds_total > 0.0)//1.0 is perfect balance, the slowest thread took exactly the average time
+        std::cout << "Load balance: " << TILE_COUNT << " tiles, slowest thread busy " << busy_seconds_max / (busy_seconds_total / THREAD_COUNT) << "x the average." << endl;
+    if (render_settings.samples_per_pixel > 1)
+        std::cout << "Anti-aliasing: refined " << statistics.refined_pixels << " of " << PIXEL_COUNT << " pixels with "
+                  << statistics.primary_rays << " primary rays (" << static_cast<double>(statistics.primary_rays) / PIXEL_COUNT << " per pixel)." << endl;
+    if (render_settings.g_buffer)
+        std::cout << "G-buffer: " << statistics.reshaded_samples << " samples re-shaded from the cache (" << statistics.refreshed_shadow_rays << " shadow rays for "
+                  << render_cache.moved_lights.size() << " moved lights), " << statistics.primary_rays << " traced, cache " << render_cache_bytes(render_cache) / 1048576.0 << "MiB." << endl;
+    {
+        unsigned long long secondary_rays = 0;
+
+        for (unsigned int i = 0; i < MAX_TRACE_DEPTH; ++i)
+            secondary_rays += statistics.secondary_rays[i];
+        if (secondary_rays > 0 || statistics.budget_cut_rays > 0)
+        {
+            std::cout << "Secondary rays: " << secondary_rays << " (";
+            for (unsigned int i = 0; i < render_settings.max_depth; ++i)
+                std::cout << (i > 0 ? ", " : "") << "depth " << i + 1 << ": " << statistics.secondary_rays[i];
+            std::cout << "), " << statistics.budget_cut_rays << " cut by the ray budget." << endl;
+        }
+    }
+    if (statistics.area_light_points > 0)
+        std::cout << "Area lights: " << statistics.area_shadow_rays << " shadow rays for " << statistics.area_light_points << " lit points ("
+                  << static_cast<double>(statistics.area_shadow_rays) / statistics.area_light_points << " per point), " << statistics.penumbra_points << " in a penumbra." << endl;
+    if (statistics.light_cut_points > 0)
+        std::cout << "Light tree: " << static_cast<double>(statistics.light_cut_entries) / statistics.light_cut_points << " cut entries and "
+                  << static_cast<double>(statistics.light_cut_shadow_rays) / statistics.light_cut_points << " shadow rays per shaded point for " << light_tree.lights.size() << " lights." << endl;
+    if (statistics.light_list_entries < statistics.light_list_candidates)
+        std::cout << "Light culling: " << static_cast<double>(statistics.light_list_entries) / statistics.light_lists << " of "
+                  << static_cast<double>(statistics.light_list_candidates) / statistics.light_lists << " lights per tile left for its primary hits." << endl;
+    if (statistics.primitive_lists > 0)
+        std::cout << "Primitive culling: of " << statistics.primitive_lists << " tiles, " << statistics.plane_regions << " can see the plane, " << statistics.mesh_regions
+                  << " the mesh, and " << statistics.sphere_lists << " listed their spheres (" << (statistics.sphere_lists > 0 ? static_cast<double>(statistics.listed_spheres)
+                  / statistics.sphere_lists : 0.0) << " per list) for their primary rays." << endl;
+    std::cout << (render_settings.stream ? "Band buffer: " : "Frame buffer: ") << FRAME_BUFFER_BYTES / 1048576.0
+              << "MiB, tile scratch " << THREAD_COUNT * TILE_SIZE * TILE_SIZE * ARRAY_SIZE * sizeof(float) / 1024.0 << "KiB." << endl;
+}
+
+/*
+ * Bytes held by a frame buffer's pixels.
+ *
+ * FRAME_BUFFER: frame buffer in question
+ */
+static size_t frame_buffer_bytes(const struct Frame_Buffer& FRAME_BUFFER)
+{
+    return FRAME_BUFFER.pixels_8_bit.size() + FRAME_BUFFER.pixels_16_bit.size() * sizeof(unsigned short) + FRAME_BUFFER.pixels_float.size() * sizeof(float);
+}
+
+/*
+ * Loads render_settings.composite_path into frame_buffer, converted to frame_buffer's depth, so a crop can be rendered on top of it. Returns false, with a warning, if
+ * the image cannot be loaded or is not the size of the full frame.
+ *
+ * frame_buffer: frame buffer filled, already set up
+ */
+static bool load_composite_target(struct Frame_Buffer& frame_buffer)
+{
+    cimg_library::CImg<float> image;
+
+    try
+    {
+        image.load(render_settings.composite_path.c_str());
+    }
+    catch (const cimg_library::CImgException&)
+    {
+        cerr << "Warning: unable to load \"" << render_settings.composite_path << "\" to composite into, writing the crop on its own" << endl;
+        return false;
+    }
+    if (static_cast<unsigned int>(image.width()) != image_plane.horizontal || static_cast<unsigned int>(image.height()) != image_plane.vertical || image.spectrum() < 3)
+    {
+        cerr << "Warning: \"" << render_settings.composite_path << "\" is " << image.width() << "x" << image.height() << ", not the " << image_plane.horizontal << "x"
+             << image_plane.vertical << " RGB frame, writing the crop on its own" << endl;
+        return false;
+    }
+    //float files are already in [0, 1], integer files are assumed 16 bit if anything is past 8 bit's range
+    {
+        const std::string& PATH = render_settings.composite_path;
+        const bool FLOAT_FILE = PATH.size() > 4 && PATH.compare(PATH.size() - 4, 4, ".pfm") == 0;
+        cimg_to_frame_buffer(image, FLOAT_FILE ? 1.0f : image.max() > 255.0f ? 65535.0f : 255.0f, frame_buffer);
+    }
+    return true;
+}
+
+/*
+ * Refills the ray budget for a new frame. Worker processes each get an equal share, as they are forked with their own copy of it.
+ */
+static void reset_ray_budget()
+{
+    secondary_rays_left = render_settings.worker_count > 0 ? render_settings.ray_budget / render_settings.worker_count : render_settings.ray_budget;
+}
+
+/*
+ * Ray traces the current state of the scene into frame_buffer and prints how the work was spread out. frame_buffer is resized to fit the camera, or only the crop
+ * when there is one, unless the crop is composited into an existing image.
+ *
+ * frame_buffer: frame buffer being rendered to, set up according to render_settings
+ */
+static void render_frame(struct Frame_Buffer& frame_buffer)
+{
+    const unsigned int THREAD_COUNT = render_settings.worker_count > 0 ? render_settings.worker_count : render_settings.thread_count > 0 ? render_settings.thread_count : 1;
+    std::vector<struct Sampling_Statistics> thread_statistics(THREAD_COUNT);//one per thread or worker to avoid sharing counters
+    std::vector<struct Thread_Report> reports(THREAD_COUNT);
+    std::vector<struct Tile> tiles;
+    struct Tile region;
+    struct Render_Cache frame_cache;//samples of the deferred passes when they are not kept in render_cache
+    struct Render_Cache * cache = render_settings.g_buffer ? &render_cache : render_settings.deferred ? &frame_cache : nullptr;
+    unsigned int x_offset, y_offset;//image pixel frame_buffer's upper left corner is
+    bool reuse_cache = false;
+
+    set_up_image_plane();
+    reset_ray_budget();
+    region = frame_region();
+    tiles = create_tiles(region, render_settings.tile_size > 0 ? render_settings.tile_size : DEFAULT_TILE_SIZE);
+    set_up_frame_buffer(frame_buffer, region.x_end - region.x_start, region.y_end - region.y_start);
+    if (cache != nullptr)
+    {
+        reuse_cache = cache -> valid && cache -> tiles.size() == tiles.size();
+        cache -> tiles.resize(tiles.size());
+    }
+    if (!render_settings.composite_path.empty() && load_composite_target(frame_buffer))
+        x_offset = y_offset = 0;//frame_buffer is the whole image
+    else
+    {
+        x_offset = region.x_start;
+        y_offset = region.y_start;
+    }
+    if (render_settings.deferred)
+        render_tiles_deferred(tiles, frame_buffer, x_offset, y_offset, thread_statistics, reports, *cache, reuse_cache);
+    else
+        render_tiles_into(tiles, frame_buffer, x_offset, y_offset, thread_statistics, reports, cache, reuse_cache);
+    print_render_report(region, tiles.size(), thread_statistics, reports, frame_buffer_bytes(frame_buffer));
+    render_cache.valid = render_settings.g_buffer;
+    render_cache.moved_lights.clear();//their bits are up to date again
+}
+
+/*
+ * Ray traces the current state of the scene straight into a file, a band of rows at a time, so only one band is ever in memory. Images far bigger than memory can
+ * be rendered this way. Bands are the tile size rounded up to a multiple of 16 high, which is also the size of the tiles of a TIFF. Only the crop is written if there is one.
+ *
+ * PATH: file written, render_settings.output_format must be IMAGE_FORMAT_PPM or IMAGE_FORMAT_TIFF
+ */
+static void render_frame_streamed(const std::string& PATH)
+{
+    const unsigned int THREAD_COUNT = render_settings.worker_count > 0 ? render_settings.worker_count : render_settings.thread_count > 0 ? render_settings.thread_count : 1;
+    const unsigned int TILE_SIZE = render_settings.tile_size > 0 ? render_settings.tile_size : DEFAULT_TILE_SIZE, BAND_HEIGHT = (TILE_SIZE + 15) / 16 * 16;
+    std::vector<struct Sampling_Statistics> thread_statistics(THREAD_COUNT);//one per thread or worker to avoid sharing counters
+    std::vector<struct Thread_Report> reports(THREAD_COUNT);
+    struct Frame_Buffer band;
+    struct Image_Stream stream;
+    size_t tile_count = 0, band_bytes;
+    struct Tile region;
+    bool written;
+
+    set_up_image_plane();
+    reset_ray_budget();
+    region = frame_region();
+    set_up_frame_buffer(band, region.x_end - region.x_start, BAND_HEIGHT);
+    band_bytes = frame_buffer_bytes(band);
+    written = open_image_stream(stream, PATH, render_settings.output_format, region.x_end - region.x_start, region.y_end - region.y_start, band.depth == FRAME_BUFFER_8_BIT ? 1 : 2,
+                                BAND_HEIGHT);
+    for (unsigned int band_y = region.y_start; band_y < region.y_end && written; band_y += BAND_HEIGHT)
+    {
+        const unsigned int ROWS = region.y_end - band_y < BAND_HEIGHT ? region.y_end - band_y : BAND_HEIGHT;
+        const std::vector<struct Tile> TILES = create_tiles(Tile{region.x_start, band_y, region.x_end, band_y + ROWS}, TILE_SIZE);
+
+        if (ROWS < BAND_HEIGHT)//last band
+            allocate_frame_buffer(band, region.x_end - region.x_start, ROWS);
+        render_tiles_into(TILES, band, region.x_start, band_y, thread_statistics, reports, nullptr, false);
+        written = write_image_band(stream, band);
+        tile_count += TILES.size();
+    }
+    if (!close_image_stream(stream) || !written)
+        cerr << "Error: unable to write \"" << PATH << "\"" << endl;
+    print_render_report(region, tile_count, thread_statistics, reports, band_bytes);
+}
+
+/*
+ * Path in the Output folder of an image of the scene, in render_settings.output_format, named after the scene and DATE_TIME.
+ *
+ * FILE_NAME: name of the scene
+ * DATE_TIME: time the render started, to uniquely create output file names
+ * SUFFIX: appended to the name, such as a frame number, may be empty
+ */
+static std::string output_file_path(const std::string& FILE_NAME, const struct tm * DATE_TIME, const std::string& SUFFIX)
+{
+    return
+    #ifdef ABSOLUTE_PATH
+        std::string(ABSOLUTE_PATH) +
+    #endif
+    "Output/" + FILE_NAME + " " + std::to_string(DATE_TIME-> tm_year + 1900) + "-" + std::to_string(DATE_TIME-> tm_mon + 1) + "-" + std::to_string(DATE_TIME-> tm_mday) +
+    " " + std::to_string(DATE_TIME-> tm_hour) + "_" + std::to_string(DATE_TIME-> tm_min) + "_" + std::to_string(DATE_TIME-> tm_sec) + SUFFIX + image_format_extension(render_settings.output_format);
+}
+
+/*
+ * Hands a frame buffer to image_writer to be saved. Takes the frame buffer's pixels, leaving frame_buffer empty, so the next frame can be rendered while this one is written.
+ *
+ * frame_buffer: frame buffer being saved
+ * OUTPUT_FILE_PATH: file written, see output_file_path(...)
+ */
+static void save_output_image(struct Frame_Buffer& frame_buffer, const std::string& OUTPUT_FILE_PATH)
+{
+    #ifdef DEBUG_2
+        cerr << OUTPUT_FILE_PATH;
+        {
+            cimg_library::CImgDisplay image_display(frame_buffer_to_cimg(frame_buffer), "Output Image");
+            while (!image_display.is_closed())
+            {
+                image_display.wait();
+            }
+        }
+    #endif
+    queue_image(image_writer, frame_buffer, OUTPUT_FILE_PATH, render_settings.output_format);
+}
+
+/*
+ * Renders the current state of the scene and saves it, streamed band by band if render_settings.stream is set.
+ *
+ * frame_buffer: frame buffer rendered to, unused when streaming
+ * FILE_NAME, DATE_TIME, SUFFIX: see output_file_path(...)
+ */
+static void render_and_save_frame(struct Frame_Buffer& frame_buffer, const std::string& FILE_NAME, const struct tm * DATE_TIME, const std::string& SUFFIX)
+{
+    if (render_settings.stream)
+        render_frame_streamed(output_file_path(FILE_NAME, DATE_TIME, SUFFIX));
+    else
+    {
+        render_frame(frame_buffer);
+        save_output_image(frame_buffer, output_file_path(FILE_NAME, DATE_TIME, SUFFIX));
+    }
+}
+
+int main(int name_of_arguments, char * argument_container [])
+{
+    const std::string FILE_NAME = name_of_arguments > 1 ? argument_container[1] : /*"mesh_scene1"*/"scene1";
+    read_command_line_options(name_of_arguments, argument_container);
+
+    //file reading, if the order of the scene object's attributes was unknown, then could use the discarded part to figure out which attribute.
+    {
+        const std::string INPUT_FILE_PATH =
+            #ifdef ABSOLUTE_PATH
+                std::string(ABSOLUTE_PATH) +
+            #endif
+            "Input/" + FILE_NAME + ".txt";
+        std::fstream target_file = std::fstream(INPUT_FILE_PATH , std::fstream::in);
+
+        if (target_file.is_open())
+        {
+            std::string placeholder;
+            std::getline(target_file, placeholder);
+            const int OBJECT_COUNT = std::stoi(placeholder);//any number of digits
+            #ifdef DEBUG_1
+                cerr << OBJECT_COUNT << endl;
+            #endif
+            for (int i = 0; i < OBJECT_COUNT; ++i)
+            {
+                std::getline(target_file, placeholder);
+                #ifdef DEBUG_1
+                    cerr << placeholder << endl;
+                #endif
+                if (placeholder == "camera")
+                {
+                    file_read_float_array_3(target_file, camera_instance.position);//position
+                    camera_instance.field_of_view = file_read_int(target_file);//field-of-view
+                    camera_instance.focal_length = file_read_int(target_file);//focal length
+                    camera_instance.aspect_ratio = file_read_float(target_file);//aspect ratio
+                }
+                else if (placeholder == "plane")
+                {
+                    plane_instance.active = true;//note that there is a plane in scene
+                    file_read_float_array_3(target_file, plane_instance.normal);//normal
+                    file_read_float_array_3(target_file, plane_instance.position);//position
+                    file_read_setup_object_light_properties(target_file, plane_instance);//setup object_light_properties part
+                }
+                else if (placeholder == "sphere")
+                {
+                    sphere_container.push_back(Sphere());
+                    file_read_float_array_3(target_file, sphere_container.back().position);//position
+                    sphere_container.back().radius = file_read_float(target_file);//radius
+                    file_read_setup_object_light_properties(target_file, sphere_container.back());//setup object_light_properties part
+                }
+                else if (placeholder == "mesh")
+                {
+                    mesh_instance.active = true;//note that there is a mesh in plane
+                    std::getline(target_file, placeholder, ' ');//discard first part
+                    #ifdef DEBUG_1
+                        cerr << placeholder << endl;
+                    #endif
+                    {
+                        std::string filename_plane_holder;
+                        std::getline(target_file, filename_plane_holder);//filename
+                        #ifdef DEBUG_1
+                            cerr << filename_plane_holder << endl;
+                        #endif
+                        filename_plane_holder =
+                        #ifdef ABSOLUTE_PATH
+                            std::string(ABSOLUTE_PATH) +
+                        #endif
+                        "Input/" + filename_plane_holder;
+                        mesh_instance.filename = new char[filename_plane_holder.length() + 1];
+                        strcpy(mesh_instance.filename, filename_plane_holder.c_str());
+                    }
+                    file_read_setup_object_light_properties(target_file, mesh_instance);//setup object_light_properties part
+                    loadOBJ(mesh_instance.filename, mesh_instance.vertices);
+                }
+                else if (placeholder == "light")
+                {
+                    light_container.push_back(Light());
+                    file_read_float_array_3(target_file, light_container.back().position);//position
+                    file_read_setup_object_light_subproperties(target_file, light_container.back());//setup object_light_subproperties part
+                    for (;;)//optional area light shape and range, in any order
+                        if (file_next_line_is(target_file, "rad:"))
+                            light_container.back().radius = file_read_float(target_file);//radius of a spherical light
+                        else if (file_next_line_is(target_file, "u:"))
+                            file_read_float_array_3(target_file, light_container.back().edge_u);//first edge of a rectangular light
+                        else if (file_next_line_is(target_file, "v:"))
+                            file_read_float_array_3(target_file, light_container.back().edge_v);//second edge of a rectangular light
+                        else if (file_next_line_is(target_file, "ran:"))
+                            light_container.back().range = file_read_float(target_file);//distance the light fades out over
+                        else
+                            break;
+                }
+                else
+                {
+                    cerr << "This message should never appear. Read value is \"" << placeholder << "\"" << endl;
+                }
+            }
+            sphere_container.shrink_to_fit();
+            light_container.shrink_to_fit();
+        }
+        else
+            cerr << "Error: unable to open \"" << INPUT_FILE_PATH << "\"" << endl;
+    }
+
+    update_sphere_structure(false);
+    update_mesh_bvh(false);
+    if (render_settings.light_tree_tolerance > 0.0f)
+        update_light_tree();
+
+    {
+        struct Frame_Buffer frame_buffer;
+        //time to uniquely create output file names
+        const time_t RAW_TIME = time(nullptr);
+        const struct tm * DATE_TIME = localtime(&RAW_TIME);
+
+        start_image_writer(image_writer);
+        if (render_settings.sequence_name.empty())
+        {
+            render_and_save_frame(frame_buffer, FILE_NAME, DATE_TIME, "");
+        }
+        else
+        {
+            struct Sequence sequence;
+            const std::string SEQUENCE_FILE_PATH =
+                #ifdef ABSOLUTE_PATH
+                    std::string(ABSOLUTE_PATH) +
+                #endif
+                "Input/" + render_settings.sequence_name + ".txt";
+
+            if (!read_sequence(SEQUENCE_FILE_PATH, sequence))
+                cerr << "Error: unable to open \"" << SEQUENCE_FILE_PATH << "\"" << endl;
+            //scene and acceleration structures stay around between frames, only what changed is updated
+            for (unsigned int frame = 0; frame < sequence.frame_count; ++frame)
+            {
+                const std::chrono::steady_clock::time_point FRAME_START = std::chrono::steady_clock::now();
+                const struct Sequence_Changes CHANGES = apply_sequence_frame(sequence, frame, sphere_container, light_container);
+                double update_milliseconds;
+                std::string frame_number = std::to_string(frame);
+
+                if (CHANGES.any_sphere_moved())
+                    update_sphere_structure(true);
+                if (CHANGES.mesh)
+                    update_mesh_bvh(true);
+                if (render_settings.light_tree_tolerance > 0.0f && (CHANGES.lights || CHANGES.light_colours))
+                    update_light_tree();//sums and representatives change with colours too, and building is cheap
+                if (CHANGES.camera || CHANGES.plane || CHANGES.mesh || CHANGES.any_sphere_moved())
+                    render_cache.valid = false;//primary rays hit something else, everything has to be traced again
+                else if (render_cache.valid && CHANGES.lights)//only the shadow rays of moved lights have to be traced again
+                    for (unsigned int i = 0; i < CHANGES.moved_lights.size(); ++i)
+                        if (CHANGES.moved_lights[i])
+                            render_cache.moved_lights.push_back(i);
+                update_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - FRAME_START).count();
+                frame_number.insert(0, frame_number.size() < 4 ? 4 - frame_number.size() : 0, '0');//pad so frames sort by name
+                render_and_save_frame(frame_buffer, FILE_NAME, DATE_TIME, " frame " + frame_number);
+                std::cout << "Frame " << frame << ": scene updated in " << update_milliseconds << "ms, frame took "
+                          << std::chrono::duration<double>(std::chrono::steady_clock::now() - FRAME_START).count() << "s." << endl;
+            }
         }
+        stop_image_writer(image_writer);//waits for the last images to be written
     }
 }
 
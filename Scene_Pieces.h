@@ -5,7 +5,7 @@ Programmer: Gabriel Toban Harris
 Date: 2019-03-[30, 31]/2019-4-10
 */
 #ifndef SCENE_PIECES_H_
-#define OBJLOADER_MODIFIED_H
+#define SCENE_PIECES_H_
 
 #include <vector>
 #include <array>
@@ -23,6 +23,9 @@ struct Object_Light_Properties : Object_Light_Subproperties
 {
     float shininess;//"specular shininess factor"
     float ambient_colour [ARRAY_SIZE];//"ambient color of the object"
+    float reflectivity [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};//optional "ref", colour of what is seen in mirror reflection off the object
+    float transmission [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};//optional "tra", colour of what is seen refracted through the object
+    float refractive_index = 1.0f;//optional "ior", index of refraction of the object's inside, outside is vacuum
 };
 
 struct Camera
@@ -51,11 +54,16 @@ struct Mesh : Object_Light_Properties
     bool active = false;//boolean for if struct is in use
     char * filename;//"where filename.obj is the OBJ file containing the mesh"
     std::vector<std::array<float, ARRAY_SIZE>> vertices;//vertices defining the mesh
+    float position [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};//translation already applied to vertices, only ever changed by a sequence
 }mesh_instance;
 
 struct Light : Object_Light_Subproperties
 {
     float position [ARRAY_SIZE];//"position of the light"
+    float radius = 0.0f;//optional "rad", radius of a spherical area light around position
+    float edge_u [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};//optional "u", first edge of a rectangular area light centred on position
+    float edge_v [ARRAY_SIZE] = {0.0f, 0.0f, 0.0f};//optional "v", second edge of a rectangular area light centred on position
+    float range = 0.0f;//optional "ran", distance the light fades out over, 0 for a light that reaches everywhere at full strength
 };
 
 #endif /* SCENE_PIECES_H_ */
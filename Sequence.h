@@ -0,0 +1,302 @@
+/**
+Program name: Sequence.h
+Purpose: keyframed sequences, which animate the objects of an already read scene over a number of frames
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef SEQUENCE_H_
+#define SEQUENCE_H_
+
+#include "Scene_Pieces.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+/*
+ * A sequence file looks like the following, where every "key" block sets properties of one object at one frame. Properties are linearly interpolated between the
+ * keys of the same object and property, and hold their first/last keyed value before/after them. Properties never keyed keep their value from the scene file.
+ *
+ * frames: 120
+ * key
+ * frame: 0
+ * object: light 0
+ * pos: 0 60 -50
+ * dif: 0.9 0.9 0.9
+ * key
+ * frame: 119
+ * object: light 0
+ * pos: 60 60 -50
+ *
+ * Objects are "camera", "plane", "mesh", "sphere i" and "light i", where i counts the spheres/lights in the order they appear in the scene file. Properties are those
+ * of the scene file: pos, rad, amb, dif, spe, shi, ref, tra and ior, an area light's rad, u and v, and a light's ran. A mesh's pos translates the whole mesh.
+ */
+
+//Value of a property at a frame.
+struct Keyframe
+{
+    unsigned int frame;
+    float value [ARRAY_SIZE];//only [0] is used by single value properties
+};
+
+//All the keys of one property of one object, sorted by frame.
+struct Keyframe_Track
+{
+    std::string object;//"camera", "plane", "mesh", "sphere" or "light"
+    unsigned int object_index;//which sphere or light
+    std::string property;//"pos", "rad", "amb", "dif", "spe", "shi", "ref", "tra", "ior", "u", "v" or "ran"
+    std::vector<struct Keyframe> keyframes;
+};
+
+struct Sequence
+{
+    unsigned int frame_count = 0;
+    std::vector<struct Keyframe_Track> tracks;
+};
+
+//What apply_sequence_frame(...) changed compared to the previous frame.
+struct Sequence_Changes
+{
+    bool camera = false;//camera moved
+    bool plane = false;//plane moved
+    bool mesh = false;//mesh moved
+    bool lights = false;//a light moved or changed shape
+    bool light_colours = false;//a light's colour changed
+    bool materials = false;//an object's amb, dif, spe, shi, ref, tra or ior changed
+    std::vector<bool> moved_spheres;//per sphere, whether its position or radius changed
+    std::vector<bool> moved_lights;//per light, whether its position or shape changed
+
+    bool any_sphere_moved() const
+    {
+        return std::find(moved_spheres.begin(), moved_spheres.end(), true) != moved_spheres.end();
+    }
+};
+
+/*
+ * Reads a sequence file. Returns false if the file could not be opened.
+ *
+ * PATH: sequence file
+ * sequence: where the read sequence is stored
+ */
+static bool read_sequence(const std::string& PATH, struct Sequence& sequence)
+{
+    std::fstream input_file(PATH, std::fstream::in);
+    std::string line;
+    unsigned int frame = 0;
+    std::string object;
+    unsigned int object_index = 0;
+
+    if (!input_file.is_open())
+        return false;
+    while (std::getline(input_file, line))
+    {
+        std::istringstream line_stream(line);
+        std::string label;
+
+        line_stream >> label;
+        if (label.empty())
+            continue;
+        if (label == "frames:")
+            line_stream >> sequence.frame_count;
+        else if (label == "key")
+        {
+            object.clear();
+            object_index = 0;
+        }
+        else if (label == "frame:")
+            line_stream >> frame;
+        else if (label == "object:")
+        {
+            line_stream >> object;
+            if (object == "sphere" || object == "light")
+                line_stream >> object_index;
+            else
+                object_index = 0;
+        }
+        else
+        {
+            const std::string PROPERTY = label.substr(0, label.size() - 1);//discard ':'
+            struct Keyframe keyframe = {frame, {0.0f, 0.0f, 0.0f}};
+            struct Keyframe_Track * track = nullptr;
+
+            for (unsigned int i = 0; i < ARRAY_SIZE; ++i)//single value properties leave the rest at 0
+                line_stream >> keyframe.value[i];
+            for (unsigned int i = 0; i < sequence.tracks.size() && track == nullptr; ++i)
+                if (sequence.tracks[i].object == object && sequence.tracks[i].object_index == object_index && sequence.tracks[i].property == PROPERTY)
+                    track = &sequence.tracks[i];
+            if (track == nullptr)
+            {
+                sequence.tracks.push_back({object, object_index, PROPERTY, std::vector<struct Keyframe>()});
+                track = &sequence.tracks.back();
+            }
+            track -> keyframes.push_back(keyframe);
+        }
+    }
+    for (unsigned int i = 0; i < sequence.tracks.size(); ++i)
+        std::stable_sort(sequence.tracks[i].keyframes.begin(), sequence.tracks[i].keyframes.end(), [](const struct Keyframe& A, const struct Keyframe& B) {return A.frame < B.frame;});
+    return true;
+}
+
+/*
+ * Calculates the value of a track at a frame.
+ *
+ * TRACK: track being evaluated, has at least one key
+ * FRAME: frame wanted
+ * value: where the result is stored
+ */
+static void evaluate_track(const struct Keyframe_Track& TRACK, const unsigned int FRAME, float value [ARRAY_SIZE])
+{
+    unsigned int next = 0;
+
+    while (next < TRACK.keyframes.size() && TRACK.keyframes[next].frame <= FRAME)
+        ++next;
+    if (next == 0 || next == TRACK.keyframes.size())//before the first or after the last key
+    {
+        std::copy(TRACK.keyframes[next == 0 ? 0 : next - 1].value, TRACK.keyframes[next == 0 ? 0 : next - 1].value + ARRAY_SIZE, value);
+        return;
+    }
+    {
+        const struct Keyframe& PREVIOUS = TRACK.keyframes[next - 1];
+        const struct Keyframe& NEXT = TRACK.keyframes[next];
+        const float WEIGHT = static_cast<float>(FRAME - PREVIOUS.frame) / (NEXT.frame - PREVIOUS.frame);
+
+        for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+            value[i] = PREVIOUS.value[i] + (NEXT.value[i] - PREVIOUS.value[i]) * WEIGHT;
+    }
+}
+
+/*
+ * Copies a value into a property if it differs. Returns true if the property changed.
+ *
+ * VALUE: new value
+ * property: property being set
+ * SIZE: number of floats in the property
+ */
+static bool set_property(const float VALUE [ARRAY_SIZE], float * property, const unsigned int SIZE)
+{
+    bool changed = false;
+
+    for (unsigned int i = 0; i < SIZE; ++i)
+        if (property[i] != VALUE[i])
+        {
+            property[i] = VALUE[i];
+            changed = true;
+        }
+    return changed;
+}
+
+/*
+ * Sets a material property of an object. Returns true if it changed.
+ *
+ * PROPERTY: name of the property
+ * VALUE: new value
+ * object: object being changed
+ */
+static bool set_material_property(const std::string& PROPERTY, const float VALUE [ARRAY_SIZE], struct Object_Light_Properties& object)
+{
+    if (PROPERTY == "amb")
+        return set_property(VALUE, object.ambient_colour, ARRAY_SIZE);
+    else if (PROPERTY == "dif")
+        return set_property(VALUE, object.diffuse_colour, ARRAY_SIZE);
+    else if (PROPERTY == "spe")
+        return set_property(VALUE, object.specular_colour, ARRAY_SIZE);
+    else if (PROPERTY == "shi")
+        return set_property(VALUE, &object.shininess, 1);
+    else if (PROPERTY == "ref")
+        return set_property(VALUE, object.reflectivity, ARRAY_SIZE);
+    else if (PROPERTY == "tra")
+        return set_property(VALUE, object.transmission, ARRAY_SIZE);
+    else if (PROPERTY == "ior")
+        return set_property(VALUE, &object.refractive_index, 1);
+    return false;
+}
+
+/*
+ * Moves the scene to a frame of a sequence. Returns what changed since the state the scene was in, so only those parts need to be updated.
+ *
+ * SEQUENCE: sequence being played
+ * FRAME: frame to move to
+ * sphere_container, light_container: the scene's spheres and lights, camera_instance, plane_instance and mesh_instance are changed as well
+ */
+static struct Sequence_Changes apply_sequence_frame(const struct Sequence& SEQUENCE, const unsigned int FRAME, std::vector<struct Sphere>& sphere_container, std::vector<struct Light>& light_container)
+{
+    struct Sequence_Changes changes;
+    float value [ARRAY_SIZE];
+
+    changes.moved_spheres.assign(sphere_container.size(), false);
+    changes.moved_lights.assign(light_container.size(), false);
+    for (unsigned int i = 0; i < SEQUENCE.tracks.size(); ++i)
+    {
+        const struct Keyframe_Track& TRACK = SEQUENCE.tracks[i];
+
+        if (TRACK.keyframes.empty())
+            continue;
+        evaluate_track(TRACK, FRAME, value);
+        if (TRACK.object == "camera")
+        {
+            if (TRACK.property == "pos")
+                changes.camera |= set_property(value, camera_instance.position, ARRAY_SIZE);
+        }
+        else if (TRACK.object == "plane")
+        {
+            if (TRACK.property == "pos")
+                changes.plane |= set_property(value, plane_instance.position, ARRAY_SIZE);
+            else
+                changes.materials |= set_material_property(TRACK.property, value, plane_instance);
+        }
+        else if (TRACK.object == "mesh")
+        {
+            if (TRACK.property == "pos")
+            {
+                float offset [ARRAY_SIZE];
+
+                for (unsigned int j = 0; j < ARRAY_SIZE; ++j)
+                    offset[j] = value[j] - mesh_instance.position[j];
+                if (set_property(value, mesh_instance.position, ARRAY_SIZE))
+                {
+                    changes.mesh = true;
+                    for (unsigned int j = 0; j < mesh_instance.vertices.size(); ++j)
+                        for (unsigned int k = 0; k < ARRAY_SIZE; ++k)
+                            mesh_instance.vertices[j][k] += offset[k];
+                }
+            }
+            else
+                changes.materials |= set_material_property(TRACK.property, value, mesh_instance);
+        }
+        else if (TRACK.object == "sphere" && TRACK.object_index < sphere_container.size())
+        {
+            struct Sphere& sphere = sphere_container[TRACK.object_index];
+
+            if (TRACK.property == "pos")
+                changes.moved_spheres[TRACK.object_index] = set_property(value, sphere.position, ARRAY_SIZE) || changes.moved_spheres[TRACK.object_index];
+            else if (TRACK.property == "rad")
+                changes.moved_spheres[TRACK.object_index] = set_property(value, &sphere.radius, 1) || changes.moved_spheres[TRACK.object_index];
+            else
+                changes.materials |= set_material_property(TRACK.property, value, sphere);
+        }
+        else if (TRACK.object == "light" && TRACK.object_index < light_container.size())
+        {
+            struct Light& light = light_container[TRACK.object_index];
+
+            if (TRACK.property == "pos")
+                changes.moved_lights[TRACK.object_index] = set_property(value, light.position, ARRAY_SIZE) || changes.moved_lights[TRACK.object_index];
+            else if (TRACK.property == "dif")
+                changes.light_colours |= set_property(value, light.diffuse_colour, ARRAY_SIZE);
+            else if (TRACK.property == "spe")
+                changes.light_colours |= set_property(value, light.specular_colour, ARRAY_SIZE);
+            else if (TRACK.property == "rad" || TRACK.property == "u" || TRACK.property == "v")//a changed shape changes the shadows like moving does
+                changes.moved_lights[TRACK.object_index] = set_property(value, TRACK.property == "rad" ? &light.radius : TRACK.property == "u" ? light.edge_u : light.edge_v,
+                                                                        TRACK.property == "rad" ? 1 : ARRAY_SIZE) || changes.moved_lights[TRACK.object_index];
+            else if (TRACK.property == "ran")//lights are left out of the cached light masks of points out of their range
+                changes.moved_lights[TRACK.object_index] = set_property(value, &light.range, 1) || changes.moved_lights[TRACK.object_index];
+        }
+        else
+            std::cerr << "Warning: sequence track for unknown object \"" << TRACK.object << " " << TRACK.object_index << "\" ignored." << std::endl;
+    }
+    changes.lights = std::find(changes.moved_lights.begin(), changes.moved_lights.end(), true) != changes.moved_lights.end();
+    return changes;
+}
+
+#endif /* SEQUENCE_H_ */
@@ -0,0 +1,153 @@
+/**
+Program name: Tile_Scheduler.h
+Purpose: work-stealing scheduler that spreads the tiles of an image over several threads
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef TILE_SCHEDULER_H_
+#define TILE_SCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+//Rectangle of pixels rendered as a unit, [x_start, x_end) x [y_start, y_end).
+struct Tile
+{
+    unsigned int x_start, y_start;//inclusive upper left corner
+    unsigned int x_end, y_end;//exclusive lower right corner
+};
+
+//What a single thread did during render_tiles(...), used to check load balance.
+struct Thread_Report
+{
+    double busy_seconds = 0.0;//time spent inside the tile function
+    unsigned int tiles_rendered = 0;//tiles this thread rendered, including stolen ones
+    unsigned int tiles_stolen = 0;//tiles taken from another thread's deque
+};
+
+//Deque of tile indices owned by a thread. The owner takes from the back, thieves take from the front so they grab tiles the owner would get to last.
+struct Tile_Deque
+{
+    std::mutex lock;
+    std::deque<unsigned int> tile_indices;
+};
+
+/*
+ * Splits a region of an image into tiles, row by row, starting at the region's upper left corner. Tiles on the right and bottom edges are smaller when TILE_SIZE does
+ * not divide the region.
+ *
+ * REGION: part of the image to cover, in pixels
+ * TILE_SIZE: width and height of a tile in pixels
+ */
+static std::vector<struct Tile> create_tiles(const struct Tile& REGION, const unsigned int TILE_SIZE)
+{
+    std::vector<struct Tile> tiles;
+
+    for (unsigned int y = REGION.y_start; y < REGION.y_end; y += TILE_SIZE)
+        for (unsigned int x = REGION.x_start; x < REGION.x_end; x += TILE_SIZE)
+            tiles.push_back({x, y, x + TILE_SIZE < REGION.x_end ? x + TILE_SIZE : REGION.x_end, y + TILE_SIZE < REGION.y_end ? y + TILE_SIZE : REGION.y_end});
+    return tiles;
+}
+
+/*
+ * Takes the next tile for a thread, first from its own deque, then by stealing from the others. Returns false once every deque is empty, since tiles are never added
+ * after the start that means all the work has been handed out.
+ *
+ * deques: one per thread
+ * THREAD_INDEX: thread asking for work
+ * tile_index: where the taken tile is stored
+ * stolen: set to whether the tile came from another thread
+ */
+static bool take_tile(std::vector<struct Tile_Deque>& deques, const unsigned int THREAD_INDEX, unsigned int& tile_index, bool& stolen)
+{
+    {
+        std::lock_guard<std::mutex> guard(deques[THREAD_INDEX].lock);
+        if (!deques[THREAD_INDEX].tile_indices.empty())
+        {
+            tile_index = deques[THREAD_INDEX].tile_indices.back();
+            deques[THREAD_INDEX].tile_indices.pop_back();
+            stolen = false;
+            return true;
+        }
+    }
+    for (unsigned int i = 1; i < deques.size(); ++i)
+    {
+        struct Tile_Deque& victim = deques[(THREAD_INDEX + i) % deques.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if (!victim.tile_indices.empty())
+        {
+            tile_index = victim.tile_indices.front();
+            victim.tile_indices.pop_front();
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Renders every tile once using THREAD_COUNT threads. Each thread starts with a contiguous share of the tiles in its own deque and steals from the others when it
+ * runs out, so threads that got cheap tiles help out those with expensive ones. Returns a report per thread.
+ *
+ * TILES: tiles to render
+ * THREAD_COUNT: number of threads, the calling thread is one of them
+ * render_tile: called as render_tile(tile, thread index), must be safe to call concurrently for different tiles
+ */
+template <typename Tile_Function>
+static std::vector<struct Thread_Report> render_tiles(const std::vector<struct Tile>& TILES, const unsigned int THREAD_COUNT, Tile_Function render_tile)
+{
+    std::vector<struct Tile_Deque> deques(THREAD_COUNT);
+    std::vector<struct Thread_Report> reports(THREAD_COUNT);
+
+    //static split as the starting point
+    for (unsigned int i = 0; i < TILES.size(); ++i)
+        deques[static_cast<unsigned long long>(i) * THREAD_COUNT / TILES.size()].tile_indices.push_back(i);
+
+    {
+        auto worker = [&](const unsigned int THREAD_INDEX)
+        {
+            unsigned int tile_index;
+            bool stolen;
+
+            while (take_tile(deques, THREAD_INDEX, tile_index, stolen))
+            {
+                const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+                render_tile(TILES[tile_index], THREAD_INDEX);
+                reports[THREAD_INDEX].busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - START).count();
+                ++reports[THREAD_INDEX].tiles_rendered;
+                if (stolen)
+                    ++reports[THREAD_INDEX].tiles_stolen;
+            }
+        };
+        std::vector<std::thread> threads;
+
+        for (unsigned int i = 1; i < THREAD_COUNT; ++i)
+            threads.push_back(std::thread(worker, i));
+        worker(0);
+        for (unsigned int i = 0; i < threads.size(); ++i)
+            threads[i].join();
+    }
+    return reports;
+}
+
+/*
+ * Adds the work in one set of reports to another, for frames rendered with several calls to render_tiles(...).
+ *
+ * reports: reports added to
+ * ADDED: reports added, one per thread like reports
+ */
+static void add_thread_reports(std::vector<struct Thread_Report>& reports, const std::vector<struct Thread_Report>& ADDED)
+{
+    for (unsigned int i = 0; i < reports.size() && i < ADDED.size(); ++i)
+    {
+        reports[i].busy_seconds += ADDED[i].busy_seconds;
+        reports[i].tiles_rendered += ADDED[i].tiles_rendered;
+        reports[i].tiles_stolen += ADDED[i].tiles_stolen;
+    }
+}
+
+#endif /* TILE_SCHEDULER_H_ */
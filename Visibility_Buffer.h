@@ -0,0 +1,147 @@
+/**
+Program name: Visibility_Buffer.h
+Purpose: what the primary ray of every sample of a window of pixels first hits, filled by rasterizing primitives over the samples rather than tracing each ray
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef VISIBILITY_BUFFER_H_
+#define VISIBILITY_BUFFER_H_
+
+#include "Scene_Pieces.h"
+#include "Ray_Queue.h"
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+#define VISIBILITY_PADDING 7//unused samples after the last, so reading up to 8 samples from the last ones stays in bounds
+
+//Closest hit of every sample of a window of pixels, all with the same number of samples, one array per field. Samples are row major by pixel with the samples
+//of a pixel together, so the samples of a row of pixels are one contiguous run.
+struct Visibility_Buffer
+{
+    unsigned int x_start, y_start, width, height;//window, in image coordinates
+    unsigned int samples_per_pixel;
+    std::vector<float> directions [ARRAY_SIZE];//normalized direction of each sample's primary ray, one array per axis
+    std::vector<float> depths;//scalar to the closest hit so far, FLT_MAX while there is none
+    std::vector<unsigned char> kinds;//see Ray_Hit
+    std::vector<unsigned int> primitives;//what was hit, see Ray_Hit
+    std::vector<unsigned char> ties;//whether something else was hit at exactly the sample's depth, see store_visibility_hit(...)
+    size_t empty_samples;//samples nothing has hit yet
+    float farthest_depth;//largest of depths when it was last looked for, see farthest_visibility_depth(...)
+    bool farthest_stale;//whether the sample farthest_depth was at has been hit by something closer since
+    std::vector<unsigned int> drawn_marks;//per primitive that may be reached more than once, the last window it was drawn in, see mark_visibility_drawn(...)
+    unsigned int window_count = 0;//windows reset for, numbering them for drawn_marks
+};
+
+/*
+ * Sizes a visibility buffer for a window with nothing hit yet, keeping its memory. Directions are left for the caller to fill in, padding included.
+ *
+ * buffer: visibility buffer reset
+ * X_START, Y_START, WIDTH, HEIGHT: the window, in image coordinates
+ * SAMPLES_PER_PIXEL: samples of each pixel
+ */
+static void reset_visibility_buffer(struct Visibility_Buffer& buffer, const unsigned int X_START, const unsigned int Y_START, const unsigned int WIDTH, const unsigned int HEIGHT,
+                                    const unsigned int SAMPLES_PER_PIXEL)
+{
+    const size_t COUNT = static_cast<size_t>(WIDTH) * HEIGHT * SAMPLES_PER_PIXEL;
+
+    buffer.x_start = X_START;
+    buffer.y_start = Y_START;
+    buffer.width = WIDTH;
+    buffer.height = HEIGHT;
+    buffer.samples_per_pixel = SAMPLES_PER_PIXEL;
+    for (unsigned int i = 0; i < ARRAY_SIZE; ++i)
+        buffer.directions[i].assign(COUNT + VISIBILITY_PADDING, 0.0f);
+    buffer.depths.assign(COUNT + VISIBILITY_PADDING, FLT_MAX);
+    buffer.kinds.assign(COUNT, RAY_HIT_NOTHING);
+    buffer.primitives.assign(COUNT, 0);
+    buffer.ties.assign(COUNT, 0);
+    buffer.empty_samples = COUNT;
+    buffer.farthest_depth = FLT_MAX;
+    buffer.farthest_stale = false;
+    if (++buffer.window_count == 0)//numbers wrapped, old marks could be mistaken for this window's
+    {
+        buffer.drawn_marks.assign(buffer.drawn_marks.size(), 0);
+        buffer.window_count = 1;
+    }
+}
+
+/*
+ * Index of the first sample of a pixel.
+ *
+ * BUFFER: visibility buffer in question
+ * X, Y: pixel, in image coordinates, inside the window
+ */
+static size_t visibility_sample(const struct Visibility_Buffer& BUFFER, const unsigned int X, const unsigned int Y)
+{
+    return (static_cast<size_t>(Y - BUFFER.y_start) * BUFFER.width + (X - BUFFER.x_start)) * BUFFER.samples_per_pixel;
+}
+
+/*
+ * Depth test: records a hit for a sample if it is strictly closer than what the sample has. Of hits at exactly the same scalar the first one drawn stays, while a
+ * traced ray keeps the first one it finds, which depends on the order it traverses the scene in, so the sample is marked as tied until something closer is drawn.
+ * Returns whether the hit was recorded.
+ *
+ * buffer: visibility buffer drawn into
+ * SAMPLE: sample hit
+ * DISTANCE: scalar to the hit, NaN is never recorded
+ * KIND, PRIMITIVE: what was hit, see Ray_Hit
+ */
+static bool store_visibility_hit(struct Visibility_Buffer& buffer, const size_t SAMPLE, const float DISTANCE, const enum Ray_Hit KIND, const unsigned int PRIMITIVE)
+{
+    if (!(DISTANCE < buffer.depths[SAMPLE]))
+    {
+        buffer.ties[SAMPLE] |= DISTANCE == buffer.depths[SAMPLE] ? 1 : 0;
+        return false;
+    }
+    buffer.empty_samples -= buffer.depths[SAMPLE] == FLT_MAX ? 1 : 0;
+    buffer.farthest_stale = buffer.farthest_stale || buffer.depths[SAMPLE] >= buffer.farthest_depth;
+    buffer.depths[SAMPLE] = DISTANCE;
+    buffer.kinds[SAMPLE] = static_cast<unsigned char>(KIND);
+    buffer.primitives[SAMPLE] = PRIMITIVE;
+    buffer.ties[SAMPLE] = 0;
+    return true;
+}
+
+/*
+ * Largest depth of any sample of a visibility buffer, FLT_MAX while some sample has nothing. Whatever is only further away than this cannot change the buffer.
+ * Depths only shrink, so the samples are only looked through again once the farthest of them was hit by something closer.
+ *
+ * buffer: visibility buffer in question
+ */
+static float farthest_visibility_depth(struct Visibility_Buffer& buffer)
+{
+    if (buffer.empty_samples > 0)
+        return FLT_MAX;
+    if (buffer.farthest_stale)
+    {
+        const size_t COUNT = buffer.kinds.size();
+        float farthest = -FLT_MAX;
+
+        for (size_t i = 0; i < COUNT; ++i)
+            farthest = std::max(farthest, buffer.depths[i]);
+        buffer.farthest_depth = farthest;
+        buffer.farthest_stale = false;
+    }
+    return buffer.farthest_depth;
+}
+
+/*
+ * Marks a primitive as drawn into the visibility buffer's current window, for primitives that can be reached more than once, as drawing one twice would mark its
+ * samples as tied with themselves. Returns false if it already was.
+ *
+ * buffer: visibility buffer drawn into
+ * PRIMITIVE: index of the primitive
+ * COUNT: number of primitives of its kind
+ */
+static bool mark_visibility_drawn(struct Visibility_Buffer& buffer, const unsigned int PRIMITIVE, const size_t COUNT)
+{
+    if (buffer.drawn_marks.size() != COUNT)
+        buffer.drawn_marks.assign(COUNT, 0);
+    if (buffer.drawn_marks[PRIMITIVE] == buffer.window_count)
+        return false;
+    buffer.drawn_marks[PRIMITIVE] = buffer.window_count;
+    return true;
+}
+
+#endif /* VISIBILITY_BUFFER_H_ */
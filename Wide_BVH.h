@@ -0,0 +1,541 @@
+/**
+Program name: Wide_BVH.h
+Purpose: BVHs with 4 or 8 children per node, collapsed from a binary BVH, whose child boxes are tested against a ray all at once with SSE or AVX, and 4 wide
+         ones with quantized boxes in nodes of a cache line each
+Programmer: Gabriel Toban Harris
+Date: 2026-10-19
+*/
+#ifndef WIDE_BVH_H_
+#define WIDE_BVH_H_
+
+#include "BVH.h"
+#include <vector>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+#include <new>
+
+#ifdef __AVX__
+    #define WIDE_BVH_DEFAULT_WIDTH 8//one AVX register of child boxes per node
+#else
+    #define WIDE_BVH_DEFAULT_WIDTH 4//one SSE register of child boxes per node
+#endif
+#define COMPRESSED_BVH_EMPTY_CHILD UINT_MAX//Compressed_BVH_Node::children of unused children
+#define COMPRESSED_BVH_LEAF_BIT 0x80000000u//set in Compressed_BVH_Node::children of leaves
+#define COMPRESSED_BVH_COUNT_SHIFT 27//leaves keep their number of primitives minus 1 in the 4 bits from here, and their first primitive in the bits below
+#define COMPRESSED_BVH_LEAF_LIMIT 16//most primitives a leaf of a compressed BVH can have
+
+//Allocator giving elements the alignment their type asks for, which std::allocator only does from C++17, so nodes kept in a std::vector really are as aligned
+//as their SIMD loads expect.
+template <typename T>
+struct Aligned_Allocator
+{
+    typedef T value_type;
+
+    Aligned_Allocator() {}
+    template <typename U>
+    Aligned_Allocator(const Aligned_Allocator<U>&) {}
+
+    T * allocate(const size_t COUNT)
+    {
+        void * memory = _mm_malloc(COUNT * sizeof(T), alignof(T));
+
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T *>(memory);
+    }
+
+    void deallocate(T * memory, size_t)
+    {
+        _mm_free(memory);
+    }
+};
+
+template <typename T, typename U>
+static bool operator==(const Aligned_Allocator<T>&, const Aligned_Allocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+static bool operator!=(const Aligned_Allocator<T>&, const Aligned_Allocator<U>&)
+{
+    return false;
+}
+
+//std::vector with its elements aligned, see Aligned_Allocator.
+template <typename T>
+using Aligned_Vector = std::vector<T, Aligned_Allocator<T> >;
+
+//Node of a wide BVH. Child boxes are stored one array per bound, so child i is lane i of a SIMD register. Unused children have inverted boxes no ray hits.
+template <unsigned int WIDTH>
+struct Wide_BVH_Node
+{
+    alignas(32) float bounds [6][WIDTH];//minimum x, y, z then maximum x, y, z of every child
+    unsigned int children [WIDTH];//index of interior children in Wide_BVH::nodes, or for leaves the index into BVH::primitive_indices of their first primitive
+    unsigned int counts [WIDTH];//number of primitives of leaf children, 0 for interior and unused children
+};
+
+//Wide BVH, leaves refer to ranges of the primitive_indices of the binary BVH it was collapsed from.
+template <unsigned int WIDTH>
+struct Wide_BVH
+{
+    Aligned_Vector<struct Wide_BVH_Node<WIDTH> > nodes;//nodes[0] is the root, empty if there are no primitives
+};
+
+//Node of a compressed BVH, 4 wide and 64 bytes, one cache line. Child boxes are quantized to 8 bits per bound on a grid over the box of all of them.
+struct alignas(64) Compressed_BVH_Node
+{
+    float origin [3];//minimum corner of the box of every child, where the grid starts
+    float scale [3];//size of a grid step per axis, a power of 2 so origin + bound * scale rounds only once, whether or not it is computed with a fused multiply add
+    unsigned char bounds [6][4];//minimum x, y, z then maximum x, y, z of every child in grid steps, minimums rounded down and maximums up so boxes only grow
+    unsigned int children [4];//index of interior children in Compressed_BVH::nodes, COMPRESSED_BVH_LEAF_BIT and the range of primitives for leaves, see
+                              //COMPRESSED_BVH_COUNT_SHIFT, or COMPRESSED_BVH_EMPTY_CHILD
+};
+
+//Compressed BVH, nodes are in the same order as the 4 wide BVH it was compressed from, leaves refer to the primitive_indices of the binary BVH that was collapsed from.
+struct Compressed_BVH
+{
+    Aligned_Vector<struct Compressed_BVH_Node> nodes;//nodes[0] is the root, empty if there are no primitives
+};
+
+//What traversing a wide BVH needs of a ray, worked out once per ray.
+struct Wide_BVH_Ray
+{
+    float origin [3];
+    float inverse_direction [3];//1 / ray direction per axis
+    unsigned int near_bounds [3], far_bounds [3];//per axis, which of Wide_BVH_Node::bounds the ray enters and leaves through, picked by the sign of the direction
+};
+
+/*
+ * Fills in a node of a wide BVH from a binary node, recursively collapsing the binary tree under it. Starting from the binary node's children, the interior child
+ * with the largest box is replaced by its own two children until there are WIDTH children or only leaves.
+ *
+ * wide: tree being built, WIDE_INDEX must already be in wide.nodes
+ * TREE: binary tree collapsed
+ * WIDE_INDEX: node filled in
+ * NODE_INDEX: node of TREE it stands for, only a leaf for the root of a tree that is a single leaf
+ */
+template <unsigned int WIDTH>
+static void collapse_bvh_node(struct Wide_BVH<WIDTH>& wide, const struct BVH& TREE, const unsigned int WIDE_INDEX, const unsigned int NODE_INDEX)
+{
+    unsigned int slots [WIDTH], slot_count = 0, i;//nodes of TREE that become children
+
+    if (TREE.nodes[NODE_INDEX].count > 0)
+        slots[slot_count++] = NODE_INDEX;
+    else
+    {
+        slots[slot_count++] = TREE.nodes[NODE_INDEX].first;
+        slots[slot_count++] = TREE.nodes[NODE_INDEX].first + 1;
+    }
+    while (slot_count < WIDTH)
+    {
+        unsigned int widest = slot_count;
+        float widest_area = -1.0f;
+
+        for (i = 0; i < slot_count; ++i)
+            if (TREE.nodes[slots[i]].count == 0 && bounding_box_area(TREE.nodes[slots[i]].bounds) > widest_area)
+            {
+                widest = i;
+                widest_area = bounding_box_area(TREE.nodes[slots[i]].bounds);
+            }
+        if (widest == slot_count)//all leaves
+            break;
+        slots[slot_count++] = TREE.nodes[slots[widest]].first + 1;
+        slots[widest] = TREE.nodes[slots[widest]].first;
+    }
+
+    for (i = 0; i < WIDTH; ++i)
+    {
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            wide.nodes[WIDE_INDEX].bounds[j][i] = i < slot_count ? TREE.nodes[slots[i]].bounds.minimum[j] : FLT_MAX;
+            wide.nodes[WIDE_INDEX].bounds[j + 3][i] = i < slot_count ? TREE.nodes[slots[i]].bounds.maximum[j] : -FLT_MAX;
+        }
+        wide.nodes[WIDE_INDEX].children[i] = i < slot_count && TREE.nodes[slots[i]].count > 0 ? TREE.nodes[slots[i]].first : 0;
+        wide.nodes[WIDE_INDEX].counts[i] = i < slot_count ? TREE.nodes[slots[i]].count : 0;
+    }
+    for (i = 0; i < slot_count; ++i)
+        if (TREE.nodes[slots[i]].count == 0)
+        {
+            const unsigned int CHILD_INDEX = static_cast<unsigned int>(wide.nodes.size());
+
+            wide.nodes[WIDE_INDEX].children[i] = CHILD_INDEX;
+            wide.nodes.emplace_back();//invalidates references into wide.nodes, hence the indexing
+            collapse_bvh_node(wide, TREE, CHILD_INDEX, slots[i]);
+        }
+}
+
+/*
+ * Collapses a binary BVH into a wide one, replacing whatever wide held. Cheap next to building TREE, so wide trees are collapsed again whenever their binary
+ * tree is built or refit.
+ *
+ * wide: where the wide BVH is stored
+ * TREE: binary tree collapsed, leaves of wide refer to its primitive_indices
+ */
+template <unsigned int WIDTH>
+static void collapse_bvh(struct Wide_BVH<WIDTH>& wide, const struct BVH& TREE)
+{
+    wide.nodes.clear();
+    if (TREE.nodes.empty())
+        return;
+    wide.nodes.reserve(TREE.nodes.size() / (WIDTH - 1) + 1);//every wide node takes the place of at least WIDTH - 1 binary ones, unless leaves end the collapse early
+    wide.nodes.emplace_back();
+    collapse_bvh_node(wide, TREE, 0, 0);
+}
+
+/*
+ * Position of a quantized bound of a compressed node.
+ *
+ * NODE: node the bound is of
+ * AXIS: axis of the bound
+ * STEPS: the bound, in grid steps
+ */
+static float dequantize_bound(const struct Compressed_BVH_Node& NODE, const unsigned int AXIS, const unsigned int STEPS)
+{
+    return NODE.origin[AXIS] + static_cast<float>(STEPS) * NODE.scale[AXIS];
+}
+
+/*
+ * Compresses a 4 wide BVH, replacing whatever compressed held. Every node's grid spans the box of its children in 255 steps, rounded up to a power of 2, and
+ * each bound is moved out to the nearest grid line that still contains the child. Returns false, leaving compressed empty, if a leaf has more than
+ * COMPRESSED_BVH_LEAF_LIMIT primitives or refers past what the bits of Compressed_BVH_Node::children can hold.
+ *
+ * compressed: where the compressed BVH is stored
+ * WIDE: tree compressed
+ */
+static bool compress_bvh(struct Compressed_BVH& compressed, const struct Wide_BVH<4>& WIDE)
+{
+    compressed.nodes.resize(WIDE.nodes.size());
+    for (size_t node = 0; node < WIDE.nodes.size(); ++node)
+    {
+        const struct Wide_BVH_Node<4>& SOURCE = WIDE.nodes[node];
+        struct Compressed_BVH_Node& target = compressed.nodes[node];
+        bool used [4];
+
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            used[i] = SOURCE.counts[i] > 0 || SOURCE.children[i] != 0;//only unused children point at the root
+            if (!used[i])
+                target.children[i] = COMPRESSED_BVH_EMPTY_CHILD;
+            else if (SOURCE.counts[i] == 0)
+                target.children[i] = SOURCE.children[i];
+            else if (SOURCE.counts[i] <= COMPRESSED_BVH_LEAF_LIMIT && SOURCE.children[i] < 1u << COMPRESSED_BVH_COUNT_SHIFT)
+                target.children[i] = COMPRESSED_BVH_LEAF_BIT | (SOURCE.counts[i] - 1) << COMPRESSED_BVH_COUNT_SHIFT | SOURCE.children[i];
+            else
+            {
+                compressed.nodes.clear();
+                return false;
+            }
+        }
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            float maximum = -FLT_MAX;
+            int exponent;
+
+            target.origin[axis] = FLT_MAX;
+            for (unsigned int i = 0; i < 4; ++i)
+                if (used[i])
+                {
+                    target.origin[axis] = std::min(target.origin[axis], SOURCE.bounds[axis][i]);
+                    maximum = std::max(maximum, SOURCE.bounds[axis + 3][i]);
+                }
+            frexp((maximum - target.origin[axis]) / 255.0f * 1.001f, &exponent);//a little extra so 255 steps still reach past maximum after rounding
+            target.scale[axis] = std::max(static_cast<float>(ldexp(1.0f, exponent)), FLT_MIN);
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                unsigned int low = 255, high = 0;//inverted for unused children
+
+                if (used[i])
+                {
+                    low = static_cast<unsigned int>(std::min(floor((SOURCE.bounds[axis][i] - target.origin[axis]) / target.scale[axis]), 255.0f));
+                    high = static_cast<unsigned int>(std::max(std::min(ceil((SOURCE.bounds[axis + 3][i] - target.origin[axis]) / target.scale[axis]), 255.0f), 0.0f));
+                    //the division rounds, so step until the bounds contain the child for certain
+                    while (low > 0 && dequantize_bound(target, axis, low) > SOURCE.bounds[axis][i])
+                        --low;
+                    while (high < 255 && dequantize_bound(target, axis, high) < SOURCE.bounds[axis + 3][i])
+                        ++high;
+                }
+                target.bounds[axis][i] = static_cast<unsigned char>(low);
+                target.bounds[axis + 3][i] = static_cast<unsigned char>(high);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Slab test of a ray against every child box of a node at once, see ray_hits_bounding_box(...). Returns a mask with bit i set if child i is hit, and stores the
+ * distance each child is entered at.
+ *
+ * NODE: node whose children are tested
+ * RAY: ray tested
+ * MINIMUM_DISTANCE, MAXIMUM_DISTANCE: part of the ray that matters, in terms of scalar
+ * entry_distances: where the distance every child is entered at is stored
+ */
+template <unsigned int WIDTH>
+static unsigned int wide_bvh_node_hits(const struct Wide_BVH_Node<WIDTH>& NODE, const struct Wide_BVH_Ray& RAY, const float MINIMUM_DISTANCE, const float MAXIMUM_DISTANCE,
+                                       float entry_distances [WIDTH])
+{
+    unsigned int mask = 0;
+
+    //max and min return their second operand when the first is NaN, from a 0 direction starting on a slab, which leaves the interval alone like the scalar test
+    #ifdef __AVX__
+        if (WIDTH == 8)
+        {
+            __m256 minimum = _mm256_set1_ps(MINIMUM_DISTANCE), maximum = _mm256_set1_ps(MAXIMUM_DISTANCE);
+
+            for (unsigned int axis = 0; axis < 3; ++axis)
+            {
+                const __m256 ORIGIN = _mm256_set1_ps(RAY.origin[axis]), INVERSE_DIRECTION = _mm256_set1_ps(RAY.inverse_direction[axis]);
+
+                minimum = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(NODE.bounds[RAY.near_bounds[axis]]), ORIGIN), INVERSE_DIRECTION), minimum);
+                maximum = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(NODE.bounds[RAY.far_bounds[axis]]), ORIGIN), INVERSE_DIRECTION), maximum);
+            }
+            _mm256_storeu_ps(entry_distances, minimum);
+            return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(minimum, maximum, _CMP_LE_OQ)));
+        }
+    #endif
+    for (unsigned int lane = 0; lane < WIDTH; lane += 4)
+    {
+        __m128 minimum = _mm_set1_ps(MINIMUM_DISTANCE), maximum = _mm_set1_ps(MAXIMUM_DISTANCE);
+
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            const __m128 ORIGIN = _mm_set1_ps(RAY.origin[axis]), INVERSE_DIRECTION = _mm_set1_ps(RAY.inverse_direction[axis]);
+
+            minimum = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(&NODE.bounds[RAY.near_bounds[axis]][lane]), ORIGIN), INVERSE_DIRECTION), minimum);
+            maximum = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(&NODE.bounds[RAY.far_bounds[axis]][lane]), ORIGIN), INVERSE_DIRECTION), maximum);
+        }
+        _mm_storeu_ps(&entry_distances[lane], minimum);
+        mask |= static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(minimum, maximum))) << lane;
+    }
+    return mask;
+}
+
+/*
+ * Slab test of a ray against every child box of a compressed node at once, see wide_bvh_node_hits(...) above. The bounds are widened back to floats 4 at a time,
+ * so the test itself is the same.
+ *
+ * NODE, RAY, MINIMUM_DISTANCE, MAXIMUM_DISTANCE, entry_distances: see wide_bvh_node_hits(...) above
+ */
+static unsigned int wide_bvh_node_hits(const struct Compressed_BVH_Node& NODE, const struct Wide_BVH_Ray& RAY, const float MINIMUM_DISTANCE, const float MAXIMUM_DISTANCE,
+                                       float entry_distances [4])
+{
+    const __m128i ZERO = _mm_setzero_si128();
+    __m128 minimum = _mm_set1_ps(MINIMUM_DISTANCE), maximum = _mm_set1_ps(MAXIMUM_DISTANCE);
+    unsigned int mask;
+
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        const __m128 ORIGIN = _mm_set1_ps(RAY.origin[axis]), INVERSE_DIRECTION = _mm_set1_ps(RAY.inverse_direction[axis]);
+        const __m128 GRID_ORIGIN = _mm_set1_ps(NODE.origin[axis]), SCALE = _mm_set1_ps(NODE.scale[axis]);
+        int near_steps, far_steps;//4 bytes each, one per child
+        __m128 near_bounds, far_bounds;
+
+        memcpy(&near_steps, NODE.bounds[RAY.near_bounds[axis]], sizeof(near_steps));
+        memcpy(&far_steps, NODE.bounds[RAY.far_bounds[axis]], sizeof(far_steps));
+        near_bounds = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(near_steps), ZERO), ZERO));
+        far_bounds = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(far_steps), ZERO), ZERO));
+        near_bounds = _mm_add_ps(GRID_ORIGIN, _mm_mul_ps(near_bounds, SCALE));//see dequantize_bound(...)
+        far_bounds = _mm_add_ps(GRID_ORIGIN, _mm_mul_ps(far_bounds, SCALE));
+        minimum = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(near_bounds, ORIGIN), INVERSE_DIRECTION), minimum);
+        maximum = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(far_bounds, ORIGIN), INVERSE_DIRECTION), maximum);
+    }
+    _mm_storeu_ps(entry_distances, minimum);
+    mask = static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(minimum, maximum)));
+    for (unsigned int i = 0; i < 4; ++i)
+        if (NODE.children[i] == COMPRESSED_BVH_EMPTY_CHILD)
+            mask &= ~(1u << i);
+    return mask;
+}
+
+/*
+ * Where a child of a wide node points.
+ *
+ * NODE: node the child is of
+ * CHILD: which child
+ * index: where the index of the child node, or of the first primitive of a leaf, is stored
+ * count: where the number of primitives of a leaf is stored, 0 for interior children
+ */
+template <unsigned int WIDTH>
+static void wide_bvh_child(const struct Wide_BVH_Node<WIDTH>& NODE, const unsigned int CHILD, unsigned int& index, unsigned int& count)
+{
+    index = NODE.children[CHILD];
+    count = NODE.counts[CHILD];
+}
+
+/*
+ * Where a child of a compressed node points, see wide_bvh_child(...) above.
+ *
+ * NODE, CHILD, index, count: see wide_bvh_child(...) above
+ */
+static void wide_bvh_child(const struct Compressed_BVH_Node& NODE, const unsigned int CHILD, unsigned int& index, unsigned int& count)
+{
+    const unsigned int CODE = NODE.children[CHILD];
+
+    index = (CODE & COMPRESSED_BVH_LEAF_BIT) != 0 ? CODE & ((1u << COMPRESSED_BVH_COUNT_SHIFT) - 1) : CODE;
+    count = (CODE & COMPRESSED_BVH_LEAF_BIT) != 0 ? (CODE >> COMPRESSED_BVH_COUNT_SHIFT & (COMPRESSED_BVH_LEAF_LIMIT - 1)) + 1 : 0;
+}
+
+/*
+ * Visits the leaves of a wide or compressed BVH a ray passes through, nearest first, see traverse_bvh_leaves(...). Children a ray hits are pushed farthest first,
+ * each with the distance it is entered at, and skipped when popped if a closer hit has lowered maximum_distance below that distance since.
+ *
+ * NODES: nodes of the tree traversed, Wide_BVH_Node or Compressed_BVH_Node
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance: see traverse_bvh(...)
+ * ROOT: node the traversal starts from, 0 for the whole tree, see wide_bvh_entry_node(...)
+ * intersect_leaf: called as intersect_leaf(first, count) for the range of BVH::primitive_indices of every leaf, returns true to stop the traversal
+ */
+template <unsigned int WIDTH, typename Node, typename Leaf_Function>
+static void traverse_wide_nodes(const Aligned_Vector<Node>& NODES, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE,
+                                const float& maximum_distance, const unsigned int ROOT, Leaf_Function intersect_leaf)
+{
+    struct Stack_Entry
+    {
+        unsigned int index, count;//see wide_bvh_child(...)
+        float distance;//where the ray enters the child
+    };
+    struct Stack_Entry stack [BVH_STACK_SIZE * (WIDTH - 1) + 1];//every level of the tree adds at most WIDTH - 1 entries
+    struct Wide_BVH_Ray ray;
+    alignas(32) float entry_distances [WIDTH];
+    unsigned int stack_size = 0;
+
+    if (NODES.empty())
+        return;
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        ray.origin[i] = RAY_ORIGIN[i];
+        ray.inverse_direction[i] = 1.0f / RAY_DIRECTION[i];
+        ray.near_bounds[i] = ray.inverse_direction[i] >= 0.0f ? i : i + 3;
+        ray.far_bounds[i] = ray.inverse_direction[i] >= 0.0f ? i + 3 : i;
+    }
+    stack[stack_size++] = {ROOT, 0, MINIMUM_DISTANCE};
+    while (stack_size > 0)
+    {
+        const struct Stack_Entry ENTRY = stack[--stack_size];
+
+        if (ENTRY.distance > maximum_distance)
+            continue;
+        if (ENTRY.count > 0)
+        {
+            if (intersect_leaf(ENTRY.index, ENTRY.count))
+                return;
+            continue;
+        }
+        {
+            const Node& NODE = NODES[ENTRY.index];
+            const unsigned int MASK = wide_bvh_node_hits(NODE, ray, MINIMUM_DISTANCE, maximum_distance, entry_distances);
+            const unsigned int FIRST_PUSHED = stack_size;
+
+            for (unsigned int lane = 0; lane < WIDTH; ++lane)
+                if ((MASK >> lane & 1u) != 0)
+                {
+                    unsigned int slot = stack_size++;
+
+                    //insertion sort, so the pushed entries go from farthest to nearest
+                    for (; slot > FIRST_PUSHED && stack[slot - 1].distance < entry_distances[lane]; --slot)
+                        stack[slot] = stack[slot - 1];
+                    wide_bvh_child(NODE, lane, stack[slot].index, stack[slot].count);
+                    stack[slot].distance = entry_distances[lane];
+                }
+        }
+    }
+}
+
+/*
+ * Visits the leaves of a wide BVH a ray passes through, see traverse_wide_nodes(...).
+ *
+ * TREE: tree traversed
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf: see traverse_wide_nodes(...)
+ */
+template <unsigned int WIDTH, typename Leaf_Function>
+static void traverse_wide_bvh(const struct Wide_BVH<WIDTH>& TREE, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE,
+                              const float& maximum_distance, const unsigned int ROOT, Leaf_Function intersect_leaf)
+{
+    traverse_wide_nodes<WIDTH>(TREE.nodes, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+}
+
+/*
+ * Visits the leaves of a compressed BVH a ray passes through, see traverse_wide_nodes(...).
+ *
+ * TREE: tree traversed
+ * RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf: see traverse_wide_nodes(...)
+ */
+template <typename Leaf_Function>
+static void traverse_compressed_bvh(const struct Compressed_BVH& TREE, const float RAY_ORIGIN [3], const float RAY_DIRECTION [3], const float MINIMUM_DISTANCE,
+                                    const float& maximum_distance, const unsigned int ROOT, Leaf_Function intersect_leaf)
+{
+    traverse_wide_nodes<4>(TREE.nodes, RAY_ORIGIN, RAY_DIRECTION, MINIMUM_DISTANCE, maximum_distance, ROOT, intersect_leaf);
+}
+
+/*
+ * Box of a child of a wide node. Returns false for unused children.
+ *
+ * NODE: node the child is of
+ * CHILD: which child
+ * box: where the box is stored
+ */
+template <unsigned int WIDTH>
+static bool wide_bvh_child_bounds(const struct Wide_BVH_Node<WIDTH>& NODE, const unsigned int CHILD, struct Bounding_Box& box)
+{
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        box.minimum[axis] = NODE.bounds[axis][CHILD];
+        box.maximum[axis] = NODE.bounds[axis + 3][CHILD];
+    }
+    return box.minimum[0] <= box.maximum[0];
+}
+
+/*
+ * Box of a child of a compressed node, see wide_bvh_child_bounds(...) above.
+ *
+ * NODE, CHILD, box: see wide_bvh_child_bounds(...) above
+ */
+static bool wide_bvh_child_bounds(const struct Compressed_BVH_Node& NODE, const unsigned int CHILD, struct Bounding_Box& box)
+{
+    for (unsigned int axis = 0; axis < 3; ++axis)
+    {
+        box.minimum[axis] = dequantize_bound(NODE, axis, NODE.bounds[axis][CHILD]);
+        box.maximum[axis] = dequantize_bound(NODE, axis, NODE.bounds[axis + 3][CHILD]);
+    }
+    return NODE.children[CHILD] != COMPRESSED_BVH_EMPTY_CHILD;
+}
+
+/*
+ * Node of a wide or compressed BVH a traversal can start from instead of the root, see bvh_entry_node(...). Goes down for as long as just one child is accepted
+ * and it is not a leaf, as traversals start from interior nodes.
+ *
+ * NODES: nodes of the tree, Wide_BVH_Node or Compressed_BVH_Node
+ * box_wanted: see bvh_entry_node(...)
+ */
+template <unsigned int WIDTH, typename Node, typename Box_Function>
+static unsigned int wide_bvh_entry_node(const Aligned_Vector<Node>& NODES, Box_Function box_wanted)
+{
+    unsigned int node = 0;
+
+    if (NODES.empty())
+        return BVH_NO_NODE;
+    for (;;)
+    {
+        struct Bounding_Box box;
+        unsigned int wanted = 0, next = BVH_NO_NODE, index, count;
+
+        for (unsigned int child = 0; child < WIDTH; ++child)
+            if (wide_bvh_child_bounds(NODES[node], child, box) && box_wanted(box))
+            {
+                wide_bvh_child(NODES[node], child, index, count);
+                next = count > 0 ? BVH_NO_NODE : index;
+                ++wanted;
+            }
+        if (wanted == 0)
+            return BVH_NO_NODE;
+        if (wanted > 1 || next == BVH_NO_NODE)
+            return node;
+        node = next;
+    }
+}
+
+#endif /* WIDE_BVH_H_ */